@@ -50,6 +50,9 @@ struct FileStackNamedNode { /* NODE_FILE, NODE_MACRO */
 };
 
 extern size_t nMaxRecursionDepth;
+/* For `--stats` */
+extern uint32_t nbMacroInvocations;
+extern uint32_t nbReptIterations;
 
 struct MacroArgs;
 
@@ -10,6 +10,7 @@
 #define RGBDS_ASM_LEXER_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #define MAXSTRLEN	255
 
@@ -32,6 +33,9 @@ static inline void lexer_SetStateAtEOL(struct LexerState *state)
 	lexerStateEOL = state;
 }
 
+/* Number of expansions (EQUS, macro args, interpolations) performed, for `--stats` */
+extern uint32_t nbExpansions;
+
 extern char binDigits[2];
 extern char gfxDigits[4];
 
@@ -25,6 +25,7 @@ extern char *tzTargetFileName;
 extern bool oGeneratedMissingIncludes;
 extern bool oFailedOnMissingInclude;
 extern bool oGeneratePhonyDeps;
+extern bool oScanDepsOnly;
 
 /* TODO: are these really needed? */
 #define YY_FATAL_ERROR fatalerror
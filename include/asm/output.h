@@ -18,6 +18,7 @@ struct FileStackNode;
 
 extern char *tzObjectname;
 extern struct Section *pSectionList, *pCurrentSection;
+extern uint32_t nbPatches; /* For `--stats` */
 
 void out_RegisterNode(struct FileStackNode *node);
 void out_ReplaceNode(struct FileStackNode *node);
@@ -0,0 +1,47 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2021, RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Attribution of assembly time and output to files and macros (`--profile`) */
+#ifndef RGBDS_ASM_PROFILE_H
+#define RGBDS_ASM_PROFILE_H
+
+#include <stdbool.h>
+
+extern bool profiling;
+
+/**
+ * Enables profiling.
+ * @param reportPath Where to write the sorted report, or NULL for none
+ * @param tracePath Where to write a Chrome trace of context changes, or NULL for none
+ */
+void prof_Init(char const *reportPath, char const *tracePath);
+
+/**
+ * Signals that a new file or macro context was entered; time and output from now
+ * on are attributed to it. Nothing should be attributed to `name` before this!
+ * @param name The name to attribute to; contexts with the same name are aggregated
+ */
+void prof_EnterNamedContext(char const *name);
+
+/**
+ * Signals that a new REPT or FOR context was entered; time and output are still
+ * attributed to the enclosing named context.
+ */
+void prof_EnterReptContext(void);
+
+/**
+ * Signals that the current context was exited.
+ */
+void prof_ExitContext(void);
+
+/**
+ * Closes all contexts still open, and writes the report.
+ */
+void prof_Finish(void);
+
+#endif /* RGBDS_ASM_PROFILE_H */
@@ -29,6 +29,8 @@ struct Section {
 	uint32_t bank;
 	uint8_t align;
 	uint16_t alignOfs;
+	bool isRelaxable; /* Whether the linker may shorten its `jp`s */
+	bool hasRelaxableJumps; /* Whether it may already have shrunk at the current offset */
 	struct Section *next;
 	struct Patch *patches;
 	uint8_t *data;
@@ -38,6 +40,7 @@ struct SectionSpec {
 	uint32_t bank;
 	uint8_t alignment;
 	uint16_t alignOfs;
+	bool isRelaxable;
 };
 
 struct Section *out_FindSectionByName(const char *name);
@@ -52,6 +55,7 @@ void out_EndLoadSection(void);
 struct Section *sect_GetSymbolSection(void);
 uint32_t sect_GetSymbolOffset(void);
 uint32_t sect_GetOutputOffset(void);
+uint64_t sect_GetNbBytesWritten(void);
 void sect_AlignPC(uint8_t alignment, uint16_t offset);
 
 void sect_StartUnion(void);
@@ -68,6 +72,7 @@ void out_String(char const *s);
 void out_RelByte(struct Expression *expr, uint32_t pcShift);
 void out_RelBytes(uint32_t n, struct Expression *exprs, size_t size);
 void out_RelWord(struct Expression *expr, uint32_t pcShift);
+void out_RelJumpWord(struct Expression *expr, uint32_t pcShift);
 void out_RelLong(struct Expression *expr, uint32_t pcShift);
 void out_PCRelByte(struct Expression *expr, uint32_t pcShift);
 void out_BinaryFile(char const *s, int32_t startPos);
@@ -15,17 +15,37 @@
 #define XFLIP 0x40
 #define YFLIP 0x20
 
+/* Tiles converted so far, with a hash table to find duplicates quickly */
+struct Tileset {
+	uint8_t *data; /* The tiles, in the order they were added */
+	int num_tiles;
+	int capacity; /* How many tiles `data` can hold */
+	int tile_size;
+	int *slots; /* Indices of tiles, -1 if empty; NULL if not deduplicating */
+	int mask;
+};
+
+void transpose_tiles(struct GBImage *gb, int width);
+void raw_row_to_gb(const uint8_t *row, int y, int width, int height,
+		   struct GBImage *gb);
 void raw_to_gb(const struct RawIndexedImage *raw_image, struct GBImage *gb);
 void output_file(const struct Options *opts, const struct GBImage *gb);
-int get_tile_index(uint8_t *tile, uint8_t **tiles, int num_tiles,
-		   int tile_size);
+void init_tileset(struct Tileset *tileset, int tile_size, bool unique);
+void free_tileset(struct Tileset *tileset);
+int add_tile(struct Tileset *tileset, const uint8_t *tile);
+int get_tile_index(uint8_t *tile, const struct Tileset *tileset);
 uint8_t reverse_bits(uint8_t b);
 void xflip(uint8_t *tile, uint8_t *tile_xflip, int tile_size);
 void yflip(uint8_t *tile, uint8_t *tile_yflip, int tile_size);
-int get_mirrored_tile_index(uint8_t *tile, uint8_t **tiles, int num_tiles,
-			    int tile_size, int *flags);
+int get_mirrored_tile_index(uint8_t *tile, const struct Tileset *tileset,
+			    int *flags);
+void add_image_tiles(const struct Options *opts, const struct GBImage *gb,
+		     struct Tileset *tileset, struct Mapfile *tilemap,
+		     struct Mapfile *attrmap);
 void create_mapfiles(const struct Options *opts, struct GBImage *gb,
 		     struct Mapfile *tilemap, struct Mapfile *attrmap);
+void output_tileset_file(const struct Options *opts,
+			 const struct Tileset *tileset);
 void output_tilemap_file(const struct Options *opts,
 			 const struct Mapfile *tilemap);
 void output_attrmap_file(const struct Options *opts,
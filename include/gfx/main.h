@@ -15,6 +15,8 @@
 
 #include "extern/err.h"
 
+#include "platform.h"
+
 struct Options {
 	bool debug;
 	bool verbose;
@@ -83,7 +85,8 @@ struct Mapfile {
 	int size;
 };
 
-extern int depth, colors;
+/* Batch mode may convert images with different depths on several threads */
+extern thread_local_ int depth, colors;
 
 #include "gfx/makepng.h"
 #include "gfx/gb.h"
@@ -12,7 +12,8 @@
 #include "gfx/main.h"
 
 struct RawIndexedImage *input_png_file(const struct Options *opts,
-				       struct ImageOptions *png_options);
+				       struct ImageOptions *png_options,
+				       struct GBImage *gb);
 void output_png_file(const struct Options *opts,
 		     const struct ImageOptions *png_options,
 		     const struct RawIndexedImage *raw_image);
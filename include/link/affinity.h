@@ -0,0 +1,39 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2021, RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Reading which sections are used together, to place them close to each other */
+#ifndef RGBDS_LINK_AFFINITY_H
+#define RGBDS_LINK_AFFINITY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct Affinity {
+	char *names[2]; /* The names of the two sections */
+	uint64_t count; /* How often the two sections were used together */
+};
+
+/**
+ * Reads an affinity profile, listing how often pairs of sections are used together.
+ * @param fileName The path to the profile
+ */
+void aff_Read(char const *fileName);
+
+/**
+ * Gets the affinities that were read.
+ * @param nbAffinities Set to how many affinities there are
+ * @return The affinities, from the highest count to the lowest
+ */
+struct Affinity const *aff_GetAffinities(size_t *nbAffinities);
+
+/**
+ * `free`s all affinity memory that was allocated.
+ */
+void aff_Cleanup(void);
+
+#endif /* RGBDS_LINK_AFFINITY_H */
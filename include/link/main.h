@@ -18,6 +18,7 @@
 
 /* Variables related to CLI options */
 extern bool isDmgMode;
+extern unsigned long nbThreads;
 extern char       *linkerScriptName;
 extern char const *mapFileName;
 extern char const *symFileName;
@@ -28,6 +29,12 @@ extern bool is32kMode;
 extern bool beVerbose;
 extern bool isWRA0Mode;
 extern bool disablePadding;
+extern bool collectGarbage;
+extern char const **rootSymbols;
+extern uint32_t nbRootSymbols;
+extern bool foldIdenticalSections;
+extern char const *stateFileName;
+extern char const *affinityFileName;
 
 struct FileStackNode {
 	struct FileStackNode *parent;
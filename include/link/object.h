@@ -13,16 +13,50 @@
 
 /**
  * Read an object (.o) file, and add its info to the data structures.
+ * If the file is a library, only its index is read.
  * @param fileName A path to the object file to be read
  * @param i The ID of the file
  */
 void obj_ReadFile(char const *fileName, unsigned int i);
 
+/**
+ * Read the library members that define symbols which are still undefined,
+ * until all symbols that libraries can define are.
+ * Must be called once all files given on the command line have been read.
+ */
+void obj_ReadLibraryMembers(void);
+
+/**
+ * Bundle object files into a library, indexing the symbols they export.
+ * @param libName The path to write the library to
+ * @param fileNames The paths to the object files
+ * @param nbFiles How many object files there are
+ */
+void obj_MakeLibrary(char const *libName, char * const *fileNames, unsigned int nbFiles);
+
+/**
+ * Write all the objects that were read as a single relocatable object, with the
+ * symbols that they define resolved, and their sections merged.
+ * @param fileName The path to write the object to
+ */
+void obj_WriteRelocatable(char const *fileName);
+
 /**
  * Perform validation on the object files' contents
  */
 void obj_DoSanityChecks(void);
 
+/**
+ * Remove the sections that nothing refers to, keeping those that assertions
+ * refer to
+ */
+void obj_CollectGarbage(void);
+
+/**
+ * Shorten `jp`s to `jr`s where possible, once sections are placed
+ */
+void obj_RelaxJumps(void);
+
 /**
  * Evaluate all assertions
  */
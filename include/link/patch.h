@@ -30,6 +30,38 @@ struct Assertion {
 	struct Assertion *next;
 };
 
+/**
+ * Calls a function for each section that a patch's expression refers to,
+ * either through a symbol, `BANK()`, or PC.
+ * The same section may be passed several times.
+ * @param patch The patch whose expression to scan
+ * @param fileSymbols The symbols of the file the patch comes from
+ * @param callback The function to call for each section
+ */
+void patch_ForEachSectionRef(struct Patch const *patch,
+			     struct Symbol const * const *fileSymbols,
+			     void (*callback)(struct Section *section));
+
+/**
+ * Checks whether two patches will always compute the same value, assuming
+ * that the sections containing them are folded together.
+ * @param patch1 The first patch
+ * @param section1 The section containing the first patch
+ * @param patch2 The second patch
+ * @param section2 The section containing the second patch
+ * @return True if the patches are equivalent
+ */
+bool patch_AreEquivalent(struct Patch const *patch1, struct Section const *section1,
+			 struct Patch const *patch2, struct Section const *section2);
+
+/**
+ * Shortens the `jp`s of relaxable sections to `jr`s when their target is close
+ * enough, moving the rest of their section accordingly.
+ * Must be called once sections are placed, and before any other patching.
+ * @param assertions The assertions, which may refer to PC in those sections
+ */
+void patch_RelaxJumps(struct Assertion *assertions);
+
 /**
  * Checks all assertions
  * @return true if assertion failed
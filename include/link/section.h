@@ -37,7 +37,7 @@ struct Patch {
 	int32_t rpnSize;
 	uint8_t *rpnExpression;
 
-	struct Section const *pcSection;
+	struct Section *pcSection;
 };
 
 struct Section {
@@ -60,8 +60,10 @@ struct Section {
 	/* Extra info computed during linking */
 	struct Symbol **fileSymbols;
 	uint32_t nbSymbols;
-	struct Symbol const **symbols;
+	struct Symbol **symbols;
 	struct Section *nextu; /* The next "component" of this unionized sect */
+	bool isReferenced; /* Only meaningful while collecting garbage */
+	struct Section *folded; /* The next section folded into this one */
 };
 
 /*
@@ -87,6 +89,44 @@ void sect_AddSection(struct Section *section);
  */
 struct Section *sect_GetSection(char const *name);
 
+/**
+ * Concatenates the data of each fragmented section's fragments.
+ * Must be called once all object files have been read.
+ */
+void sect_ConcatFragments(void);
+
+/**
+ * Marks a section as referenced, so that `sect_CollectGarbage` keeps it.
+ * @param section The section, or any of its components
+ */
+void sect_MarkReferenced(struct Section *section);
+
+/**
+ * Removes all sections that are not reachable from a root: sections with a
+ * fixed address, the labels named with `-s`, and the sections marked with
+ * `sect_MarkReferenced`. Sections reachable from a kept one are kept too.
+ */
+void sect_CollectGarbage(void);
+
+/**
+ * Folds identical floating sections together: only one of them is placed,
+ * and the others' symbols are moved to it.
+ */
+void sect_FoldIdenticalSections(void);
+
+/**
+ * Reports how much has been saved by folding identical sections.
+ * @param nbSections Set to the number of sections that were folded
+ * @return The total size of the folded sections
+ */
+uint32_t sect_GetFoldedSize(uint32_t *nbSections);
+
+/**
+ * `free`s a section, all of its components, and the sections folded into it.
+ * @param section The section to free; it must not be registered anymore
+ */
+void sect_FreeSection(struct Section *section);
+
 /**
  * `free`s all section memory that was allocated.
  */
@@ -0,0 +1,63 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2021, RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Remembering a link's results, to relink faster afterwards */
+#ifndef RGBDS_LINK_STATE_H
+#define RGBDS_LINK_STATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "link/section.h"
+
+/**
+ * Reads the state left by the previous link, if there is one.
+ * @param fileName The path to the state file
+ */
+void state_Read(char const *fileName);
+
+/**
+ * Gets where the previous link placed a section.
+ * @param section The section to look up
+ * @param bank Set to the bank the section was placed in
+ * @param org Set to the address the section was placed at
+ * @return True if the section was placed by the previous link
+ */
+bool state_GetPlacement(struct Section const *section, uint32_t *bank, uint16_t *org);
+
+/**
+ * Checks whether the output file can be updated in place, instead of rewritten.
+ * This is only the case if the file is still what the previous link wrote, and
+ * every bank would be written at the same offset with the same length.
+ * @param fileName The path to the output file
+ * @param bankLens The length of each bank that will be written, ROM0 first
+ * @param nbBanks How many banks will be written
+ */
+bool state_CanUpdateOutput(char const *fileName, uint16_t const *bankLens, uint32_t nbBanks);
+
+/**
+ * Records the contents of a bank of the output file.
+ * @param index The index of the bank in the output file, ROM0 being 0
+ * @param data The contents of the bank
+ * @param len The length of the bank
+ * @return True if the bank is not known to be already in the output file
+ */
+bool state_UpdateBank(uint32_t index, uint8_t const *data, uint16_t len);
+
+/**
+ * Writes the state of this link, once all output files have been written.
+ * @param fileName The path to the state file
+ */
+void state_Write(char const *fileName);
+
+/**
+ * `free`s all state memory that was allocated.
+ */
+void state_Cleanup(void);
+
+#endif /* RGBDS_LINK_STATE_H */
@@ -14,7 +14,10 @@
 
 #define RGBDS_OBJECT_VERSION_STRING "RGB%1u"
 #define RGBDS_OBJECT_VERSION_NUMBER 9U
-#define RGBDS_OBJECT_REV 7U
+#define RGBDS_OBJECT_REV 8U
+
+#define RGBDS_LIBRARY_ID "RGBL"
+#define RGBDS_LIBRARY_REV 1U
 
 enum AssertionType {
 	ASSERT_WARN,
@@ -104,6 +107,7 @@ enum PatchType {
 	PATCHTYPE_WORD,
 	PATCHTYPE_LONG,
 	PATCHTYPE_JR,
+	PATCHTYPE_JP, /* A `jp` target, which the linker may shorten to a `jr` */
 
 	PATCHTYPE_INVALID
 };
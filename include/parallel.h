@@ -0,0 +1,25 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2021, RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Running independent tasks on several threads */
+#ifndef RGBDS_PARALLEL_H
+#define RGBDS_PARALLEL_H
+
+#include <stddef.h>
+
+/**
+ * Runs `task` once for each index from 0 to `nbTasks - 1`, spread over up to `nbThreads`
+ * threads, the calling thread included; returns once all tasks are done.
+ * Tasks may run concurrently and in any order, so they must not modify shared state;
+ * only with a single thread are they guaranteed to run one after another, in order.
+ * If threads are unavailable or cannot be created, the tasks are run on the calling thread.
+ */
+void par_Run(size_t nbTasks, unsigned long nbThreads,
+	     void (*task)(size_t index, void *arg), void *arg);
+
+#endif /* RGBDS_PARALLEL_H */
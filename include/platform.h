@@ -70,4 +70,20 @@
 # define setmode(fd, mode) ((void)0)
 #endif
 
+/* MSVC lacks `_Thread_local`, but programs don't use threads there either */
+#ifdef _MSC_VER
+# define thread_local_
+#else
+# define thread_local_ _Thread_local
+#endif
+
+/* The sub-second part of a file's modification time, where `stat` provides it */
+#if defined(__APPLE__)
+# define STAT_MTIME_NSEC(info) ((info).st_mtimespec.tv_nsec)
+#elif defined(_WIN32)
+# define STAT_MTIME_NSEC(info) 0
+#else
+# define STAT_MTIME_NSEC(info) ((info).st_mtim.tv_nsec)
+#endif
+
 #endif /* RGBDS_PLATFORM_H */
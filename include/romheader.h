@@ -0,0 +1,76 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2020, Eldred habert and RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Cartridge header fixing, shared by rgbfix and rgblink */
+#ifndef RGBDS_ROMHEADER_H
+#define RGBDS_ROMHEADER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "platform.h" // MIN_NB_ELMS
+
+/* How many bytes of ROM0 the header spans */
+#define HEADER_SIZE 0x150
+
+/**
+ * Parses a byte value given to an option, e.g. `0x33`, `$33` or `51`.
+ * @param value Where to store the value; left untouched on error
+ * @param name The option's name, used in error messages
+ * @return False on error, which has already been printed
+ */
+bool hdr_ParseByte(uint16_t *value, char const *name, char const *arg);
+
+/**
+ * Parses one of the header options, identified by its rgbfix short name:
+ * `C`, `c`, `f`, `i`, `j`, `k`, `l`, `m`, `n`, `r`, `s`, `t`, or `v`.
+ * @param arg The option's argument, ignored if the option takes none
+ * @return False on error, which has already been printed
+ */
+bool hdr_ParseOption(char option, char const *arg);
+
+/**
+ * Warns about combinations of header options that are likely mistakes.
+ * To be called once all options have been parsed.
+ */
+void hdr_CheckOptions(void);
+
+/**
+ * @return True if any header option was given
+ */
+bool hdr_IsFixing(void);
+
+/**
+ * @return True if the global checksum is to be fixed or trashed
+ */
+bool hdr_FixesGlobalSum(void);
+
+/**
+ * Writes the logo and the header fields that were specified.
+ * The ROM size is not touched; if it must be set, do so before fixing the header checksum.
+ */
+void hdr_FixFields(uint8_t rom0[MIN_NB_ELMS(HEADER_SIZE)]);
+
+/**
+ * Fixes or trashes the header checksum, if requested.
+ */
+void hdr_FixHeaderSum(uint8_t rom0[MIN_NB_ELMS(HEADER_SIZE)]);
+
+/**
+ * Fixes or trashes the global checksum, if requested.
+ * @param sum The sum of all of the ROM's bytes, except the global checksum itself
+ */
+void hdr_FixGlobalSum(uint8_t rom0[MIN_NB_ELMS(HEADER_SIZE)], uint16_t sum);
+
+/**
+ * Sums bytes, modulo 2^16 as required by the global checksum
+ */
+uint16_t hdr_SumBytes(uint8_t const *data, size_t len);
+
+#endif /* RGBDS_ROMHEADER_H */
@@ -0,0 +1,60 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2021, RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Phase timing and counters, reported with `--stats` */
+#ifndef RGBDS_STATS_H
+#define RGBDS_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum StatsFormat {
+	STATS_NONE,
+	STATS_TEXT,
+	STATS_JSON,
+};
+
+extern enum StatsFormat statsFormat;
+
+/**
+ * Parses the argument to `--stats`, and enables stats collection accordingly.
+ * @param arg The option's argument, NULL if none was given
+ * @return False if the argument is not a valid format
+ */
+bool stats_SetFormat(char const *arg);
+
+/**
+ * @return The current wall clock time, in seconds from an arbitrary origin
+ */
+double stats_GetWallTime(void);
+
+/**
+ * Starts timing a new phase, ending the current one if any.
+ * Does nothing if stats are not enabled.
+ * @param name The phase's name; it must outlive the stats report
+ */
+void stats_StartPhase(char const *name);
+
+/**
+ * Ends the current phase, if any.
+ */
+void stats_EndPhase(void);
+
+/**
+ * Records a counter to be reported.
+ * @param name The counter's name; it must outlive the stats report
+ */
+void stats_SetCounter(char const *name, uint64_t value);
+
+/**
+ * Prints all phases and counters recorded so far to stderr, in the selected format.
+ * @param toolName The name of the program reporting them
+ */
+void stats_Print(char const *toolName);
+
+#endif /* RGBDS_STATS_H */
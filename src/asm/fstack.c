@@ -13,13 +13,17 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "asm/fstack.h"
 #include "asm/macro.h"
 #include "asm/main.h"
+#include "asm/profile.h"
 #include "asm/symbol.h"
 #include "asm/warning.h"
-#include "platform.h" /* S_ISDIR (stat macro) */
+
+#include "hashmap.h"
+#include "platform.h" /* S_ISDIR (stat macro), strdup */
 
 #define MAXINCPATHS 128
 
@@ -46,6 +50,9 @@ static size_t contextDepth = 0;
 #define DEFAULT_MAX_DEPTH 64
 size_t nMaxRecursionDepth;
 
+uint32_t nbMacroInvocations = 0;
+uint32_t nbReptIterations = 0;
+
 static unsigned int nbIncPaths = 0;
 static char const *includePaths[MAXINCPATHS];
 
@@ -160,41 +167,102 @@ static bool isPathValid(char const *path)
 	return !S_ISDIR(statbuf.st_mode);
 }
 
-bool fstk_FindFile(char const *path, char **fullPath, size_t *size)
+/*
+ * Results of include path searches, keyed by the user-provided path.
+ * Files that weren't found anywhere are remembered as well, since finding that out
+ * requires checking every single include path.
+ */
+struct ResolvedPath {
+	char *path; /* The user-provided path, which is the key */
+	char *fullPath; /* NULL if the file was not found */
+};
+
+static HashMap resolvedPaths;
+
+static char *searchIncludePaths(char const *path)
 {
-	if (!*size) {
-		*size = 64; /* This is arbitrary, really */
-		*fullPath = realloc(*fullPath, *size);
-		if (!*fullPath)
-			error("realloc error during include path search: %s\n",
-			      strerror(errno));
-	}
+	char *fullPath = NULL;
+	size_t size = 64; /* This is arbitrary, really */
+
+	for (size_t i = 0; i <= nbIncPaths; ++i) {
+		char const *incPath = i ? includePaths[i - 1] : "";
+
+		/* Oh how I wish `asnprintf` was standard... */
+		for (;;) {
+			char *newPath = realloc(fullPath, size);
 
-	if (*fullPath) {
-		for (size_t i = 0; i <= nbIncPaths; ++i) {
-			char const *incPath = i ? includePaths[i - 1] : "";
-			int len = snprintf(*fullPath, *size, "%s%s", incPath, path);
-
-			/* Oh how I wish `asnprintf` was standard... */
-			if (len >= *size) { /* `len` doesn't include the terminator, `size` does */
-				*size = len + 1;
-				*fullPath = realloc(*fullPath, *size);
-				if (!*fullPath) {
-					error("realloc error during include path search: %s\n",
-					      strerror(errno));
-					break;
-				}
-				len = sprintf(*fullPath, "%s%s", incPath, path);
+			if (!newPath) {
+				error("realloc error during include path search: %s\n",
+				      strerror(errno));
+				free(fullPath);
+				return NULL;
 			}
+			fullPath = newPath;
+
+			int len = snprintf(fullPath, size, "%s%s", incPath, path);
 
 			if (len < 0) {
 				error("snprintf error during include path search: %s\n",
 				      strerror(errno));
-			} else if (isPathValid(*fullPath)) {
-				printDep(*fullPath);
-				return true;
+				break;
+			}
+			/* `len` doesn't include the terminator, `size` does */
+			if (len < size) {
+				if (isPathValid(fullPath))
+					return fullPath;
+				break;
+			}
+			size = len + 1;
+		}
+	}
+
+	free(fullPath);
+	return NULL;
+}
+
+static struct ResolvedPath const *resolvePath(char const *path)
+{
+	struct ResolvedPath *resolved = hash_GetElement(resolvedPaths, path);
+
+	if (resolved)
+		return resolved;
+
+	resolved = malloc(sizeof(*resolved));
+	if (!resolved)
+		fatalerror("Failed to allocate include path search result: %s\n",
+			   strerror(errno));
+	resolved->path = strdup(path);
+	if (!resolved->path)
+		fatalerror("Failed to allocate include path search result: %s\n",
+			   strerror(errno));
+	resolved->fullPath = searchIncludePaths(path);
+
+	hash_AddElement(resolvedPaths, resolved->path, resolved);
+	return resolved;
+}
+
+bool fstk_FindFile(char const *path, char **fullPath, size_t *size)
+{
+	struct ResolvedPath const *resolved = resolvePath(path);
+
+	if (resolved->fullPath) {
+		size_t len = strlen(resolved->fullPath);
+
+		if (len >= *size) {
+			char *newPath = realloc(*fullPath, len + 1);
+
+			if (!newPath) {
+				error("realloc error during include path search: %s\n",
+				      strerror(errno));
+				errno = ENOENT;
+				return false;
 			}
+			*fullPath = newPath;
+			*size = len + 1;
 		}
+		memcpy(*fullPath, resolved->fullPath, len + 1);
+		printDep(*fullPath);
+		return true;
 	}
 
 	errno = ENOENT;
@@ -244,6 +312,7 @@ bool yywrap(void)
 		fileInfo->iters[0]++;
 		/* If this wasn't the last iteration, wrap instead of popping */
 		if (fileInfo->iters[0] <= contextStack->nbReptIters) {
+			nbReptIterations++;
 			lexer_RestartRept(contextStack->fileInfo->lineNo);
 			contextStack->uniqueID = macro_UseNewUniqueID();
 			return false;
@@ -259,6 +328,7 @@ bool yywrap(void)
 	assert(contextDepth != 0); // This is never supposed to underflow
 	contextDepth--;
 
+	prof_ExitContext();
 	lexer_DeleteState(context->lexerState);
 	/* Restore args if a macro (not REPT) saved them */
 	if (context->fileInfo->type == NODE_MACRO) {
@@ -340,6 +410,7 @@ void fstk_RunInclude(char const *path)
 	/* We're back at top-level, so most things are reset */
 	contextStack->uniqueID = 0;
 	macro_SetUniqueID(0);
+	prof_EnterNamedContext(fileInfo->name);
 }
 
 void fstk_RunMacro(char const *macroName, struct MacroArgs *args)
@@ -412,6 +483,8 @@ void fstk_RunMacro(char const *macroName, struct MacroArgs *args)
 	lexer_SetStateAtEOL(contextStack->lexerState);
 	contextStack->uniqueID = macro_UseNewUniqueID();
 	macro_UseNewArgs(args);
+	nbMacroInvocations++;
+	prof_EnterNamedContext(fileInfo->name);
 }
 
 static bool newReptContext(int32_t reptLineNo, char *body, size_t size)
@@ -444,6 +517,8 @@ static bool newReptContext(int32_t reptLineNo, char *body, size_t size)
 		fatalerror("Failed to set up lexer for REPT block\n");
 	lexer_SetStateAtEOL(contextStack->lexerState);
 	contextStack->uniqueID = macro_UseNewUniqueID();
+	nbReptIterations++;
+	prof_EnterReptContext();
 	return true;
 }
 
@@ -547,6 +622,7 @@ void fstk_Init(char const *mainPath, size_t maxRecursionDepth)
 
 	/* Now that it's set up properly, register the context */
 	contextStack = context;
+	prof_EnterNamedContext(fileInfo->name);
 
 	/*
 	 * Check that max recursion depth won't allow overflowing node `malloc`s
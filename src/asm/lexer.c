@@ -179,6 +179,7 @@ static struct KeywordMapping {
 	{"FRAGMENT", T_POP_FRAGMENT},
 	{"BANK", T_OP_BANK},
 	{"ALIGN", T_OP_ALIGN},
+	{"RELAX", T_OP_RELAX},
 
 	{"ROUND", T_OP_ROUND},
 	{"CEIL", T_OP_CEIL},
@@ -580,7 +581,7 @@ struct KeywordDictNode {
 	uint16_t children[0x60 - ' '];
 	struct KeywordMapping const *keyword;
 /* Since the keyword structure is invariant, the min number of nodes is known at compile time */
-} keywordDict[351] = {0}; /* Make sure to keep this correct when adding keywords! */
+} keywordDict[354] = {0}; /* Make sure to keep this correct when adding keywords! */
 
 /* Convert a char into its index into the dict */
 static inline uint8_t dictIndex(char c)
@@ -736,10 +737,13 @@ static struct Expansion *getExpansionAtDistance(size_t *distance)
 	return expansion;
 }
 
+uint32_t nbExpansions = 0;
+
 static void beginExpansion(size_t distance, uint8_t skip,
 			   char const *str, size_t size, bool owned,
 			   char const *name)
 {
+	nbExpansions++;
 	distance += lexerState->expansionOfs; /* Distance argument is relative to read offset! */
 	/* Increase the total length of all parents, and return the topmost one */
 	struct Expansion *parent = NULL;
@@ -25,7 +25,9 @@
 #include "asm/main.h"
 #include "asm/opt.h"
 #include "asm/output.h"
+#include "asm/profile.h"
 #include "asm/rpn.h"
+#include "asm/section.h"
 #include "asm/symbol.h"
 #include "asm/warning.h"
 #include "parser.h"
@@ -34,6 +36,7 @@
 #include "extern/getopt.h"
 
 #include "helpers.h"
+#include "stats.h"
 #include "version.h"
 
 // Old Bison versions (confirmed for 2.3) do not forward-declare `yyparse` in the generated header
@@ -48,6 +51,7 @@ FILE * dependfile;
 bool oGeneratedMissingIncludes;
 bool oFailedOnMissingInclude;
 bool oGeneratePhonyDeps;
+bool oScanDepsOnly;
 char *tzTargetFileName;
 
 bool haltnop;
@@ -104,21 +108,54 @@ static struct option const longopts[] = {
 	{ "MP",               no_argument,       &depType, 'P' },
 	{ "MT",               required_argument, &depType, 'T' },
 	{ "MQ",               required_argument, &depType, 'Q' },
+	{ "MS",               no_argument,       &depType, 'S' },
 	{ "output",           required_argument, NULL,     'o' },
 	{ "pad-value",        required_argument, NULL,     'p' },
+	{ "profile",          required_argument, NULL,     'P' },
+	{ "profile-trace",    required_argument, NULL,     'T' },
 	{ "recursion-depth",  required_argument, NULL,     'r' },
+	{ "stats",            optional_argument, NULL,     'S' },
 	{ "version",          no_argument,       NULL,     'V' },
 	{ "verbose",          no_argument,       NULL,     'v' },
 	{ "warning",          required_argument, NULL,     'W' },
 	{ NULL,               no_argument,       NULL,     0   }
 };
 
+static void countSymbol(struct Symbol *sym, void *arg)
+{
+	(void)sym;
+	(*(uint64_t *)arg)++;
+}
+
+static void printStats(void)
+{
+	if (statsFormat == STATS_NONE)
+		return;
+
+	uint64_t nbSymbols = 0;
+	uint64_t nbSections = 0;
+
+	sym_ForEach(countSymbol, &nbSymbols);
+	for (struct Section const *sect = pSectionList; sect; sect = sect->next)
+		nbSections++;
+
+	stats_SetCounter("symbols", nbSymbols);
+	stats_SetCounter("sections", nbSections);
+	stats_SetCounter("patches", nbPatches);
+	stats_SetCounter("macro_invocations", nbMacroInvocations);
+	stats_SetCounter("rept_iterations", nbReptIterations);
+	stats_SetCounter("expansions", nbExpansions);
+	stats_Print("rgbasm");
+}
+
 static void print_usage(void)
 {
 	fputs(
 "Usage: rgbasm [-EhLVvw] [-b chars] [-D name[=value]] [-g chars] [-i path]\n"
 "              [-M depend_file] [-MG] [-MP] [-MT target_file] [-MQ target_file]\n"
-"              [-o out_file] [-p pad_value] [-r depth] [-W warning] <file>\n"
+"              [-MS] [-o out_file] [-p pad_value] [--profile report_file]\n"
+"              [--profile-trace trace_file] [-r depth] [--stats[=json]]\n"
+"              [-W warning] <file>\n"
 "Useful options:\n"
 "    -E, --export-all         export all labels\n"
 "    -M, --dependfile <path>  set the output dependency file\n"
@@ -159,6 +196,7 @@ int main(int argc, char *argv[])
 	// Set defaults
 
 	oGeneratePhonyDeps = false;
+	oScanDepsOnly = false;
 	oGeneratedMissingIncludes = false;
 	oFailedOnMissingInclude = false;
 	tzTargetFileName = NULL;
@@ -173,6 +211,8 @@ int main(int argc, char *argv[])
 	sym_SetExportAll(false);
 	uint32_t maxRecursionDepth = 64;
 	size_t nTargetFileNameLen = 0;
+	char const *profileFileName = NULL;
+	char const *profileTraceFileName = NULL;
 
 	while ((ch = musl_getopt_long_only(argc, argv, optstring, longopts, NULL)) != -1) {
 		switch (ch) {
@@ -243,6 +283,14 @@ int main(int argc, char *argv[])
 			opt_P(fill);
 			break;
 
+		case 'P':
+			profileFileName = musl_optarg;
+			break;
+
+		case 'T':
+			profileTraceFileName = musl_optarg;
+			break;
+
 		case 'r':
 			maxRecursionDepth = strtoul(musl_optarg, &ep, 0);
 
@@ -250,6 +298,12 @@ int main(int argc, char *argv[])
 				errx(1, "Invalid argument for option 'r'");
 			break;
 
+		case 'S':
+			if (!stats_SetFormat(musl_optarg))
+				errx(1, "Invalid argument for option '--stats': \"%s\" (expected \"text\" or \"json\")",
+				     musl_optarg);
+			break;
+
 		case 'V':
 			printf("rgbasm %s\n", get_package_version_string());
 			exit(0);
@@ -276,6 +330,10 @@ int main(int argc, char *argv[])
 				oGeneratePhonyDeps = true;
 				break;
 
+			case 'S':
+				oScanDepsOnly = true;
+				break;
+
 			case 'Q':
 			case 'T':
 				if (musl_optind == argc)
@@ -330,6 +388,10 @@ int main(int argc, char *argv[])
 	if (verbose)
 		printf("Assembling %s\n", mainFileName);
 
+	/* Scanning for dependencies is pointless if they aren't printed anywhere */
+	if (oScanDepsOnly && !dependfile)
+		dependfile = stdout;
+
 	if (dependfile) {
 		if (!tzTargetFileName)
 			errx(1, "Dependency files can only be created if a target file is specified with either -o, -MQ or -MT\n");
@@ -337,6 +399,10 @@ int main(int argc, char *argv[])
 		fprintf(dependfile, "%s: %s\n", tzTargetFileName, mainFileName);
 	}
 
+	if (profileFileName || profileTraceFileName)
+		prof_Init(profileFileName, profileTraceFileName);
+
+	stats_StartPhase("init");
 	charmap_New("main", NULL);
 
 	// Init lexer and file stack, prodiving file info
@@ -344,8 +410,11 @@ int main(int argc, char *argv[])
 	fstk_Init(mainFileName, maxRecursionDepth);
 
 	// Perform parse (yyparse is auto-generated from `parser.y`)
+	stats_StartPhase("lex/parse");
 	if (yyparse() != 0 && nbErrors == 0)
 		nbErrors = 1;
+	stats_EndPhase();
+	prof_Finish();
 
 	if (dependfile)
 		fclose(dependfile);
@@ -356,11 +425,17 @@ int main(int argc, char *argv[])
 		errx(1, "Assembly aborted (%u errors)!", nbErrors);
 
 	// If parse aborted due to missing an include, and `-MG` was given, exit normally
-	if (oFailedOnMissingInclude)
+	if (oFailedOnMissingInclude) {
+		printStats();
 		return 0;
+	}
 
-	/* If no path specified, don't write file */
-	if (tzObjectname != NULL)
+	/* If no path specified, or only scanning for dependencies, don't write file */
+	if (tzObjectname != NULL && !oScanDepsOnly) {
+		stats_StartPhase("object write");
 		out_WriteObject();
+		stats_EndPhase();
+	}
+	printStats();
 	return 0;
 }
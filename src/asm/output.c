@@ -61,6 +61,8 @@ static struct Symbol *objectSymbols = NULL;
 static struct Symbol **objectSymbolsTail = &objectSymbols;
 static uint32_t nbSymbols = 0; /* Length of the above list */
 
+uint32_t nbPatches = 0;
+
 static struct Assertion *assertions = NULL;
 
 static struct FileStackNode *fileStackNodes = NULL;
@@ -420,6 +422,7 @@ void out_CreatePatch(uint32_t type, struct Expression const *expr, uint32_t ofs,
 
 	patch->next = pCurrentSection->patches;
 	pCurrentSection->patches = patch;
+	nbPatches++;
 }
 
 /**
@@ -428,6 +431,10 @@ void out_CreatePatch(uint32_t type, struct Expression const *expr, uint32_t ofs,
 bool out_CreateAssert(enum AssertionType type, struct Expression const *expr,
 		      char const *message, uint32_t ofs)
 {
+	/* Assertions would only be written to the object file */
+	if (oScanDepsOnly)
+		return true;
+
 	struct Assertion *assertion = malloc(sizeof(*assertion));
 
 	if (!assertion)
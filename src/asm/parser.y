@@ -479,6 +479,7 @@ enum {
 %token	T_OP_DEF "DEF"
 %token	T_OP_BANK "BANK"
 %token	T_OP_ALIGN "ALIGN"
+%token	T_OP_RELAX "RELAX"
 %token	T_OP_SIN "SIN" T_OP_COS "COS" T_OP_TAN "TAN"
 %token	T_OP_ASIN "ASIN" T_OP_ACOS "ACOS" T_OP_ATAN "ATAN" T_OP_ATAN2 "ATAN2"
 %token	T_OP_FDIV "FDIV"
@@ -1515,6 +1516,7 @@ sectattrs	: %empty {
 			$$.alignment = 0;
 			$$.alignOfs = 0;
 			$$.bank = -1;
+			$$.isRelaxable = false;
 		}
 		| sectattrs T_COMMA T_OP_ALIGN T_LBRACK uconst T_RBRACK {
 			$$.alignment = $5;
@@ -1527,6 +1529,9 @@ sectattrs	: %empty {
 			/* We cannot check the validity of this now */
 			$$.bank = $5;
 		}
+		| sectattrs T_COMMA T_OP_RELAX {
+			$$.isRelaxable = true;
+		}
 ;
 
 
@@ -1660,11 +1665,11 @@ z80_inc		: T_Z80_INC reg_r	{ out_AbsByte(0x04 | ($2 << 3)); }
 
 z80_jp		: T_Z80_JP reloc_16bit {
 			out_AbsByte(0xC3);
-			out_RelWord(&$2, 1);
+			out_RelJumpWord(&$2, 1);
 		}
 		| T_Z80_JP ccode T_COMMA reloc_16bit {
 			out_AbsByte(0xC2 | ($2 << 3));
-			out_RelWord(&$4, 1);
+			out_RelJumpWord(&$4, 1);
 		}
 		| T_Z80_JP T_MODE_HL {
 			out_AbsByte(0xE9);
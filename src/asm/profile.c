@@ -0,0 +1,283 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2021, RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "asm/profile.h"
+#include "asm/section.h"
+#include "asm/warning.h"
+
+#include "extern/err.h"
+
+#include "hashmap.h"
+#include "stats.h"
+
+/* All time and output attributed to a given name */
+struct ProfileEntry {
+	char *name;
+	uint32_t nbEntries; /* How many times a context with this name was entered */
+	uint32_t activeDepth; /* How many contexts with this name are currently open */
+	double outerStart; /* When the outermost currently open context was entered */
+	double selfTime;
+	double totalTime; /* Includes time spent in child contexts */
+	uint64_t nbBytes;
+	struct ProfileEntry *next;
+};
+
+struct ProfileFrame {
+	struct ProfileEntry *entry;
+	struct ProfileFrame *parent;
+};
+
+bool profiling = false;
+
+static char const *reportFileName;
+static FILE *traceFile;
+
+static HashMap entryMap;
+static struct ProfileEntry *entries = NULL;
+static size_t nbEntries = 0;
+static struct ProfileFrame *frames = NULL;
+
+static double startTime;
+static double lastTime;
+static uint64_t lastNbBytes;
+
+void prof_Init(char const *reportPath, char const *tracePath)
+{
+	profiling = true;
+	if (reportPath)
+		reportFileName = reportPath;
+	if (tracePath) {
+		traceFile = fopen(tracePath, "w");
+		if (!traceFile)
+			err(1, "Could not open profile trace file %s", tracePath);
+		fputs("[\n", traceFile);
+	}
+	startTime = stats_GetWallTime();
+	lastTime = startTime;
+}
+
+static void printJSONString(char const *str, FILE *file)
+{
+	putc('"', file);
+	for (; *str; str++) {
+		unsigned char c = *str;
+
+		if (c == '"' || c == '\\')
+			fprintf(file, "\\%c", c);
+		else if (c < ' ')
+			fprintf(file, "\\u%04x", c);
+		else
+			putc(c, file);
+	}
+	putc('"', file);
+}
+
+static void traceEvent(char phase, char const *name, char const *suffix, double time)
+{
+	static bool first = true;
+
+	if (!traceFile)
+		return;
+
+	fputs(first ? "" : ",\n", traceFile);
+	first = false;
+	fprintf(traceFile, "{\"ph\":\"%c\",\"pid\":1,\"tid\":1,\"ts\":%.3f", phase,
+		(time - startTime) * 1e6);
+	if (name) {
+		char *fullName = malloc(strlen(name) + strlen(suffix) + 1);
+
+		if (!fullName)
+			fatalerror("Failed to allocate profile trace event: %s\n", strerror(errno));
+		strcpy(fullName, name);
+		strcat(fullName, suffix);
+		fputs(",\"name\":", traceFile);
+		printJSONString(fullName, traceFile);
+		free(fullName);
+	}
+	putc('}', traceFile);
+}
+
+/*
+ * Attribute everything since the last context change to the current context
+ */
+static double account(void)
+{
+	double now = stats_GetWallTime();
+	uint64_t nbBytes = sect_GetNbBytesWritten();
+
+	if (frames) {
+		frames->entry->selfTime += now - lastTime;
+		frames->entry->nbBytes += nbBytes - lastNbBytes;
+	}
+	lastTime = now;
+	lastNbBytes = nbBytes;
+	return now;
+}
+
+static void pushFrame(struct ProfileEntry *entry, double now)
+{
+	struct ProfileFrame *frame = malloc(sizeof(*frame));
+
+	if (!frame)
+		fatalerror("Failed to allocate profile frame: %s\n", strerror(errno));
+	frame->entry = entry;
+	frame->parent = frames;
+	frames = frame;
+
+	if (entry->activeDepth++ == 0)
+		entry->outerStart = now;
+}
+
+/*
+ * The names of macro contexts include the iteration counts of the REPT blocks that they
+ * were invoked from; strip those, so that all invocations are aggregated together
+ */
+static char *stripReptIters(char const *name)
+{
+	static char const reptPrefix[] = "::REPT~";
+	char *stripped = malloc(strlen(name) + 1);
+	char *dest = stripped;
+
+	if (!stripped)
+		fatalerror("Failed to allocate profile entry name: %s\n", strerror(errno));
+	while (*name) {
+		if (!strncmp(name, reptPrefix, sizeof(reptPrefix) - 1)) {
+			name += sizeof(reptPrefix) - 1;
+			while (*name >= '0' && *name <= '9')
+				name++;
+		} else {
+			*dest++ = *name++;
+		}
+	}
+	*dest = '\0';
+	return stripped;
+}
+
+void prof_EnterNamedContext(char const *name)
+{
+	if (!profiling)
+		return;
+
+	double now = account();
+	char *key = stripReptIters(name);
+	struct ProfileEntry *entry = hash_GetElement(entryMap, key);
+
+	if (!entry) {
+		entry = malloc(sizeof(*entry));
+		if (!entry)
+			fatalerror("Failed to allocate profile entry: %s\n", strerror(errno));
+		entry->name = key;
+		entry->nbEntries = 0;
+		entry->activeDepth = 0;
+		entry->selfTime = 0;
+		entry->totalTime = 0;
+		entry->nbBytes = 0;
+		entry->next = entries;
+		entries = entry;
+		nbEntries++;
+		hash_AddElement(entryMap, entry->name, entry);
+	} else {
+		free(key);
+	}
+	entry->nbEntries++;
+	pushFrame(entry, now);
+	traceEvent('B', name, "", now);
+}
+
+void prof_EnterReptContext(void)
+{
+	if (!profiling)
+		return;
+	assert(frames); /* REPT blocks are always within another context */
+
+	double now = account();
+
+	pushFrame(frames->entry, now);
+	traceEvent('B', frames->entry->name, "::REPT", now);
+}
+
+void prof_ExitContext(void)
+{
+	if (!profiling)
+		return;
+	assert(frames);
+
+	double now = account();
+	struct ProfileFrame *frame = frames;
+
+	if (--frame->entry->activeDepth == 0)
+		frame->entry->totalTime += now - frame->entry->outerStart;
+	traceEvent('E', NULL, NULL, now);
+
+	frames = frame->parent;
+	free(frame);
+}
+
+static int compareEntries(void const *a, void const *b)
+{
+	struct ProfileEntry const *entry1 = *(struct ProfileEntry const * const *)a;
+	struct ProfileEntry const *entry2 = *(struct ProfileEntry const * const *)b;
+
+	if (entry1->selfTime > entry2->selfTime)
+		return -1;
+	if (entry1->selfTime < entry2->selfTime)
+		return 1;
+	return strcmp(entry1->name, entry2->name);
+}
+
+static void writeReport(void)
+{
+	FILE *file = fopen(reportFileName, "w");
+
+	if (!file)
+		err(1, "Could not open profile report file %s", reportFileName);
+
+	struct ProfileEntry **sorted = malloc(sizeof(*sorted) * nbEntries);
+	size_t i = 0;
+
+	if (!sorted)
+		fatalerror("Failed to allocate profile report: %s\n", strerror(errno));
+	for (struct ProfileEntry *entry = entries; entry; entry = entry->next)
+		sorted[i++] = entry;
+	qsort(sorted, nbEntries, sizeof(*sorted), compareEntries);
+
+	fprintf(file, "%12s %12s %10s %10s  %s\n", "Self (ms)", "Total (ms)", "Entries",
+		"Bytes", "Context");
+	for (i = 0; i < nbEntries; i++)
+		fprintf(file, "%12.3f %12.3f %10" PRIu32 " %10" PRIu64 "  %s\n",
+			sorted[i]->selfTime * 1000, sorted[i]->totalTime * 1000,
+			sorted[i]->nbEntries, sorted[i]->nbBytes, sorted[i]->name);
+
+	free(sorted);
+	fclose(file);
+}
+
+void prof_Finish(void)
+{
+	if (!profiling)
+		return;
+
+	while (frames)
+		prof_ExitContext();
+
+	if (traceFile) {
+		fputs("\n]\n", traceFile);
+		fclose(traceFile);
+	}
+	if (reportFileName)
+		writeReport();
+}
@@ -263,7 +263,8 @@ bool rpn_IsDiffConstant(struct Expression const *src, struct Symbol const *sym)
 
 	struct Section const *section1 = sym_GetSection(sym1);
 	struct Section const *section2 = sym_GetSection(sym);
-	return section1 && (section1 == section2);
+	/* The linker may shrink relaxable sections, changing the difference */
+	return section1 && (section1 == section2) && !section1->isRelaxable;
 }
 
 static bool isDiffConstant(struct Expression const *src1,
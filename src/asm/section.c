@@ -1,4 +1,5 @@
 
+#include <sys/stat.h>
 #include <assert.h>
 #include <errno.h>
 #include <inttypes.h>
@@ -16,6 +17,7 @@
 #include "asm/warning.h"
 
 #include "extern/err.h"
+#include "hashmap.h"
 #include "platform.h" // strdup
 
 uint8_t fillByte;
@@ -31,6 +33,7 @@ struct SectionStackEntry *sectionStack;
 uint32_t curOffset; /* Offset into the current section (see sect_GetSymbolOffset) */
 static struct Section *currentLoadSection = NULL;
 int32_t loadOffset; /* Offset into the LOAD section's parent (see sect_GetOutputOffset) */
+static uint64_t nbBytesWritten = 0; /* Total amount of data output, for profiling */
 
 struct UnionStackEntry {
 	uint32_t start;
@@ -249,7 +252,7 @@ static void mergeSections(struct Section *sect, enum SectionType type, uint32_t
  */
 static struct Section *createSection(char const *name, enum SectionType type,
 				     uint32_t org, uint32_t bank, uint8_t alignment,
-				     uint16_t alignOffset, enum SectionModifier mod)
+				     uint16_t alignOffset, enum SectionModifier mod, bool isRelaxable)
 {
 	struct Section *sect = malloc(sizeof(*sect));
 
@@ -269,11 +272,16 @@ static struct Section *createSection(char const *name, enum SectionType type,
 	sect->bank = bank;
 	sect->align = alignment;
 	sect->alignOfs = alignOffset;
+	sect->isRelaxable = isRelaxable;
+	sect->hasRelaxableJumps = false;
 	sect->next = NULL;
 	sect->patches = NULL;
 
-	/* It is only needed to allocate memory for ROM sections. */
-	if (sect_HasData(type)) {
+	/*
+	 * It is only needed to allocate memory for ROM sections, and only if their
+	 * contents will be output
+	 */
+	if (sect_HasData(type) && !oScanDepsOnly) {
 		sect->data = malloc(maxsize[type]);
 		if (sect->data == NULL)
 			fatalerror("Not enough memory for section: %s\n", strerror(errno));
@@ -293,6 +301,7 @@ static struct Section *getSection(char const *name, enum SectionType type, uint3
 	uint32_t bank = attrs->bank;
 	uint8_t alignment = attrs->alignment;
 	uint16_t alignOffset = attrs->alignOfs;
+	bool isRelaxable = attrs->isRelaxable;
 
 	// First, validate parameters, and normalize them if applicable
 
@@ -347,6 +356,12 @@ static struct Section *getSection(char const *name, enum SectionType type, uint3
 		}
 	}
 
+	// Only floating code sections can shrink without breaking anything
+	if (isRelaxable && (!sect_HasData(type) || org != -1 || mod != SECTION_NORMAL)) {
+		error("RELAX only allowed for ROM0 or ROMX sections without a fixed address, UNION, or FRAGMENT\n");
+		isRelaxable = false;
+	}
+
 	// Check if another section exists with the same name; merge if yes, otherwise create one
 
 	struct Section *sect = out_FindSectionByName(name);
@@ -354,7 +369,7 @@ static struct Section *getSection(char const *name, enum SectionType type, uint3
 	if (sect) {
 		mergeSections(sect, type, org, bank, alignment, alignOffset, mod);
 	} else {
-		sect = createSection(name, type, org, bank, alignment, alignOffset, mod);
+		sect = createSection(name, type, org, bank, alignment, alignOffset, mod, isRelaxable);
 		// Add the new section to the list (order doesn't matter)
 		sect->next = pSectionList;
 		pSectionList = sect;
@@ -453,6 +468,12 @@ void sect_AlignPC(uint8_t alignment, uint16_t offset)
 	struct Section *sect = sect_GetSymbolSection();
 	uint16_t alignSize = 1 << alignment; // Size of an aligned "block"
 
+	// The linker may shorten the jumps before this point, which would move it
+	if (sect->hasRelaxableJumps) {
+		error("Cannot align after a `jp` that may be shortened in a RELAX section\n");
+		return;
+	}
+
 	if (sect->org != -1) {
 		if ((sym_GetPCValue() - offset) % alignSize)
 			error("Section's fixed address fails required alignment (PC = $%04" PRIx32
@@ -481,10 +502,29 @@ static inline void growSection(uint32_t growth)
 		currentLoadSection->size = curOffset;
 }
 
+/*
+ * When only scanning for dependencies, sections have no data buffer, but still
+ * grow so that labels keep their values
+ */
 static inline void writebyte(uint8_t byte)
 {
-	pCurrentSection->data[sect_GetOutputOffset()] = byte;
+	if (pCurrentSection->data)
+		pCurrentSection->data[sect_GetOutputOffset()] = byte;
 	growSection(1);
+	nbBytesWritten++;
+}
+
+static inline void writebytes(uint8_t const *s, uint32_t length)
+{
+	if (pCurrentSection->data)
+		memcpy(&pCurrentSection->data[sect_GetOutputOffset()], s, length);
+	growSection(length);
+	nbBytesWritten += length;
+}
+
+uint64_t sect_GetNbBytesWritten(void)
+{
+	return nbBytesWritten;
 }
 
 static inline void writeword(uint16_t b)
@@ -504,6 +544,9 @@ static inline void writelong(uint32_t b)
 static inline void createPatch(enum PatchType type, struct Expression const *expr,
 			       uint32_t pcShift)
 {
+	/* Patches would only be written to the object file */
+	if (oScanDepsOnly)
+		return;
 	out_CreatePatch(type, expr, sect_GetOutputOffset(), pcShift);
 }
 
@@ -688,6 +731,29 @@ void out_RelWord(struct Expression *expr, uint32_t pcShift)
 	rpn_Free(expr);
 }
 
+/*
+ * Output the target of a `jp`, whose opcode was just output. In relaxable
+ * sections, the linker may shorten it to a `jr` if the target is close enough.
+ */
+void out_RelJumpWord(struct Expression *expr, uint32_t pcShift)
+{
+	checkcodesection();
+	reserveSpace(2);
+
+	/* In LOAD blocks, the code doesn't run where it is */
+	if (pCurrentSection->isRelaxable && !currentLoadSection) {
+		pCurrentSection->hasRelaxableJumps = true;
+		createPatch(PATCHTYPE_JP, expr, pcShift);
+		writeword(0);
+	} else if (!rpn_isKnown(expr)) {
+		createPatch(PATCHTYPE_WORD, expr, pcShift);
+		writeword(0);
+	} else {
+		writeword(expr->nVal);
+	}
+	rpn_Free(expr);
+}
+
 /*
  * Output a relocatable longword. Checking will be done to see if
  * is an absolute value in disguise.
@@ -741,6 +807,147 @@ void out_PCRelByte(struct Expression *expr, uint32_t pcShift)
 	rpn_Free(expr);
 }
 
+/*
+ * INCBIN'd files are read in full once, and kept around for the rest of the
+ * assembly; this way, slicing the same file many times only costs a `memcpy`
+ */
+struct IncbinFile {
+	char *path; /* Resolved path, also used as the key */
+	uint8_t *data; /* NULL if only the size is known */
+	int32_t size;
+};
+
+static HashMap incbinFiles;
+
+static bool readIncbinFile(struct IncbinFile *file, FILE *f, char const *s)
+{
+	size_t capacity = 0;
+	size_t size = 0;
+
+	if (fseek(f, 0, SEEK_END) != -1) {
+		long fsize = ftell(f);
+
+		if (fsize < 0 || fsize > INT32_MAX) {
+			error("Error determining size of INCBIN file '%s': %s\n",
+			      s, fsize < 0 ? strerror(errno) : "file too large");
+			return false;
+		}
+		capacity = fsize;
+		fseek(f, 0, SEEK_SET);
+	} else if (errno != ESPIPE) {
+		error("Error determining size of INCBIN file '%s': %s\n", s, strerror(errno));
+	}
+
+	/* Non-seekable files are read in growing chunks until EOF */
+	if (capacity == 0)
+		capacity = 0x4000;
+	file->data = malloc(capacity);
+	if (!file->data)
+		fatalerror("Not enough memory for INCBIN file '%s': %s\n", s, strerror(errno));
+
+	for (;;) {
+		size += fread(&file->data[size], 1, capacity - size, f);
+		if (size != capacity || feof(f) || ferror(f))
+			break;
+		/* Check if there is anything left, to avoid growing files read to their exact size */
+		int c = getc(f);
+
+		if (c == EOF)
+			break;
+		if (capacity >= INT32_MAX) {
+			error("INCBIN file '%s' is too large\n", s);
+			break;
+		}
+		capacity = capacity * 2 > INT32_MAX ? INT32_MAX : capacity * 2;
+		file->data = realloc(file->data, capacity);
+		if (!file->data)
+			fatalerror("Not enough memory for INCBIN file '%s': %s\n",
+				   s, strerror(errno));
+		file->data[size++] = c;
+	}
+
+	if (ferror(f))
+		error("Error reading INCBIN file '%s': %s\n", s, strerror(errno));
+
+	file->size = size;
+	return true;
+}
+
+/*
+ * Get the contents of an INCBIN file, reading it if it's not cached yet
+ * Returns NULL (with `errno` set) if the file could not be opened
+ */
+static struct IncbinFile const *getIncbinFile(char const *s)
+{
+	char *fullPath = NULL;
+	size_t size = 0;
+
+	if (!fstk_FindFile(s, &fullPath, &size)) {
+		free(fullPath);
+		return NULL;
+	}
+
+	struct IncbinFile *file = hash_GetElement(incbinFiles, fullPath);
+
+	if (file) {
+		free(fullPath);
+		return file;
+	}
+
+	/* When only scanning for dependencies, the contents are not needed, only the size */
+	struct stat fileInfo;
+
+	if (oScanDepsOnly) {
+		if (stat(fullPath, &fileInfo) != 0) {
+			free(fullPath);
+			return NULL;
+		}
+		/* Other files, e.g. pipes, must be read to know their size */
+		if (S_ISREG(fileInfo.st_mode)) {
+			if (fileInfo.st_size > INT32_MAX) {
+				error("Error determining size of INCBIN file '%s': file too large\n",
+				      s);
+				free(fullPath);
+				errno = EIO;
+				return NULL;
+			}
+			file = malloc(sizeof(*file));
+			if (!file)
+				fatalerror("Not enough memory for INCBIN file '%s': %s\n",
+					   s, strerror(errno));
+			file->path = fullPath;
+			file->data = NULL;
+			file->size = fileInfo.st_size;
+			hash_AddElement(incbinFiles, file->path, file);
+			return file;
+		}
+	}
+
+	FILE *f = fopen(fullPath, "rb");
+
+	if (!f) {
+		free(fullPath);
+		return NULL;
+	}
+
+	file = malloc(sizeof(*file));
+	if (!file)
+		fatalerror("Not enough memory for INCBIN file '%s': %s\n", s, strerror(errno));
+	file->path = fullPath;
+	if (!readIncbinFile(file, f, s)) {
+		/* Don't cache the failure, so the error gets reported again next time */
+		fclose(f);
+		free(fullPath);
+		free(file);
+		errno = EIO;
+		return NULL;
+	}
+	fclose(f);
+
+	hash_AddElement(incbinFiles, file->path, file);
+	return file;
+}
+
 /*
  * Output a binary file
  */
@@ -751,15 +958,9 @@ void out_BinaryFile(char const *s, int32_t startPos)
 		startPos = 0;
 	}
 
-	char *fullPath = NULL;
-	size_t size = 0;
-	FILE *f = NULL;
-
-	if (fstk_FindFile(s, &fullPath, &size))
-		f = fopen(fullPath, "rb");
-	free(fullPath);
+	struct IncbinFile const *file = getIncbinFile(s);
 
-	if (!f) {
+	if (!file) {
 		if (oGeneratedMissingIncludes) {
 			oFailedOnMissingInclude = true;
 			return;
@@ -767,40 +968,14 @@ void out_BinaryFile(char const *s, int32_t startPos)
 		fatalerror("Error opening INCBIN file '%s': %s\n", s, strerror(errno));
 	}
 
-	int32_t fsize = -1;
-	int byte;
-
 	checkcodesection();
-	if (fseek(f, 0, SEEK_END) != -1) {
-		fsize = ftell(f);
-
-		if (startPos >= fsize) {
-			error("Specified start position is greater than length of file\n");
-			fclose(f);
-			return;
-		}
-
-		fseek(f, startPos, SEEK_SET);
-		reserveSpace(fsize - startPos);
-	} else {
-		if (errno != ESPIPE)
-			error("Error determining size of INCBIN file '%s': %s\n",
-				s, strerror(errno));
-		/* The file isn't seekable, so we'll just skip bytes */
-		while (startPos--)
-			(void)fgetc(f);
-	}
-
-	while ((byte = fgetc(f)) != EOF) {
-		if (fsize == -1)
-			growSection(1);
-		writebyte(byte);
+	if (startPos >= file->size) {
+		error("Specified start position is greater than length of file\n");
+		return;
 	}
 
-	if (ferror(f))
-		error("Error reading INCBIN file '%s': %s\n", s, strerror(errno));
-
-	fclose(f);
+	reserveSpace(file->size - startPos);
+	writebytes(file->data ? &file->data[startPos] : NULL, file->size - startPos);
 }
 
 void out_BinaryFileSlice(char const *s, int32_t start_pos, int32_t length)
@@ -817,15 +992,9 @@ void out_BinaryFileSlice(char const *s, int32_t start_pos, int32_t length)
 	if (length == 0) /* Don't even bother with 0-byte slices */
 		return;
 
-	char *fullPath = NULL;
-	size_t size = 0;
-	FILE *f = NULL;
-
-	if (fstk_FindFile(s, &fullPath, &size))
-		f = fopen(fullPath, "rb");
+	struct IncbinFile const *file = getIncbinFile(s);
 
-	if (!f) {
-		free(fullPath);
+	if (!file) {
 		if (oGeneratedMissingIncludes) {
 			oFailedOnMissingInclude = true;
 			return;
@@ -836,46 +1005,15 @@ void out_BinaryFileSlice(char const *s, int32_t start_pos, int32_t length)
 	checkcodesection();
 	reserveSpace(length);
 
-	int32_t fsize;
-
-	if (fseek(f, 0, SEEK_END) != -1) {
-		fsize = ftell(f);
-
-		if (start_pos >= fsize) {
-			error("Specified start position is greater than length of file\n");
-			return;
-		}
-
-		if ((start_pos + length) > fsize)
-			fatalerror("Specified range in INCBIN is out of bounds\n");
-
-		fseek(f, start_pos, SEEK_SET);
-	} else {
-		if (errno != ESPIPE)
-			error("Error determining size of INCBIN file '%s': %s\n",
-				s, strerror(errno));
-		/* The file isn't seekable, so we'll just skip bytes */
-		while (start_pos--)
-			(void)fgetc(f);
+	if (start_pos >= file->size) {
+		error("Specified start position is greater than length of file\n");
+		return;
 	}
 
-	int32_t todo = length;
-
-	while (todo--) {
-		int byte = fgetc(f);
+	if (length > file->size - start_pos)
+		fatalerror("Specified range in INCBIN is out of bounds\n");
 
-		if (byte != EOF) {
-			writebyte(byte);
-		} else if (ferror(f)) {
-			error("Error reading INCBIN file '%s': %s\n", s, strerror(errno));
-		} else {
-			error("Premature end of file (%" PRId32 " bytes left to read)\n",
-				todo + 1);
-		}
-	}
-
-	fclose(f);
-	free(fullPath);
+	writebytes(file->data ? &file->data[start_pos] : NULL, length);
 }
 
 /*
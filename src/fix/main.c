@@ -18,11 +18,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+/* Neither MSVC nor MinGW provide `mmap` */
+#if !defined(_MSC_VER) && !defined(__MINGW32__)
+# include <sys/mman.h>
+# define HAS_MMAP
+#endif
 
 #include "extern/getopt.h"
 
 #include "helpers.h"
+#include "parallel.h"
 #include "platform.h"
+#include "romheader.h"
 #include "version.h"
 
 #define UNSPECIFIED 0x100 // May not be in byte range
@@ -30,7 +37,7 @@
 #define BANK_SIZE 0x4000
 
 /* Short options */
-static const char *optstring = "Ccf:i:jk:l:m:n:p:r:st:Vv";
+static const char *optstring = "CcJ:f:i:jk:l:m:n:p:r:st:Vv";
 
 /*
  * Equivalent long options
@@ -45,6 +52,7 @@ static const char *optstring = "Ccf:i:jk:l:m:n:p:r:st:Vv";
 static struct option const longopts[] = {
 	{ "color-only",       no_argument,       NULL, 'C' },
 	{ "color-compatible", no_argument,       NULL, 'c' },
+	{ "jobs",             required_argument, NULL, 'J' },
 	{ "fix-spec",         required_argument, NULL, 'f' },
 	{ "game-id",          required_argument, NULL, 'i' },
 	{ "non-japanese",     no_argument,       NULL, 'j' },
@@ -64,10 +72,12 @@ static struct option const longopts[] = {
 static void printUsage(void)
 {
 	fputs(
-"Usage: rgbfix [-jsVv] [-C | -c] [-f <fix_spec>] [-i <game_id>] [-k <licensee>]\n"
-"              [-l <licensee_byte>] [-m <mbc_type>] [-n <rom_version>]\n"
-"              [-p <pad_value>] [-r <ram_size>] [-t <title_str>] [<file> ...]\n"
+"Usage: rgbfix [-jsVv] [-C | -c] [-f <fix_spec>] [-i <game_id>] [-J <jobs>]\n"
+"              [-k <licensee>] [-l <licensee_byte>] [-m <mbc_type>]\n"
+"              [-n <rom_version>] [-p <pad_value>] [-r <ram_size>] [-t <title_str>]\n"
+"              [<file> ...]\n"
 "Useful options:\n"
+"    -J, --jobs <count>          fix up to this many files at the same time\n"
 "    -m, --mbc-type <value>      set the MBC type byte to this value; refer\n"
 "                                  to the man page for a list of values\n"
 "    -p, --pad-value <value>     pad to the next valid size using this value\n"
@@ -79,528 +89,75 @@ static void printUsage(void)
 	      stderr);
 }
 
-enum MbcType {
-	ROM  = 0x00,
-	ROM_RAM = 0x08,
-	ROM_RAM_BATTERY = 0x09,
-
-	MBC1 = 0x01,
-	MBC1_RAM = 0x02,
-	MBC1_RAM_BATTERY = 0x03,
-
-	MBC2 = 0x05,
-	MBC2_BATTERY = 0x06,
-
-	MMM01 = 0x0B,
-	MMM01_RAM = 0x0C,
-	MMM01_RAM_BATTERY = 0x0D,
-
-	MBC3 = 0x11,
-	MBC3_TIMER_BATTERY = 0x0F,
-	MBC3_TIMER_RAM_BATTERY = 0x10,
-	MBC3_RAM = 0x12,
-	MBC3_RAM_BATTERY = 0x13,
-
-	MBC5 = 0x19,
-	MBC5_RAM = 0x1A,
-	MBC5_RAM_BATTERY = 0x1B,
-	MBC5_RUMBLE = 0x1C,
-	MBC5_RUMBLE_RAM = 0x1D,
-	MBC5_RUMBLE_RAM_BATTERY = 0x1E,
-
-	MBC6 = 0x20,
-
-	MBC7_SENSOR_RUMBLE_RAM_BATTERY = 0x22,
-
-	POCKET_CAMERA = 0xFC,
-
-	BANDAI_TAMA5 = 0xFD,
-
-	HUC3 = 0xFE,
-
-	HUC1_RAM_BATTERY = 0xFF,
-
-	// Error values
-	MBC_NONE = UNSPECIFIED, // No MBC specified, do not act on it
-	MBC_BAD, // Specified MBC does not exist / syntax error
-	MBC_WRONG_FEATURES, // MBC incompatible with specified features
-	MBC_BAD_RANGE, // MBC number out of range
+struct FixJob {
+	char const *name;
+	char *log; // Messages reported while fixing the file, printed once it's done
+	size_t logLen;
+	size_t logCapacity;
+	bool failed;
 };
 
-/**
- * @return False on failure
- */
-static bool readMBCSlice(char const **name, char const *expected)
-{
-	while (*expected) {
-		char c = *(*name)++;
-
-		if (c == '\0') // Name too short
-			return false;
-
-		if (c >= 'a' && c <= 'z') // Perform the comparison case-insensitive
-			c = c - 'a' + 'A';
-		else if (c == '_') // Treat underscores as spaces
-			c = ' ';
-
-		if (c != *expected++)
-			return false;
-	}
-	return true;
-}
+// When fixing files in parallel, each thread tracks its own file
+static thread_local_ uint8_t nbErrors;
+static thread_local_ struct FixJob *curJob = NULL;
 
-static enum MbcType parseMBC(char const *name)
+static format_(printf, 1, 0) void vprintMsg(char const *fmt, va_list ap)
 {
-	if (name[0] >= '0' && name[0] <= '9') {
-		// Parse number, and return it as-is (unless it's too large)
-		char *endptr;
-		unsigned long mbc = strtoul(name, &endptr, 0);
-
-		if (*endptr)
-			return MBC_BAD;
-		if (mbc > 0xFF)
-			return MBC_BAD_RANGE;
-		return mbc;
-
-	} else {
-		// Begin by reading the MBC type:
-		uint16_t mbc;
-		char const *ptr = name;
-
-		// Trim off leading whitespace
-		while (*ptr == ' ' || *ptr == '\t')
-			ptr++;
-
-#define tryReadSlice(expected) \
-do { \
-	if (!readMBCSlice(&ptr, expected)) \
-		return MBC_BAD; \
-} while (0)
-
-		switch (*ptr++) {
-		case 'R': // ROM / ROM_ONLY
-		case 'r':
-			tryReadSlice("OM");
-			// Handle optional " ONLY"
-			while (*ptr == ' ' || *ptr == '\t' || *ptr == '_')
-				ptr++;
-			if (*ptr == 'O' || *ptr == 'o') {
-				ptr++;
-				tryReadSlice("NLY");
-			}
-			mbc = ROM;
-			break;
-
-		case 'M': // MBC{1, 2, 3, 5, 6, 7} / MMM01
-		case 'm':
-			switch (*ptr++) {
-			case 'B':
-			case 'b':
-				switch (*ptr++) {
-				case 'C':
-				case 'c':
-					break;
-				default:
-					return MBC_BAD;
-				}
-				switch (*ptr++) {
-				case '1':
-					mbc = MBC1;
-					break;
-				case '2':
-					mbc = MBC2;
-					break;
-				case '3':
-					mbc = MBC3;
-					break;
-				case '5':
-					mbc = MBC5;
-					break;
-				case '6':
-					mbc = MBC6;
-					break;
-				case '7':
-					mbc = MBC7_SENSOR_RUMBLE_RAM_BATTERY;
-					break;
-				default:
-					return MBC_BAD;
-				}
-				break;
-			case 'M':
-			case 'm':
-				tryReadSlice("M01");
-				mbc = MMM01;
-				break;
-			default:
-				return MBC_BAD;
-			}
-			break;
-
-		case 'P': // POCKET_CAMERA
-		case 'p':
-			tryReadSlice("OCKET CAMERA");
-			mbc = POCKET_CAMERA;
-			break;
-
-		case 'B': // BANDAI_TAMA5
-		case 'b':
-			tryReadSlice("ANDAI TAMA5");
-			mbc = BANDAI_TAMA5;
-			break;
-
-		case 'T': // TAMA5
-		case 't':
-			tryReadSlice("AMA5");
-			mbc = BANDAI_TAMA5;
-			break;
-
-		case 'H': // HuC{1, 3}
-		case 'h':
-			tryReadSlice("UC");
-			switch (*ptr++) {
-			case '1':
-				mbc = HUC1_RAM_BATTERY;
-				break;
-			case '3':
-				mbc = HUC3;
-				break;
-			default:
-				return MBC_BAD;
-			}
-			break;
-
-		default:
-			return MBC_BAD;
-		}
-
-		// Read "additional features"
-		uint8_t features = 0;
-#define RAM 0x80
-#define BATTERY 0x40
-#define TIMER 0x20
-#define RUMBLE 0x10
-#define SENSOR 0x08
-
-		for (;;) {
-			// Trim off trailing whitespace
-			while (*ptr == ' ' || *ptr == '\t' || *ptr == '_')
-				ptr++;
-
-			// If done, start processing "features"
-			if (!*ptr)
-				break;
-			// We expect a '+' at this point
-			if (*ptr++ != '+')
-				return MBC_BAD;
-			// Trim off leading whitespace
-			while (*ptr == ' ' || *ptr == '\t' || *ptr == '_')
-				ptr++;
-
-			switch (*ptr++) {
-			case 'B': // BATTERY
-			case 'b':
-				tryReadSlice("ATTERY");
-				features |= BATTERY;
-				break;
-
-			case 'R': // RAM or RUMBLE
-			case 'r':
-				switch (*ptr++) {
-				case 'U':
-				case 'u':
-					tryReadSlice("MBLE");
-					features |= RUMBLE;
-					break;
-				case 'A':
-				case 'a':
-					if (*ptr != 'M' && *ptr != 'm')
-						return MBC_BAD;
-					ptr++;
-					features |= RAM;
-					break;
-				default:
-					return MBC_BAD;
-				}
-				break;
-
-			case 'S': // SENSOR
-			case 's':
-				tryReadSlice("ENSOR");
-				features |= SENSOR;
-				break;
-
-			case 'T': // TIMER
-			case 't':
-				tryReadSlice("IMER");
-				features |= TIMER;
-				break;
-
-			default:
-				return MBC_BAD;
-			}
-		}
-#undef tryReadSlice
-
-		switch (mbc) {
-		case ROM:
-			if (!features)
-				break;
-			mbc = ROM_RAM - 1;
-			static_assert(ROM_RAM + 1 == ROM_RAM_BATTERY, "Enum sanity check failed!");
-			static_assert(MBC1 + 1 == MBC1_RAM, "Enum sanity check failed!");
-			static_assert(MBC1 + 2 == MBC1_RAM_BATTERY, "Enum sanity check failed!");
-			static_assert(MMM01 + 1 == MMM01_RAM, "Enum sanity check failed!");
-			static_assert(MMM01 + 2 == MMM01_RAM_BATTERY, "Enum sanity check failed!");
-			// fallthrough
-		case MBC1:
-		case MMM01:
-			if (features == RAM)
-				mbc++;
-			else if (features == (RAM | BATTERY))
-				mbc += 2;
-			else if (features)
-				return MBC_WRONG_FEATURES;
-			break;
+	if (!curJob) {
+		vfprintf(stderr, fmt, ap);
+		return;
+	}
 
-		case MBC2:
-			if (features == BATTERY)
-				mbc = MBC2_BATTERY;
-			else if (features)
-				return MBC_WRONG_FEATURES;
-			break;
+	// Buffer the message, so that messages about different files don't get mixed up
+	va_list ap2;
 
-		case MBC3:
-			// Handle timer, which also requires battery
-			if (features & (TIMER & BATTERY)) {
-				features &= ~(TIMER | BATTERY); // Reset those bits
-				mbc = MBC3_TIMER_BATTERY;
-				// RAM is handled below
-			}
-			static_assert(MBC3 + 1 == MBC3_RAM, "Enum sanity check failed!");
-			static_assert(MBC3 + 2 == MBC3_RAM_BATTERY, "Enum sanity check failed!");
-			static_assert(MBC3_TIMER_BATTERY + 1 == MBC3_TIMER_RAM_BATTERY,
-				      "Enum sanity check failed!");
-			if (features == RAM)
-				mbc++;
-			else if (features == (RAM | BATTERY))
-				mbc += 2;
-			else if (features)
-				return MBC_WRONG_FEATURES;
-			break;
+	va_copy(ap2, ap);
+	int len = vsnprintf(NULL, 0, fmt, ap2);
 
-		case MBC5:
-			if (features & RUMBLE) {
-				features &= ~RUMBLE;
-				mbc = MBC5_RUMBLE;
-			}
-			static_assert(MBC5 + 1 == MBC5_RAM, "Enum sanity check failed!");
-			static_assert(MBC5 + 2 == MBC5_RAM_BATTERY, "Enum sanity check failed!");
-			static_assert(MBC5_RUMBLE + 1 == MBC5_RUMBLE_RAM, "Enum sanity check failed!");
-			static_assert(MBC5_RUMBLE + 2 == MBC5_RUMBLE_RAM_BATTERY,
-				      "Enum sanity check failed!");
-			if (features == RAM)
-				mbc++;
-			else if (features == (RAM | BATTERY))
-				mbc += 2;
-			else if (features)
-				return MBC_WRONG_FEATURES;
-			break;
-
-		case MBC6:
-		case POCKET_CAMERA:
-		case BANDAI_TAMA5:
-		case HUC3:
-			// No extra features accepted
-			if (features)
-				return MBC_WRONG_FEATURES;
-			break;
+	va_end(ap2);
+	if (len < 0)
+		return;
+	if (curJob->logLen + len + 1 > curJob->logCapacity) {
+		size_t newCapacity = curJob->logCapacity ? curJob->logCapacity : 128;
 
-		case MBC7_SENSOR_RUMBLE_RAM_BATTERY:
-			if (features != (SENSOR | RUMBLE | RAM | BATTERY))
-				return MBC_WRONG_FEATURES;
-			break;
+		while (curJob->logLen + len + 1 > newCapacity)
+			newCapacity *= 2;
+		char *newLog = realloc(curJob->log, newCapacity);
 
-		case HUC1_RAM_BATTERY:
-			if (features != (RAM | BATTERY)) // HuC1 expects RAM+BATTERY
-				return MBC_WRONG_FEATURES;
-			break;
+		if (!newLog) {
+			// Don't lose the message, even if it can't be kept in order
+			vfprintf(stderr, fmt, ap);
+			return;
 		}
-
-		// Trim off trailing whitespace
-		while (*ptr == ' ' || *ptr == '\t')
-			ptr++;
-
-		// If there is still something past the whitespace, error out
-		if (*ptr)
-			return MBC_BAD;
-
-		return mbc;
-	}
-}
-
-static char const *mbcName(enum MbcType type)
-{
-	switch (type) {
-	case ROM:
-		return "ROM";
-	case ROM_RAM:
-		return "ROM+RAM";
-	case ROM_RAM_BATTERY:
-		return "ROM+RAM+BATTERY";
-	case MBC1:
-		return "MBC1";
-	case MBC1_RAM:
-		return "MBC1+RAM";
-	case MBC1_RAM_BATTERY:
-		return "MBC1+RAM+BATTERY";
-	case MBC2:
-		return "MBC2";
-	case MBC2_BATTERY:
-		return "MBC2+BATTERY";
-	case MMM01:
-		return "MMM01";
-	case MMM01_RAM:
-		return "MMM01+RAM";
-	case MMM01_RAM_BATTERY:
-		return "MMM01+RAM+BATTERY";
-	case MBC3:
-		return "MBC3";
-	case MBC3_TIMER_BATTERY:
-		return "MBC3+TIMER+BATTERY";
-	case MBC3_TIMER_RAM_BATTERY:
-		return "MBC3+TIMER+RAM+BATTERY";
-	case MBC3_RAM:
-		return "MBC3+RAM";
-	case MBC3_RAM_BATTERY:
-		return "MBC3+RAM+BATTERY";
-	case MBC5:
-		return "MBC5";
-	case MBC5_RAM:
-		return "MBC5+RAM";
-	case MBC5_RAM_BATTERY:
-		return "MBC5+RAM+BATTERY";
-	case MBC5_RUMBLE:
-		return "MBC5+RUMBLE";
-	case MBC5_RUMBLE_RAM:
-		return "MBC5+RUMBLE+RAM";
-	case MBC5_RUMBLE_RAM_BATTERY:
-		return "MBC5+RUMBLE+RAM+BATTERY";
-	case MBC6:
-		return "MBC6";
-	case MBC7_SENSOR_RUMBLE_RAM_BATTERY:
-		return "MBC7+SENSOR+RUMBLE+RAM+BATTERY";
-	case POCKET_CAMERA:
-		return "POCKET CAMERA";
-	case BANDAI_TAMA5:
-		return "BANDAI TAMA5";
-	case HUC3:
-		return "HUC3";
-	case HUC1_RAM_BATTERY:
-		return "HUC1+RAM+BATTERY";
-
-	// Error values
-	case MBC_NONE:
-	case MBC_BAD:
-	case MBC_WRONG_FEATURES:
-	case MBC_BAD_RANGE:
-		unreachable_();
+		curJob->log = newLog;
+		curJob->logCapacity = newCapacity;
 	}
-
-	unreachable_();
+	vsnprintf(&curJob->log[curJob->logLen], len + 1, fmt, ap);
+	curJob->logLen += len;
 }
 
-static bool hasRAM(enum MbcType type)
+static format_(printf, 1, 2) void printMsg(char const *fmt, ...)
 {
-	switch (type) {
-	case ROM:
-	case MBC1:
-	case MBC2: // Technically has RAM, but not marked as such
-	case MBC2_BATTERY:
-	case MMM01:
-	case MBC3:
-	case MBC3_TIMER_BATTERY:
-	case MBC5:
-	case MBC5_RUMBLE:
-	case MBC6: // TODO: not sure
-	case BANDAI_TAMA5: // TODO: not sure
-	case MBC_NONE:
-	case MBC_BAD:
-	case MBC_WRONG_FEATURES:
-	case MBC_BAD_RANGE:
-		return false;
-
-	case ROM_RAM:
-	case ROM_RAM_BATTERY:
-	case MBC1_RAM:
-	case MBC1_RAM_BATTERY:
-	case MMM01_RAM:
-	case MMM01_RAM_BATTERY:
-	case MBC3_TIMER_RAM_BATTERY:
-	case MBC3_RAM:
-	case MBC3_RAM_BATTERY:
-	case MBC5_RAM:
-	case MBC5_RAM_BATTERY:
-	case MBC5_RUMBLE_RAM:
-	case MBC5_RUMBLE_RAM_BATTERY:
-	case MBC7_SENSOR_RUMBLE_RAM_BATTERY:
-	case POCKET_CAMERA:
-	case HUC3:
-	case HUC1_RAM_BATTERY:
-		return true;
-	}
+	va_list ap;
 
-	unreachable_();
+	va_start(ap, fmt);
+	vprintMsg(fmt, ap);
+	va_end(ap);
 }
 
-static uint8_t nbErrors;
-
 static format_(printf, 1, 2) void report(char const *fmt, ...)
 {
 	va_list ap;
 
 	va_start(ap, fmt);
-	vfprintf(stderr, fmt, ap);
+	vprintMsg(fmt, ap);
 	va_end(ap);
 
 	if (nbErrors != UINT8_MAX)
 		nbErrors++;
 }
 
-static const uint8_t ninLogo[] = {
-	0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B,
-	0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
-	0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E,
-	0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
-	0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC,
-	0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E
-};
-
-static enum { DMG, BOTH, CGB } model = DMG; // If DMG, byte is left alone
-#define   FIX_LOGO        0x80
-#define TRASH_LOGO        0x40
-#define   FIX_HEADER_SUM  0x20
-#define TRASH_HEADER_SUM  0x10
-#define   FIX_GLOBAL_SUM  0x08
-#define TRASH_GLOBAL_SUM  0x04
-static uint8_t fixSpec = 0;
-static const char *gameID = NULL;
-static uint8_t gameIDLen;
-static bool japanese = true;
-static const char *newLicensee = NULL;
-static uint8_t newLicenseeLen;
-static uint16_t oldLicensee = UNSPECIFIED;
-static enum MbcType cartridgeType = MBC_NONE;
-static uint16_t romVersion = UNSPECIFIED;
 static uint16_t padValue = UNSPECIFIED;
-static uint16_t ramSize = UNSPECIFIED;
-static bool sgb = false; // If false, SGB flags are left alone
-static const char *title = NULL;
-static uint8_t titleLen;
-
-static uint8_t maxTitleLen(void)
-{
-	return gameID ? 11 :  model != DMG ? 15 : 16;
-}
 
 static ssize_t readBytes(int fd, uint8_t *buf, size_t len)
 {
@@ -653,6 +210,40 @@ static ssize_t writeBytes(int fd, void *buf, size_t len)
 	return total;
 }
 
+static uint16_t sumFileBytes(int fd, off_t offset, off_t fileSize)
+{
+#ifdef HAS_MMAP
+	// Map the whole file at once, which avoids copying it around
+	if (fileSize > offset) {
+		void *mapping = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+
+		if (mapping != MAP_FAILED) {
+			posix_madvise(mapping, fileSize, POSIX_MADV_SEQUENTIAL);
+			uint16_t sum = hdr_SumBytes((uint8_t const *)mapping + offset, fileSize - offset);
+
+			munmap(mapping, fileSize);
+			return sum;
+		}
+	}
+#else
+	(void)offset;
+	(void)fileSize;
+#endif
+	// If mapping the file isn't possible, fall back to reading it
+	uint16_t sum = 0;
+	uint8_t bank[BANK_SIZE];
+
+	for (;;) {
+		ssize_t len = readBytes(fd, bank, sizeof(bank));
+
+		if (len > 0)
+			sum += hdr_SumBytes(bank, len);
+		if (len != sizeof(bank))
+			break;
+	}
+	return sum;
+}
+
 /**
  * @param input File descriptor to be used for reading
  * @param output File descriptor to be used for writing, may be equal to `input`
@@ -680,45 +271,7 @@ static void processFile(int input, int output, char const *name, off_t fileSize)
 	}
 	// Accept partial reads if the file contains at least the header
 
-	if (fixSpec & (FIX_LOGO | TRASH_LOGO)) {
-		if (fixSpec & FIX_LOGO) {
-			memcpy(&rom0[0x104], ninLogo, sizeof(ninLogo));
-		} else {
-			for (uint8_t i = 0; i < sizeof(ninLogo); i++)
-				rom0[i + 0x104] = ~ninLogo[i];
-		}
-	}
-
-	if (title)
-		memcpy(&rom0[0x134], title, titleLen);
-
-	if (gameID)
-		memcpy(&rom0[0x13f], gameID, gameIDLen);
-
-	if (model != DMG)
-		rom0[0x143] = model == BOTH ? 0x80 : 0xc0;
-
-	if (newLicensee)
-		memcpy(&rom0[0x144], newLicensee, newLicenseeLen);
-
-	if (sgb)
-		rom0[0x146] = 0x03;
-
-	// If a valid MBC was specified...
-	if (cartridgeType < MBC_NONE)
-		rom0[0x147] = cartridgeType;
-
-	if (ramSize != UNSPECIFIED)
-		rom0[0x149] = ramSize;
-
-	if (!japanese)
-		rom0[0x14a] = 0x01;
-
-	if (oldLicensee != UNSPECIFIED)
-		rom0[0x14b] = oldLicensee;
-
-	if (romVersion != UNSPECIFIED)
-		rom0[0x14c] = romVersion;
+	hdr_FixFields(rom0);
 
 	// Remain to be handled the ROM size, and header checksum.
 	// The latter depends on the former, and so will be handled after it.
@@ -748,13 +301,19 @@ static void processFile(int input, int output, char const *name, off_t fileSize)
 		//      = ceil(totalRomxLen / BANK_SIZE)
 		totalRomxLen = fileSize >= BANK_SIZE ? fileSize - BANK_SIZE : 0;
 	} else if (rom0Len == BANK_SIZE) {
+		uint32_t romxCapacity = 0; // How many banks `romx` can hold
+
 		// Copy ROMX when reading a pipe, and we're not at EOF yet
 		for (;;) {
-			romx = realloc(romx, nbBanks * BANK_SIZE);
-			if (!romx) {
-				report("FATAL: Failed to realloc ROMX buffer: %s\n",
-				       strerror(errno));
-				return;
+			// Grow the buffer geometrically, to avoid reallocating for every bank
+			if (nbBanks > romxCapacity) {
+				romxCapacity = romxCapacity ? romxCapacity * 2 : 8;
+				romx = realloc(romx, romxCapacity * BANK_SIZE);
+				if (!romx) {
+					report("FATAL: Failed to realloc ROMX buffer: %s\n",
+					       strerror(errno));
+					return;
+				}
 			}
 			ssize_t bankLen = readBytes(input, &romx[(nbBanks - 1) * BANK_SIZE],
 						    BANK_SIZE);
@@ -771,8 +330,7 @@ static void processFile(int input, int output, char const *name, off_t fileSize)
 				nbBanks++;
 
 				// Update global checksum, too
-				for (uint16_t i = 0; i < bankLen; i++)
-					globalSum += romx[totalRomxLen + i];
+				globalSum += hdr_SumBytes(&romx[totalRomxLen], bankLen);
 				totalRomxLen += bankLen;
 			}
 			// Stop when an incomplete bank has been read
@@ -813,36 +371,18 @@ static void processFile(int input, int output, char const *name, off_t fileSize)
 	}
 
 	// Handle the header checksum after the ROM size has been written
-	if (fixSpec & (FIX_HEADER_SUM | TRASH_HEADER_SUM)) {
-		uint8_t sum = 0;
+	hdr_FixHeaderSum(rom0);
 
-		for (uint16_t i = 0x134; i < 0x14d; i++)
-			sum -= rom0[i] + 1;
-		rom0[0x14d] = fixSpec & TRASH_HEADER_SUM ? ~sum : sum;
-	}
-
-	if (fixSpec & (FIX_GLOBAL_SUM | TRASH_GLOBAL_SUM)) {
+	if (hdr_FixesGlobalSum()) {
 		// Computation of the global checksum assumes 0s being stored in its place
 		rom0[0x14e] = 0;
 		rom0[0x14f] = 0;
-		for (uint16_t i = 0; i < rom0Len; i++)
-			globalSum += rom0[i];
+		globalSum += hdr_SumBytes(rom0, rom0Len);
 		// Pipes have already read ROMX and updated globalSum, but not regular files
-		if (input == output) {
-			for (;;) {
-				ssize_t romxLen = readBytes(input, bank, sizeof(bank));
+		if (input == output)
+			globalSum += sumFileBytes(input, rom0Len, fileSize);
 
-				for (uint16_t i = 0; i < romxLen; i++)
-					globalSum += bank[i];
-				if (romxLen != sizeof(bank))
-					break;
-			}
-		}
-
-		if (fixSpec & TRASH_GLOBAL_SUM)
-			globalSum = ~globalSum;
-		rom0[0x14e] = globalSum >> 8;
-		rom0[0x14f] = globalSum & 0xff;
+		hdr_FixGlobalSum(rom0, globalSum);
 	}
 
 	// In case the output depends on the input, reset to the beginning of the file, and only
@@ -955,227 +495,111 @@ static bool processFilename(char const *name)
 	}
 	if (nbErrors)
 fail:
-		fprintf(stderr, "Fixing \"%s\" failed with %u error%s\n",
-			name, nbErrors, nbErrors == 1 ? "" : "s");
+		printMsg("Fixing \"%s\" failed with %u error%s\n",
+			 name, nbErrors, nbErrors == 1 ? "" : "s");
 	return nbErrors;
 }
 
+static void fixJob(size_t index, void *arg)
+{
+	struct FixJob *jobs = arg;
+
+	curJob = &jobs[index];
+	jobs[index].failed = processFilename(jobs[index].name);
+	curJob = NULL;
+}
+
+/**
+ * Fixes files on several threads, then prints each file's messages in argument order
+ * @return True if fixing any of the files failed
+ */
+static bool processFilenamesParallel(char **names, size_t nbNames, unsigned long nbThreads)
+{
+	struct FixJob *jobs = calloc(nbNames, sizeof(*jobs));
+
+	if (!jobs) {
+		fprintf(stderr, "FATAL: Failed to allocate jobs: %s\n", strerror(errno));
+		return true;
+	}
+	for (size_t i = 0; i < nbNames; i++)
+		jobs[i].name = names[i];
+
+	par_Run(nbNames, nbThreads, fixJob, jobs);
+
+	bool failed = false;
+
+	for (size_t i = 0; i < nbNames; i++) {
+		if (jobs[i].logLen)
+			fputs(jobs[i].log, stderr);
+		free(jobs[i].log);
+		failed |= jobs[i].failed;
+	}
+	free(jobs);
+	return failed;
+}
+
 int main(int argc, char *argv[])
 {
 	nbErrors = 0;
+	unsigned long nbThreads = 1;
 	char ch;
 
 	while ((ch = musl_getopt_long_only(argc, argv, optstring, longopts, NULL)) != -1) {
 		switch (ch) {
-			size_t len;
-#define parseByte(output, name) \
-do { \
-	char *endptr; \
-	unsigned long tmp; \
-	\
-	if (musl_optarg[0] == 0) { \
-		report("error: Argument to option '" name "' may not be empty\n"); \
-	} else { \
-		if (musl_optarg[0] == '$') { \
-			tmp = strtoul(&musl_optarg[1], &endptr, 16); \
-		} else { \
-			tmp = strtoul(musl_optarg, &endptr, 0); \
-		} \
-		if (*endptr) \
-			report("error: Expected number as argument to option '" name "', got %s\n", \
-			       musl_optarg); \
-		else if (tmp > 0xFF) \
-			report("error: Argument to option '" name "' is larger than 255: %lu\n", tmp); \
-		else \
-			output = tmp; \
-	} \
-} while (0)
-
 		case 'C':
 		case 'c':
-			model = ch == 'c' ? BOTH : CGB;
-			if (titleLen > 15) {
-				titleLen = 15;
-				fprintf(stderr, "warning: Truncating title \"%s\" to 15 chars\n",
-					title);
-			}
-			break;
-
 		case 'f':
-			fixSpec = 0;
-			while (*musl_optarg) {
-				switch (*musl_optarg) {
-#define SPEC_l FIX_LOGO
-#define SPEC_L TRASH_LOGO
-#define SPEC_h FIX_HEADER_SUM
-#define SPEC_H TRASH_HEADER_SUM
-#define SPEC_g FIX_GLOBAL_SUM
-#define SPEC_G TRASH_GLOBAL_SUM
-#define or(new, bad) \
-do { \
-	if (fixSpec & SPEC_##bad) \
-		fprintf(stderr, \
-			"warning: '" #new "' overriding '" #bad "' in fix spec\n"); \
-	fixSpec = (fixSpec & ~SPEC_##bad) | SPEC_##new; \
-} while (0)
-				case 'l':
-					or(l, L);
-					break;
-				case 'L':
-					or(L, l);
-					break;
-
-				case 'h':
-					or(h, H);
-					break;
-				case 'H':
-					or(H, h);
-					break;
-
-				case 'g':
-					or(g, G);
-					break;
-				case 'G':
-					or(G, g);
-					break;
-
-				default:
-					fprintf(stderr, "warning: Ignoring '%c' in fix spec\n",
-						*musl_optarg);
-#undef or
-				}
-				musl_optarg++;
-			}
-			break;
-
 		case 'i':
-			gameID = musl_optarg;
-			len = strlen(gameID);
-			if (len > 4) {
-				len = 4;
-				fprintf(stderr, "warning: Truncating game ID \"%s\" to 4 chars\n",
-					gameID);
-			}
-			gameIDLen = len;
-			if (titleLen > 11) {
-				titleLen = 11;
-				fprintf(stderr, "warning: Truncating title \"%s\" to 11 chars\n",
-					title);
-			}
-			break;
-
 		case 'j':
-			japanese = false;
-			break;
-
 		case 'k':
-			newLicensee = musl_optarg;
-			len = strlen(newLicensee);
-			if (len > 2) {
-				len = 2;
-				fprintf(stderr,
-					"warning: Truncating new licensee \"%s\" to 2 chars\n",
-					newLicensee);
-			}
-			newLicenseeLen = len;
-			break;
-
 		case 'l':
-			parseByte(oldLicensee, "l");
-			break;
-
 		case 'm':
-			cartridgeType = parseMBC(musl_optarg);
-			if (cartridgeType == MBC_BAD) {
-				report("error: Unknown MBC \"%s\"\n", musl_optarg);
-			} else if (cartridgeType == MBC_WRONG_FEATURES) {
-				report("error: Features incompatible with MBC (\"%s\")\n",
-				       musl_optarg);
-			} else if (cartridgeType == MBC_BAD_RANGE) {
-				report("error: Specified MBC ID out of range 0-255: %s\n",
-				       musl_optarg);
-			} else if (cartridgeType == ROM_RAM || cartridgeType == ROM_RAM_BATTERY) {
-				fprintf(stderr, "warning: ROM+RAM / ROM+RAM+BATTERY are under-specified and poorly supported\n");
-			}
-			break;
-
 		case 'n':
-			parseByte(romVersion, "n");
-			break;
-
-		case 'p':
-			parseByte(padValue, "p");
-			break;
-
 		case 'r':
-			parseByte(ramSize, "r");
-			break;
-
 		case 's':
-			sgb = true;
+		case 't':
+		case 'v':
+			if (!hdr_ParseOption(ch, musl_optarg) && nbErrors != UINT8_MAX)
+				nbErrors++;
 			break;
 
-		case 't':
-			title = musl_optarg;
-			len = strlen(title);
-			uint8_t maxLen = maxTitleLen();
-
-			if (len > maxLen) {
-				len = maxLen;
-				fprintf(stderr, "warning: Truncating title \"%s\" to %u chars\n",
-					title, maxLen);
+		case 'J': {
+			char *endptr;
+
+			nbThreads = strtoul(musl_optarg, &endptr, 0);
+			if (musl_optarg[0] == '\0' || *endptr || nbThreads == 0 || nbThreads > 256) {
+				report("error: Argument to option 'J' must be between 1 and 256, got %s\n",
+				       musl_optarg);
+				nbThreads = 1;
 			}
-			titleLen = len;
+			break;
+		}
+
+		case 'p':
+			if (!hdr_ParseByte(&padValue, "p", musl_optarg) && nbErrors != UINT8_MAX)
+				nbErrors++;
 			break;
 
 		case 'V':
 			printf("rgbfix %s\n", get_package_version_string());
 			exit(0);
 
-		case 'v':
-			fixSpec = FIX_LOGO | FIX_HEADER_SUM | FIX_GLOBAL_SUM;
-			break;
-
 		default:
 			fprintf(stderr, "FATAL: unknown option '%c'\n", ch);
 			printUsage();
 			exit(1);
 		}
-#undef parseByte
-	}
-
-	if (ramSize != UNSPECIFIED && cartridgeType < UNSPECIFIED) {
-		if (cartridgeType == ROM_RAM || cartridgeType == ROM_RAM_BATTERY) {
-			if (ramSize != 1)
-				fprintf(stderr, "warning: MBC \"%s\" should have 2kiB of RAM (-r 1)\n",
-					mbcName(cartridgeType));
-		} else if (hasRAM(cartridgeType)) {
-			if (!ramSize) {
-				fprintf(stderr,
-					"warning: MBC \"%s\" has RAM, but RAM size was set to 0\n",
-					mbcName(cartridgeType));
-			} else if (ramSize == 1) {
-				fprintf(stderr,
-					"warning: RAM size 1 (2 kiB) was specified for MBC \"%s\"\n",
-					mbcName(cartridgeType));
-			} // TODO: check possible values?
-		} else if (ramSize) {
-			fprintf(stderr,
-				"warning: MBC \"%s\" has no RAM, but RAM size was set to %u\n",
-				mbcName(cartridgeType), ramSize);
-		}
 	}
 
-	if (sgb && oldLicensee != UNSPECIFIED && oldLicensee != 0x33)
-		fprintf(stderr,
-			"warning: SGB compatibility enabled, but old licensee is %#x, not 0x33\n",
-			oldLicensee);
+	hdr_CheckOptions();
 
 	argv += musl_optind;
 	bool failed = nbErrors;
 
 	if (!*argv) {
 		failed |= processFilename("-");
+	} else if (nbThreads > 1 && argv[1]) {
+		failed |= processFilenamesParallel(argv, argc - musl_optind, nbThreads);
 	} else {
 		do {
 			failed |= processFilename(*argv);
@@ -9,9 +9,27 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 
 #include "gfx/gb.h"
 
+/* A tile is 8 rows of `depth` bytes each, i.e. at most 16 bytes */
+#define MAX_TILE_SIZE 16
+
+/* Bit-reversed value of each byte, for flipping tiles horizontally */
+#define R2(n) n, n + 2 * 64, n + 1 * 64, n + 3 * 64
+#define R4(n) R2(n), R2(n + 2 * 16), R2(n + 1 * 16), R2(n + 3 * 16)
+#define R6(n) R4(n), R4(n + 2 * 4), R4(n + 1 * 4), R4(n + 3 * 4)
+static const uint8_t reversed_bits[256] = {
+	R6(0), R6(2), R6(1), R6(3)
+};
+#undef R6
+#undef R4
+#undef R2
+
 void transpose_tiles(struct GBImage *gb, int width)
 {
 	uint8_t *newdata;
@@ -35,28 +53,65 @@ void transpose_tiles(struct GBImage *gb, int width)
 	gb->data = newdata;
 }
 
-void raw_to_gb(const struct RawIndexedImage *raw_image, struct GBImage *gb)
+/*
+ * Packs a row of 8 pixels into one byte of each bitplane, leftmost pixel in
+ * the most significant bit.
+ */
+static void pack_pixel_row(const uint8_t *pixels, uint8_t *planes)
 {
-	int x, y, byte;
-	uint8_t index;
-
-	for (y = 0; y < raw_image->height; y++) {
-		for (x = 0; x < raw_image->width; x++) {
-			index = raw_image->data[y][x];
-			index &= (1 << depth) - 1;
-
-			byte = y * depth
-				+ x / 8 * raw_image->height / 8 * 8 * depth;
-			gb->data[byte] |= (index & 1) << (7 - x % 8);
-			if (depth == 2) {
-				gb->data[byte + 1] |=
-					(index >> 1) << (7 - x % 8);
-			}
+	uint8_t low = 0;
+	uint8_t high = 0;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		low = low << 1 | (pixels[i] & 1);
+		high = high << 1 | (pixels[i] >> 1 & 1);
+	}
+	planes[0] = low;
+	if (depth == 2)
+		planes[1] = high;
+}
+
+void raw_row_to_gb(const uint8_t *row, int y, int width, int height,
+		   struct GBImage *gb)
+{
+	int x = 0;
+	/* Each column of tiles is stored contiguously, one row at a time */
+	int column_size = height * depth;
+	uint8_t *planes = &gb->data[y * depth];
+
+#ifdef __SSE2__
+	/*
+	 * Shifting each pixel left moves one of its bits to the top of its
+	 * byte, where `pmovmskb` collects it for 16 pixels at once
+	 */
+	for (; x + 16 <= width; x += 16) {
+		__m128i pixels = _mm_loadu_si128((const __m128i *)&row[x]);
+		int low = _mm_movemask_epi8(_mm_slli_epi16(pixels, 7));
+		int high = _mm_movemask_epi8(_mm_slli_epi16(pixels, 6));
+		uint8_t *left = &planes[x / 8 * column_size];
+		uint8_t *right = left + column_size;
+
+		/* `pmovmskb` puts the leftmost pixel in the lowest bit */
+		left[0] = reversed_bits[low & 0xFF];
+		right[0] = reversed_bits[low >> 8];
+		if (depth == 2) {
+			left[1] = reversed_bits[high & 0xFF];
+			right[1] = reversed_bits[high >> 8];
 		}
 	}
+#endif
+	for (; x < width; x += 8)
+		pack_pixel_row(&row[x], &planes[x / 8 * column_size]);
+}
+
+void raw_to_gb(const struct RawIndexedImage *raw_image, struct GBImage *gb)
+{
+	int y;
 
-	if (!gb->horizontal)
-		transpose_tiles(gb, raw_image->width / 8);
+	for (y = 0; y < raw_image->height; y++)
+		raw_row_to_gb(raw_image->data[y], y, raw_image->width,
+			      raw_image->height, gb);
 }
 
 void output_file(const struct Options *opts, const struct GBImage *gb)
@@ -73,35 +128,119 @@ void output_file(const struct Options *opts, const struct GBImage *gb)
 	fclose(f);
 }
 
-int get_tile_index(uint8_t *tile, uint8_t **tiles, int num_tiles, int tile_size)
+/* FNV-1a hash */
+static uint32_t hash_tile(const uint8_t *tile, int tile_size)
 {
-	int i, j;
+	uint32_t hash = 0x811c9dc5;
+	int i;
 
-	for (i = 0; i < num_tiles; i++) {
-		for (j = 0; j < tile_size; j++) {
-			if (tile[j] != tiles[i][j])
-				break;
-		}
+	for (i = 0; i < tile_size; i++) {
+		hash ^= tile[i];
+		hash *= 16777619;
+	}
+	return hash;
+}
+
+void init_tileset(struct Tileset *tileset, int tile_size, bool unique)
+{
+	int i;
+	int nb_slots = 256;
+
+	tileset->data = NULL;
+	tileset->num_tiles = 0;
+	tileset->capacity = 0;
+	tileset->tile_size = tile_size;
+	tileset->slots = NULL;
+	tileset->mask = nb_slots - 1;
+
+	if (unique) {
+		tileset->slots = malloc(nb_slots * sizeof(*tileset->slots));
+		if (!tileset->slots)
+			err(1, "%s: Failed to allocate memory for tile index",
+			    __func__);
+		for (i = 0; i < nb_slots; i++)
+			tileset->slots[i] = -1;
+	}
+}
+
+void free_tileset(struct Tileset *tileset)
+{
+	free(tileset->data);
+	free(tileset->slots);
+}
+
+/*
+ * Returns the slot where `tile` is stored in the index, or the empty slot
+ * where it would be stored.
+ */
+static int find_tile_slot(const struct Tileset *tileset, const uint8_t *tile)
+{
+	int tile_size = tileset->tile_size;
+	int slot = hash_tile(tile, tile_size) & tileset->mask;
+
+	while (tileset->slots[slot] >= 0
+	    && memcmp(&tileset->data[tileset->slots[slot] * tile_size], tile,
+		      tile_size))
+		slot = (slot + 1) & tileset->mask;
+	return slot;
+}
+
+/* Doubles the size of the index, once it's half full */
+static void grow_tile_index(struct Tileset *tileset)
+{
+	int i;
+	int nb_slots = (tileset->mask + 1) * 2;
+
+	free(tileset->slots);
+	tileset->slots = malloc(nb_slots * sizeof(*tileset->slots));
+	if (!tileset->slots)
+		err(1, "%s: Failed to allocate memory for tile index",
+		    __func__);
+	for (i = 0; i < nb_slots; i++)
+		tileset->slots[i] = -1;
+	tileset->mask = nb_slots - 1;
 
-		if (j >= tile_size)
-			return i;
+	for (i = 0; i < tileset->num_tiles; i++) {
+		uint8_t *tile = &tileset->data[i * tileset->tile_size];
+
+		tileset->slots[find_tile_slot(tileset, tile)] = i;
+	}
+}
+
+int add_tile(struct Tileset *tileset, const uint8_t *tile)
+{
+	int index = tileset->num_tiles;
+
+	if (index == tileset->capacity) {
+		tileset->capacity = tileset->capacity ? tileset->capacity * 2
+						      : 64;
+		tileset->data = realloc(tileset->data, tileset->capacity
+							* tileset->tile_size);
+		if (!tileset->data)
+			err(1, "%s: Failed to allocate memory for tiles",
+			    __func__);
+	}
+	memcpy(&tileset->data[index * tileset->tile_size], tile,
+	       tileset->tile_size);
+	tileset->num_tiles++;
+
+	if (tileset->slots) {
+		if (tileset->num_tiles * 2 > tileset->mask + 1)
+			grow_tile_index(tileset);
+		else
+			tileset->slots[find_tile_slot(tileset, tile)] = index;
 	}
-	return -1;
+	return index;
+}
+
+int get_tile_index(uint8_t *tile, const struct Tileset *tileset)
+{
+	return tileset->slots[find_tile_slot(tileset, tile)];
 }
 
 uint8_t reverse_bits(uint8_t b)
 {
-	uint8_t rev = 0;
-
-	rev |= (b & 0x80) >> 7;
-	rev |= (b & 0x40) >> 5;
-	rev |= (b & 0x20) >> 3;
-	rev |= (b & 0x10) >> 1;
-	rev |= (b & 0x08) << 1;
-	rev |= (b & 0x04) << 3;
-	rev |= (b & 0x02) << 5;
-	rev |= (b & 0x01) << 7;
-	return rev;
+	return reversed_bits[b];
 }
 
 void xflip(uint8_t *tile, uint8_t *tile_xflip, int tile_size)
@@ -109,7 +248,7 @@ void xflip(uint8_t *tile, uint8_t *tile_xflip, int tile_size)
 	int i;
 
 	for (i = 0; i < tile_size; i++)
-		tile_xflip[i] = reverse_bits(tile[i]);
+		tile_xflip[i] = reversed_bits[tile[i]];
 }
 
 void yflip(uint8_t *tile, uint8_t *tile_yflip, int tile_size)
@@ -121,74 +260,60 @@ void yflip(uint8_t *tile, uint8_t *tile_yflip, int tile_size)
 }
 
 /*
- * get_mirrored_tile_index looks for `tile` in tile array `tiles`, also
+ * get_mirrored_tile_index looks for `tile` in `tileset`, also
  * checking x-, y-, and xy-mirrored versions of `tile`. If one is found,
  * `*flags` is set according to the type of mirroring and the index of the
  * matched tile is returned. If no match is found, -1 is returned.
  */
-int get_mirrored_tile_index(uint8_t *tile, uint8_t **tiles, int num_tiles,
-			    int tile_size, int *flags)
+int get_mirrored_tile_index(uint8_t *tile, const struct Tileset *tileset,
+			    int *flags)
 {
 	int index;
-	uint8_t *tile_xflip;
-	uint8_t *tile_yflip;
+	int tile_size = tileset->tile_size;
+	uint8_t tile_xflip[MAX_TILE_SIZE];
+	uint8_t tile_yflip[MAX_TILE_SIZE];
 
-	index = get_tile_index(tile, tiles, num_tiles, tile_size);
+	index = get_tile_index(tile, tileset);
 	if (index >= 0) {
 		*flags = 0;
 		return index;
 	}
 
-	tile_yflip = malloc(tile_size);
-	if (!tile_yflip)
-		err(1, "%s: Failed to allocate memory for Y flip of tile",
-		    __func__);
 	yflip(tile, tile_yflip, tile_size);
-	index = get_tile_index(tile_yflip, tiles, num_tiles, tile_size);
+	index = get_tile_index(tile_yflip, tileset);
 	if (index >= 0) {
 		*flags = YFLIP;
-		free(tile_yflip);
 		return index;
 	}
 
-	tile_xflip = malloc(tile_size);
-	if (!tile_xflip)
-		err(1, "%s: Failed to allocate memory for X flip of tile",
-		    __func__);
 	xflip(tile, tile_xflip, tile_size);
-	index = get_tile_index(tile_xflip, tiles, num_tiles, tile_size);
+	index = get_tile_index(tile_xflip, tileset);
 	if (index >= 0) {
 		*flags = XFLIP;
-		free(tile_yflip);
-		free(tile_xflip);
 		return index;
 	}
 
 	yflip(tile_xflip, tile_yflip, tile_size);
-	index = get_tile_index(tile_yflip, tiles, num_tiles, tile_size);
+	index = get_tile_index(tile_yflip, tileset);
 	if (index >= 0)
 		*flags = XFLIP | YFLIP;
 
-	free(tile_yflip);
-	free(tile_xflip);
 	return index;
 }
 
-void create_mapfiles(const struct Options *opts, struct GBImage *gb,
-		     struct Mapfile *tilemap, struct Mapfile *attrmap)
+void add_image_tiles(const struct Options *opts, const struct GBImage *gb,
+		     struct Tileset *tileset, struct Mapfile *tilemap,
+		     struct Mapfile *attrmap)
 {
-	int i, j;
 	int gb_i;
-	int tile_size;
+	int tile_size = tileset->tile_size;
 	int max_tiles;
-	int num_tiles;
 	int index;
 	int flags;
 	int gb_size;
-	uint8_t *tile;
-	uint8_t **tiles;
+	bool warned = false;
+	uint8_t tile[MAX_TILE_SIZE];
 
-	tile_size = sizeof(*tile) * depth * 8;
 	gb_size = gb->size - (gb->trim * tile_size);
 	max_tiles = gb_size / tile_size;
 
@@ -196,11 +321,6 @@ void create_mapfiles(const struct Options *opts, struct GBImage *gb,
 	if (gb_size > max_tiles * tile_size)
 		max_tiles++;
 
-	tiles = calloc(max_tiles, sizeof(*tiles));
-	if (!tiles)
-		err(1, "%s: Failed to allocate memory for tiles", __func__);
-	num_tiles = 0;
-
 	if (*opts->tilemapfile) {
 		tilemap->data = calloc(max_tiles, sizeof(*tilemap->data));
 		if (!tilemap->data)
@@ -217,41 +337,32 @@ void create_mapfiles(const struct Options *opts, struct GBImage *gb,
 		attrmap->size = 0;
 	}
 
-	gb_i = 0;
-	while (gb_i < gb_size) {
+	for (gb_i = 0; gb_i < gb_size; gb_i += tile_size) {
 		flags = 0;
-		tile = malloc(tile_size);
-		if (!tile)
-			err(1, "%s: Failed to allocate memory for tile",
-			    __func__);
-		for (i = 0; i < tile_size; i++) {
-			tile[i] = gb->data[gb_i];
-			gb_i++;
-		}
+		/* A partial last tile is padded with zeros */
+		memset(tile, 0, tile_size);
+		memcpy(tile, &gb->data[gb_i], gb->size - gb_i < tile_size
+					      ? gb->size - gb_i : tile_size);
+
 		if (opts->unique) {
-			if (opts->mirror) {
-				index = get_mirrored_tile_index(tile, tiles,
-								num_tiles,
-								tile_size,
+			if (opts->mirror)
+				index = get_mirrored_tile_index(tile, tileset,
 								&flags);
-			} else {
-				index = get_tile_index(tile, tiles, num_tiles,
-						       tile_size);
-			}
+			else
+				index = get_tile_index(tile, tileset);
 
-			if (index < 0) {
-				index = num_tiles;
-				tiles[num_tiles] = tile;
-				num_tiles++;
-			} else {
-				free(tile);
-			}
+			if (index < 0)
+				index = add_tile(tileset, tile);
 		} else {
-			index = num_tiles;
-			tiles[num_tiles] = tile;
-			num_tiles++;
+			index = add_tile(tileset, tile);
 		}
 		if (*opts->tilemapfile) {
+			/* Tilemap entries are bytes, so higher indices wrap */
+			if (index > 0xFF && !warned) {
+				warnx("Tile #%d of '%s' doesn't fit in tilemap '%s', whose indices wrap around past 255",
+				      index, opts->infile, opts->tilemapfile);
+				warned = true;
+			}
 			tilemap->data[tilemap->size] = index;
 			tilemap->size++;
 		}
@@ -260,25 +371,38 @@ void create_mapfiles(const struct Options *opts, struct GBImage *gb,
 			attrmap->size++;
 		}
 	}
+}
+
+void create_mapfiles(const struct Options *opts, struct GBImage *gb,
+		     struct Mapfile *tilemap, struct Mapfile *attrmap)
+{
+	struct Tileset tileset;
+
+	init_tileset(&tileset, depth * 8, opts->unique);
+	add_image_tiles(opts, gb, &tileset, tilemap, attrmap);
 
 	if (opts->unique) {
 		free(gb->data);
-		gb->data = malloc(tile_size * num_tiles);
-		if (!gb->data)
-			err(1, "%s: Failed to allocate memory for tile data",
-			    __func__);
-		for (i = 0; i < num_tiles; i++) {
-			tile = tiles[i];
-			for (j = 0; j < tile_size; j++)
-				gb->data[i * tile_size + j] = tile[j];
-		}
-		gb->size = i * tile_size;
+		gb->data = tileset.data;
+		gb->size = tileset.num_tiles * tileset.tile_size;
+		tileset.data = NULL;
 	}
+	free_tileset(&tileset);
+}
+
+void output_tileset_file(const struct Options *opts,
+			 const struct Tileset *tileset)
+{
+	FILE *f;
+
+	f = fopen(opts->outfile, "wb");
+	if (!f)
+		err(1, "%s: Opening output file '%s' failed", __func__,
+		    opts->outfile);
 
-	for (i = 0; i < num_tiles; i++)
-		free(tiles[i]);
+	fwrite(tileset->data, tileset->tile_size, tileset->num_tiles, f);
 
-	free(tiles);
+	fclose(f);
 }
 
 void output_tilemap_file(const struct Options *opts,
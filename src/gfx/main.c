@@ -13,12 +13,17 @@
 #include "gfx/main.h"
 
 #include "extern/getopt.h"
+#include "hashmap.h"
+#include "parallel.h"
 #include "version.h"
 
-int depth, colors;
+thread_local_ int depth, colors;
+
+static char *batchfile = NULL; /* -b */
+static unsigned long nb_threads = 1; /* -J */
 
 /* Short options */
-static char const *optstring = "Aa:CDd:Ffhmo:Pp:Tt:uVvx:";
+static char const *optstring = "Aa:b:CDd:FfhJ:mo:Pp:Tt:uVvx:";
 
 /*
  * Equivalent long options
@@ -33,12 +38,14 @@ static char const *optstring = "Aa:CDd:Ffhmo:Pp:Tt:uVvx:";
 static struct option const longopts[] = {
 	{ "output-attr-map", no_argument,       NULL, 'A' },
 	{ "attr-map",        required_argument, NULL, 'a' },
+	{ "batch",           required_argument, NULL, 'b' },
 	{ "color-curve",     no_argument,       NULL, 'C' },
 	{ "debug",           no_argument,       NULL, 'D' },
 	{ "depth",           required_argument, NULL, 'd' },
 	{ "fix",             no_argument,       NULL, 'f' },
 	{ "fix-and-save",    no_argument,       NULL, 'F' },
 	{ "horizontal",      no_argument,       NULL, 'h' },
+	{ "jobs",            required_argument, NULL, 'J' },
 	{ "mirror-tiles",    no_argument,       NULL, 'm' },
 	{ "output",          required_argument, NULL, 'o' },
 	{ "output-palette",  no_argument,       NULL, 'P' },
@@ -58,8 +65,11 @@ static void print_usage(void)
 "Usage: rgbgfx [-CDhmuVv] [-f | -F] [-a <attr_map> | -A] [-d <depth>]\n"
 "              [-o <out_file>] [-p <pal_file> | -P] [-t <tile_map> | -T]\n"
 "              [-x <tiles>] <file>\n"
+"       rgbgfx -b <manifest> [-J <jobs>]\n"
 "Useful options:\n"
+"    -b, --batch <path>        convert each image listed in this file\n"
 "    -f, --fix                 make the input image an indexed PNG\n"
+"    -J, --jobs <count>        convert up to this many images at the same time\n"
 "    -m, --mirror-tiles        optimize out mirrored tiles\n"
 "    -o, --output <path>       set the output binary file\n"
 "    -t, --tilemap <path>      set the output tilemap file\n"
@@ -71,107 +81,50 @@ static void print_usage(void)
 	exit(1);
 }
 
-int main(int argc, char *argv[])
+/*
+ * Returns the default name of one of an image's outputs: the input file's
+ * name, with its extension replaced by `ext`.
+ */
+static char *make_output_name(const char *infile, const char *ext)
 {
-	int ch, size;
-	struct Options opts = {0};
+	char *dot = strrchr(infile, '.');
+	size_t len = dot ? (size_t)(dot - infile) : strlen(infile);
+	char *name = malloc(len + strlen(ext) + 1);
+
+	if (!name)
+		err(1, "%s: Failed to allocate memory for output file name",
+		    __func__);
+	memcpy(name, infile, len);
+	strcpy(&name[len], ext);
+	return name;
+}
+
+/*
+ * Converts one image. If `tileset` is non-NULL, the image's tiles are added
+ * to it instead of being written to the output file.
+ */
+static void convert_image(const struct Options *options,
+			  struct Tileset *tileset)
+{
+	struct Options opts = *options;
 	struct ImageOptions png_options = {0};
 	struct RawIndexedImage *raw_image;
 	struct GBImage gb = {0};
 	struct Mapfile tilemap = {0};
 	struct Mapfile attrmap = {0};
-	char *ext;
-
-	opts.tilemapfile = "";
-	opts.attrmapfile = "";
-	opts.palfile = "";
-	opts.outfile = "";
-
-	depth = 2;
-
-	while ((ch = musl_getopt_long_only(argc, argv, optstring, longopts,
-					   NULL)) != -1) {
-		switch (ch) {
-		case 'A':
-			opts.attrmapout = true;
-			break;
-		case 'a':
-			opts.attrmapfile = musl_optarg;
-			break;
-		case 'C':
-			opts.colorcurve = true;
-			break;
-		case 'D':
-			opts.debug = true;
-			break;
-		case 'd':
-			depth = strtoul(musl_optarg, NULL, 0);
-			break;
-		case 'F':
-			opts.hardfix = true;
-			/* fallthrough */
-		case 'f':
-			opts.fix = true;
-			break;
-		case 'h':
-			opts.horizontal = true;
-			break;
-		case 'm':
-			opts.mirror = true;
-			opts.unique = true;
-			break;
-		case 'o':
-			opts.outfile = musl_optarg;
-			break;
-		case 'P':
-			opts.palout = true;
-			break;
-		case 'p':
-			opts.palfile = musl_optarg;
-			break;
-		case 'T':
-			opts.tilemapout = true;
-			break;
-		case 't':
-			opts.tilemapfile = musl_optarg;
-			break;
-		case 'u':
-			opts.unique = true;
-			break;
-		case 'V':
-			printf("rgbgfx %s\n", get_package_version_string());
-			exit(0);
-		case 'v':
-			opts.verbose = true;
-			break;
-		case 'x':
-			opts.trim = strtoul(musl_optarg, NULL, 0);
-			break;
-		default:
-			print_usage();
-			/* NOTREACHED */
-		}
-	}
-	argc -= musl_optind;
-	argv += musl_optind;
-
-	if (argc == 0) {
-		fputs("FATAL: no input files\n", stderr);
-		print_usage();
-	}
 
 #define WARN_MISMATCH(property) \
 	warnx("The PNG's " property \
 	      " setting doesn't match the one defined on the command line")
 
-	opts.infile = argv[argc - 1];
-
-	if (depth != 1 && depth != 2)
-		errx(1, "Depth option must be either 1 or 2.");
-
 	colors = 1 << depth;
 
-	raw_image = input_png_file(&opts, &png_options);
+	/*
+	 * Unless the PNG is to be rewritten, which requires all of its pixels,
+	 * it's converted to tiles while being decoded, one row at a time.
+	 */
+	raw_image = input_png_file(&opts, &png_options,
+				   opts.fix || opts.debug ? NULL : &gb);
 
 	png_options.tilemapfile = "";
 	png_options.attrmapfile = "";
@@ -278,65 +231,36 @@ int main(int argc, char *argv[])
 	if (png_options.palout)
 		opts.palout = png_options.palout;
 
-	if (!*opts.tilemapfile && opts.tilemapout) {
-		ext = strrchr(opts.infile, '.');
-
-		if (ext != NULL) {
-			size = ext - opts.infile + 9;
-			opts.tilemapfile = malloc(size);
-			strncpy(opts.tilemapfile, opts.infile, size);
-			*strrchr(opts.tilemapfile, '.') = '\0';
-			strcat(opts.tilemapfile, ".tilemap");
-		} else {
-			opts.tilemapfile = malloc(strlen(opts.infile) + 9);
-			strcpy(opts.tilemapfile, opts.infile);
-			strcat(opts.tilemapfile, ".tilemap");
-		}
-	}
+	if (!*opts.tilemapfile && opts.tilemapout)
+		opts.tilemapfile = make_output_name(opts.infile, ".tilemap");
 
-	if (!*opts.attrmapfile && opts.attrmapout) {
-		ext = strrchr(opts.infile, '.');
-
-		if (ext != NULL) {
-			size = ext - opts.infile + 9;
-			opts.attrmapfile = malloc(size);
-			strncpy(opts.attrmapfile, opts.infile, size);
-			*strrchr(opts.attrmapfile, '.') = '\0';
-			strcat(opts.attrmapfile, ".attrmap");
-		} else {
-			opts.attrmapfile = malloc(strlen(opts.infile) + 9);
-			strcpy(opts.attrmapfile, opts.infile);
-			strcat(opts.attrmapfile, ".attrmap");
-		}
-	}
+	if (!*opts.attrmapfile && opts.attrmapout)
+		opts.attrmapfile = make_output_name(opts.infile, ".attrmap");
 
-	if (!*opts.palfile && opts.palout) {
-		ext = strrchr(opts.infile, '.');
-
-		if (ext != NULL) {
-			size = ext - opts.infile + 5;
-			opts.palfile = malloc(size);
-			strncpy(opts.palfile, opts.infile, size);
-			*strrchr(opts.palfile, '.') = '\0';
-			strcat(opts.palfile, ".pal");
-		} else {
-			opts.palfile = malloc(strlen(opts.infile) + 5);
-			strcpy(opts.palfile, opts.infile);
-			strcat(opts.palfile, ".pal");
-		}
-	}
+	if (!*opts.palfile && opts.palout)
+		opts.palfile = make_output_name(opts.infile, ".pal");
 
-	gb.size = raw_image->width * raw_image->height * depth / 8;
-	gb.data = calloc(gb.size, 1);
+	if (raw_image->data) {
+		gb.size = raw_image->width * raw_image->height * depth / 8;
+		gb.data = calloc(gb.size, 1);
+	}
 	gb.trim = opts.trim;
 	gb.horizontal = opts.horizontal;
 
 	if (*opts.outfile || *opts.tilemapfile || *opts.attrmapfile) {
-		raw_to_gb(raw_image, &gb);
-		create_mapfiles(&opts, &gb, &tilemap, &attrmap);
+		if (raw_image->data)
+			raw_to_gb(raw_image, &gb);
+		if (!gb.horizontal)
+			transpose_tiles(&gb, raw_image->width / 8);
+		if (tileset)
+			add_image_tiles(&opts, &gb, tileset, &tilemap,
+					&attrmap);
+		else
+			create_mapfiles(&opts, &gb, &tilemap, &attrmap);
 	}
 
-	if (*opts.outfile)
+	/* Shared tilesets are written once all of their images are added */
+	if (*opts.outfile && !tileset)
 		output_file(&opts, &gb);
 
 	if (*opts.tilemapfile)
@@ -353,6 +277,378 @@ int main(int argc, char *argv[])
 
 	destroy_raw_image(&raw_image);
 	free(gb.data);
+	free(tilemap.data);
+	free(attrmap.data);
+}
+
+/*
+ * Parses the options of one conversion, either from the command line or from
+ * a line of a batch manifest, where batch options may not appear.
+ */
+static void parse_options(int argc, char *argv[], struct Options *opts,
+			  bool in_manifest)
+{
+	int ch;
+	char *endptr;
+
+	opts->tilemapfile = "";
+	opts->attrmapfile = "";
+	opts->palfile = "";
+	opts->outfile = "";
+
+	depth = 2;
+
+	/* Start parsing from scratch, even if another line was parsed before */
+	musl_optind = 0;
+	while ((ch = musl_getopt_long_only(argc, argv, optstring, longopts,
+					   NULL)) != -1) {
+		switch (ch) {
+		case 'A':
+			opts->attrmapout = true;
+			break;
+		case 'a':
+			opts->attrmapfile = musl_optarg;
+			break;
+		case 'b':
+			if (in_manifest)
+				errx(1, "Batch manifests cannot contain option -b");
+			batchfile = musl_optarg;
+			break;
+		case 'C':
+			opts->colorcurve = true;
+			break;
+		case 'D':
+			opts->debug = true;
+			break;
+		case 'd':
+			depth = strtoul(musl_optarg, NULL, 0);
+			break;
+		case 'F':
+			opts->hardfix = true;
+			/* fallthrough */
+		case 'f':
+			opts->fix = true;
+			break;
+		case 'h':
+			opts->horizontal = true;
+			break;
+		case 'J':
+			if (in_manifest)
+				errx(1, "Batch manifests cannot contain option -J");
+			nb_threads = strtoul(musl_optarg, &endptr, 0);
+			if (musl_optarg[0] == '\0' || *endptr
+			 || nb_threads == 0 || nb_threads > 256)
+				errx(1, "Argument to option -J must be between 1 and 256");
+			break;
+		case 'm':
+			opts->mirror = true;
+			opts->unique = true;
+			break;
+		case 'o':
+			opts->outfile = musl_optarg;
+			break;
+		case 'P':
+			opts->palout = true;
+			break;
+		case 'p':
+			opts->palfile = musl_optarg;
+			break;
+		case 'T':
+			opts->tilemapout = true;
+			break;
+		case 't':
+			opts->tilemapfile = musl_optarg;
+			break;
+		case 'u':
+			opts->unique = true;
+			break;
+		case 'V':
+			printf("rgbgfx %s\n", get_package_version_string());
+			exit(0);
+		case 'v':
+			opts->verbose = true;
+			break;
+		case 'x':
+			opts->trim = strtoul(musl_optarg, NULL, 0);
+			break;
+		default:
+			print_usage();
+			/* NOTREACHED */
+		}
+	}
+
+	if (musl_optind < argc)
+		opts->infile = argv[argc - 1];
+
+	if (depth != 1 && depth != 2)
+		errx(1, "Depth option must be either 1 or 2.");
+}
+
+/* One line of a batch manifest */
+struct Conversion {
+	struct Options opts;
+	int depth;
+	struct Conversion *next; /* The next one sharing the same output file */
+	char *output_names[4]; /* Default names of its outputs */
+};
+
+static void convert_group(size_t index, void *arg)
+{
+	struct Conversion *first = ((struct Conversion **)arg)[index];
+	struct Conversion *conversion;
+	struct Tileset tileset;
+
+	depth = first->depth;
+	if (!first->next) {
+		convert_image(&first->opts, NULL);
+		return;
+	}
+
+	init_tileset(&tileset, depth * 8, first->opts.unique);
+	for (conversion = first; conversion; conversion = conversion->next)
+		convert_image(&conversion->opts, &tileset);
+	output_tileset_file(&first->opts, &tileset);
+	free_tileset(&tileset);
+}
+
+static char *read_manifest(void)
+{
+	FILE *f;
+	char *contents = NULL;
+	size_t size = 0;
+	size_t capacity = 0;
+
+	f = fopen(batchfile, "rb");
+	if (!f)
+		err(1, "Opening batch manifest '%s' failed", batchfile);
+
+	do {
+		if (size == capacity) {
+			capacity = capacity ? capacity * 2 : 4096;
+			contents = realloc(contents, capacity + 1);
+			if (!contents)
+				err(1, "%s: Failed to allocate memory for manifest",
+				    __func__);
+		}
+		size += fread(&contents[size], 1, capacity - size, f);
+	} while (size == capacity);
+
+	if (ferror(f))
+		err(1, "Reading batch manifest '%s' failed", batchfile);
+	fclose(f);
+
+	contents[size] = '\0';
+	return contents;
+}
+
+/*
+ * Checks that an output of a conversion isn't written by any other one, since
+ * conversions may run concurrently.
+ * Tile data outputs are only checked here against other kinds of outputs.
+ */
+static void add_output(HashMap outputs, HashMap tile_outputs,
+		       struct Conversion *conversion, const char *path,
+		       unsigned int line_no)
+{
+	if (hash_GetElement(outputs, path) || hash_GetElement(tile_outputs, path)
+	 || !strcmp(path, conversion->opts.outfile))
+		errx(1, "%s(%u): Output file '%s' is written more than once",
+		     batchfile, line_no, path);
+	hash_AddElement(outputs, path, conversion);
+}
+
+/*
+ * Returns the path of one of a conversion's outputs, or NULL if it has none.
+ * If the path is a default one, it's kept in `output_names` to be freed later.
+ */
+static const char *get_output_path(struct Conversion *conversion,
+				   char *path, bool enabled, const char *ext,
+				   size_t *nb_names)
+{
+	if (*path)
+		return path;
+	if (!enabled)
+		return NULL;
+	path = make_output_name(conversion->opts.infile, ext);
+	conversion->output_names[(*nb_names)++] = path;
+	return path;
+}
+
+/*
+ * Records every output of a conversion other than its tile data, erroring out
+ * if any of them is written by another conversion.
+ */
+static void add_outputs(HashMap outputs, HashMap tile_outputs,
+			struct Conversion *conversion, unsigned int line_no)
+{
+	struct Options *opts = &conversion->opts;
+	size_t nb_names = 0;
+	const char *paths[4];
+	char *png_path = NULL;
+	int i;
+
+	if (*opts->outfile && hash_GetElement(outputs, opts->outfile))
+		errx(1, "%s(%u): Output file '%s' is written more than once",
+		     batchfile, line_no, opts->outfile);
+
+	paths[0] = get_output_path(conversion, opts->tilemapfile,
+				   opts->tilemapout, ".tilemap", &nb_names);
+	paths[1] = get_output_path(conversion, opts->attrmapfile,
+				   opts->attrmapout, ".attrmap", &nb_names);
+	paths[2] = get_output_path(conversion, opts->palfile, opts->palout,
+				   ".pal", &nb_names);
+
+	/* -f rewrites the input image, and -D writes a copy next to it */
+	if (opts->debug) {
+		png_path = malloc(strlen(opts->infile) + 5);
+		if (!png_path)
+			err(1, "%s: Failed to allocate memory for output file name",
+			    __func__);
+		strcpy(png_path, opts->infile);
+		strcat(png_path, ".out");
+		conversion->output_names[nb_names++] = png_path;
+		paths[3] = png_path;
+	} else {
+		paths[3] = opts->fix ? opts->infile : NULL;
+	}
+
+	for (i = 0; i < 4; i++) {
+		if (paths[i])
+			add_output(outputs, tile_outputs, conversion, paths[i],
+				   line_no);
+	}
+}
+
+/*
+ * Converts every image listed in the batch manifest. Images that share an
+ * output file share their tiles, and are converted in manifest order; other
+ * images are converted on up to `nb_threads` threads.
+ */
+static void run_batch(void)
+{
+	static HashMap last_of_group;
+	static HashMap outputs;
+	char *contents = read_manifest();
+	char *line = contents;
+	char *next_line;
+	unsigned int line_no = 0;
+	struct Conversion **groups = NULL;
+	size_t nb_groups = 0;
+	size_t groups_capacity = 0;
+	struct Conversion *conversion;
+	struct Conversion *last;
+	char **args = NULL;
+	int nb_args;
+	size_t args_capacity = 0;
+	char *token;
+
+	for (; line; line = next_line) {
+		next_line = strchr(line, '\n');
+		if (next_line)
+			*next_line++ = '\0';
+		line_no++;
+
+		/* Each line holds the arguments of one conversion */
+		nb_args = 1;
+		for (token = strtok(line, " \t\r"); token;
+		     token = strtok(NULL, " \t\r")) {
+			if (nb_args == 1 && token[0] == '#')
+				break;
+			/* Leave room for the program name and the terminator */
+			if (nb_args + 2 > args_capacity) {
+				args_capacity = args_capacity
+					? args_capacity * 2 : 16;
+				args = realloc(args,
+					       sizeof(*args) * args_capacity);
+				if (!args)
+					err(1, "%s: Failed to allocate memory for arguments",
+					    __func__);
+			}
+			args[nb_args++] = token;
+		}
+		if (nb_args == 1)
+			continue;
+		args[0] = "rgbgfx";
+		args[nb_args] = NULL;
+
+		conversion = calloc(1, sizeof(*conversion));
+		if (!conversion)
+			err(1, "%s: Failed to allocate memory for conversion",
+			    __func__);
+		parse_options(nb_args, args, &conversion->opts, true);
+		if (!conversion->opts.infile)
+			errx(1, "%s(%u): No input file", batchfile, line_no);
+		conversion->depth = depth;
+		add_outputs(outputs, last_of_group, conversion, line_no);
+
+		last = *conversion->opts.outfile
+			? hash_GetElement(last_of_group, conversion->opts.outfile)
+			: NULL;
+		if (last) {
+			if (conversion->depth != last->depth
+			 || conversion->opts.unique != last->opts.unique
+			 || conversion->opts.mirror != last->opts.mirror)
+				errx(1, "%s(%u): Images sharing output file '%s' must use the same -d, -m and -u options",
+				     batchfile, line_no,
+				     conversion->opts.outfile);
+			last->next = conversion;
+			hash_ReplaceElement(last_of_group,
+					    conversion->opts.outfile,
+					    conversion);
+			continue;
+		}
+
+		if (*conversion->opts.outfile)
+			hash_AddElement(last_of_group, conversion->opts.outfile,
+					conversion);
+		if (nb_groups == groups_capacity) {
+			groups_capacity = groups_capacity
+				? groups_capacity * 2 : 64;
+			groups = realloc(groups,
+					 sizeof(*groups) * groups_capacity);
+			if (!groups)
+				err(1, "%s: Failed to allocate memory for conversions",
+				    __func__);
+		}
+		groups[nb_groups++] = conversion;
+	}
+	free(args);
+	hash_EmptyMap(last_of_group);
+	hash_EmptyMap(outputs);
+
+	par_Run(nb_groups, nb_threads, convert_group, groups);
+
+	for (size_t i = 0; i < nb_groups; i++) {
+		for (conversion = groups[i]; conversion; conversion = last) {
+			last = conversion->next;
+			for (int j = 0; j < 4; j++)
+				free(conversion->output_names[j]);
+			free(conversion);
+		}
+	}
+	free(groups);
+	free(contents);
+}
+
+int main(int argc, char *argv[])
+{
+	struct Options opts = {0};
+
+	parse_options(argc, argv, &opts, false);
+
+	if (batchfile) {
+		if (opts.infile)
+			errx(1, "Input files cannot be given along with -b");
+		run_batch();
+		return 0;
+	}
+
+	if (!opts.infile) {
+		fputs("FATAL: no input files\n", stderr);
+		print_usage();
+	}
+
+	convert_image(&opts, NULL);
 
 	return 0;
 }
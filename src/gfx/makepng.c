@@ -13,18 +13,27 @@
 
 #include "gfx/makepng.h"
 
+/* `colors` is at most 4, since the depth is at most 2 */
+#define MAX_COLORS 4
+
 static void initialize_png(struct PNGImage *img, FILE * f);
-static struct RawIndexedImage *indexed_png_to_raw(struct PNGImage *img);
-static struct RawIndexedImage *grayscale_png_to_raw(struct PNGImage *img);
-static struct RawIndexedImage *truecolor_png_to_raw(struct PNGImage *img);
+static struct RawIndexedImage *indexed_png_to_raw(struct PNGImage *img,
+						  struct GBImage *gb);
+static struct RawIndexedImage *truecolor_png_to_raw(struct PNGImage *img,
+						    struct GBImage *gb);
 static void get_text(const struct PNGImage *img,
 		     struct ImageOptions *png_options);
 static void set_text(const struct PNGImage *img,
 		     const struct ImageOptions *png_options);
 static void free_png_data(const struct PNGImage *png);
 
+/*
+ * If `gb` is non-NULL, the image is packed into it row by row while being
+ * decoded, and the returned raw image has no pixel data.
+ */
 struct RawIndexedImage *input_png_file(const struct Options *opts,
-				       struct ImageOptions *png_options)
+				       struct ImageOptions *png_options,
+				       struct GBImage *gb)
 {
 	struct PNGImage img;
 	struct RawIndexedImage *raw_image;
@@ -36,6 +45,10 @@ struct RawIndexedImage *input_png_file(const struct Options *opts,
 
 	initialize_png(&img, f);
 
+	/* Interlaced images can only be decoded all at once */
+	if (png_get_interlace_type(img.png, img.info) != PNG_INTERLACE_NONE)
+		gb = NULL;
+
 	if (img.depth != depth) {
 		if (opts->verbose) {
 			warnx("Image bit depth is not %d (is %d).",
@@ -45,13 +58,12 @@ struct RawIndexedImage *input_png_file(const struct Options *opts,
 
 	switch (img.type) {
 	case PNG_COLOR_TYPE_PALETTE:
-		raw_image = indexed_png_to_raw(&img); break;
+		raw_image = indexed_png_to_raw(&img, gb); break;
 	case PNG_COLOR_TYPE_GRAY:
 	case PNG_COLOR_TYPE_GRAY_ALPHA:
-		raw_image = grayscale_png_to_raw(&img); break;
 	case PNG_COLOR_TYPE_RGB:
 	case PNG_COLOR_TYPE_RGB_ALPHA:
-		raw_image = truecolor_png_to_raw(&img); break;
+		raw_image = truecolor_png_to_raw(&img, gb); break;
 	default:
 		/* Shouldn't happen, but might as well handle just in case. */
 		errx(1, "Input PNG file is of invalid color type.");
@@ -145,10 +157,12 @@ void destroy_raw_image(struct RawIndexedImage **raw_image_ptr_ptr)
 	int y;
 	struct RawIndexedImage *raw_image = *raw_image_ptr_ptr;
 
-	for (y = 0; y < raw_image->height; y++)
-		free(raw_image->data[y]);
+	if (raw_image->data) {
+		for (y = 0; y < raw_image->height; y++)
+			free(raw_image->data[y]);
 
-	free(raw_image->data);
+		free(raw_image->data);
+	}
 	free(raw_image->palette);
 	free(raw_image);
 	*raw_image_ptr_ptr = NULL;
@@ -176,17 +190,143 @@ static void initialize_png(struct PNGImage *img, FILE *f)
 	img->height = png_get_image_height(img->png, img->info);
 	img->depth  = png_get_bit_depth(img->png, img->info);
 	img->type   = png_get_color_type(img->png, img->info);
+	img->data   = NULL;
 }
 
 static void read_png(struct PNGImage *img);
 static struct RawIndexedImage *create_raw_image(int width, int height,
-						int num_colors);
+						int num_colors, bool with_data);
 static void set_raw_image_palette(struct RawIndexedImage *raw_image,
 				  const png_color *palette, int num_colors);
 
-static struct RawIndexedImage *indexed_png_to_raw(struct PNGImage *img)
+/*
+ * Decodes the image's rows, and passes each of them to `process_row`.
+ * If `stream` is set, only one row is decoded at a time, instead of the whole
+ * image being decoded into `img->data`.
+ */
+static void read_rows(struct PNGImage *img, bool stream,
+		      void (*process_row)(const png_byte *pixels, int y,
+					  void *arg),
+		      void *arg)
+{
+	png_byte *pixels;
+	int y;
+
+	if (!stream) {
+		if (!img->data)
+			read_png(img);
+		for (y = 0; y < img->height; y++)
+			process_row(img->data[y], y, arg);
+		return;
+	}
+
+	png_read_update_info(img->png, img->info);
+
+	pixels = malloc(png_get_rowbytes(img->png, img->info));
+	if (!pixels)
+		err(1, "%s: Failed to allocate memory for image row",
+		    __func__);
+	for (y = 0; y < img->height; y++) {
+		png_read_row(img->png, pixels, NULL);
+		process_row(pixels, y, arg);
+	}
+	png_read_end(img->png, img->info);
+
+	free(pixels);
+}
+
+/* Packs a color into an integer, so that colors are compared at once */
+static uint32_t pack_color(png_byte red, png_byte green, png_byte blue)
 {
+	return (uint32_t)red << 16 | green << 8 | blue;
+}
+
+static uint8_t palette_index_of(const uint32_t *packed_palette,
+				int num_colors, uint32_t color);
+
+/* Converts decoded rows to indices into the raw image's palette */
+struct RowConverter {
 	struct RawIndexedImage *raw_image;
+	struct GBImage *gb; /* If non-NULL, rows are packed into it */
+	uint8_t *row; /* The converted row, if it's not kept in `raw_image` */
+	bool truecolor;
+	uint8_t index_map[256]; /* PLTE index to palette index */
+	uint32_t packed_palette[MAX_COLORS]; /* For truecolor images */
+	int num_colors;
+	uint32_t last_color;
+	uint8_t last_index;
+	bool has_last_color;
+};
+
+static void init_row_converter(struct RowConverter *converter,
+			       struct RawIndexedImage *raw_image,
+			       struct GBImage *gb, bool truecolor)
+{
+	converter->raw_image = raw_image;
+	converter->gb = gb;
+	converter->row = NULL;
+	converter->truecolor = truecolor;
+	converter->has_last_color = false;
+
+	if (gb) {
+		converter->row = malloc(raw_image->width);
+		if (!converter->row)
+			err(1, "%s: Failed to allocate memory for image row",
+			    __func__);
+
+		gb->size = raw_image->width * raw_image->height * depth / 8;
+		gb->data = calloc(gb->size, 1);
+		if (!gb->data)
+			err(1, "%s: Failed to allocate memory for tile data",
+			    __func__);
+	}
+}
+
+static void convert_row(const png_byte *pixels, int y, void *arg)
+{
+	struct RowConverter *converter = arg;
+	int width = converter->raw_image->width;
+	uint8_t *row = converter->gb ? converter->row
+				     : converter->raw_image->data[y];
+	uint32_t color;
+	int x;
+
+	if (!converter->truecolor) {
+		for (x = 0; x < width; x++)
+			row[x] = converter->index_map[pixels[x]];
+	} else {
+		for (x = 0; x < width; x++, pixels += 4) {
+			if (pixels[3] == 0) {
+				row[x] = 0;
+				continue;
+			}
+
+			/* Runs of the same color are common, skip the lookup */
+			color = pack_color(pixels[0], pixels[1], pixels[2]);
+			if (!converter->has_last_color
+			 || color != converter->last_color) {
+				converter->last_index =
+					palette_index_of(converter->packed_palette,
+							 converter->num_colors,
+							 color);
+				converter->last_color = color;
+				converter->has_last_color = true;
+			}
+			row[x] = converter->last_index;
+		}
+	}
+
+	/* Other widths are rejected once the image has been read */
+	if (converter->gb && width % 8 == 0)
+		raw_row_to_gb(row, y, width, converter->raw_image->height,
+			      converter->gb);
+}
+
+static struct RawIndexedImage *indexed_png_to_raw(struct PNGImage *img,
+						  struct GBImage *gb)
+{
+	struct RawIndexedImage *raw_image;
+	struct RowConverter converter;
 	png_color *palette;
 	int colors_in_PLTE;
 	int colors_in_new_palette;
@@ -194,15 +334,17 @@ static struct RawIndexedImage *indexed_png_to_raw(struct PNGImage *img)
 	int num_trans;
 	png_color_16 *trans_color;
 	png_color *original_palette;
-	uint8_t *old_to_new_palette;
-	int i, x, y;
+	int i;
 
 	if (img->depth < 8)
 		png_set_packing(img->png);
 
 	png_get_PLTE(img->png, img->info, &palette, &colors_in_PLTE);
 
-	raw_image = create_raw_image(img->width, img->height, colors);
+	raw_image = create_raw_image(img->width, img->height, colors, !gb);
+	init_row_converter(&converter, raw_image, gb, false);
+	for (i = 0; i < 256; i++)
+		converter.index_map[i] = i;
 
 	/*
 	 * Transparent palette entries are removed, and the palette is
@@ -218,35 +360,21 @@ static struct RawIndexedImage *indexed_png_to_raw(struct PNGImage *img)
 			err(1, "%s: Failed to allocate memory for palette",
 			    __func__);
 		colors_in_new_palette = 0;
-		old_to_new_palette = malloc(sizeof(*old_to_new_palette)
-					    * colors_in_PLTE);
-		if (!old_to_new_palette)
-			err(1, "%s: Failed to allocate memory for new palette",
-			    __func__);
 
 		for (i = 0; i < num_trans; i++) {
 			if (trans_alpha[i] == 0) {
-				old_to_new_palette[i] = 0;
+				converter.index_map[i] = 0;
 			} else {
-				old_to_new_palette[i] = colors_in_new_palette;
+				converter.index_map[i] = colors_in_new_palette;
 				palette[colors_in_new_palette++] =
 					original_palette[i];
 			}
 		}
 		for (i = num_trans; i < colors_in_PLTE; i++) {
-			old_to_new_palette[i] = colors_in_new_palette;
+			converter.index_map[i] = colors_in_new_palette;
 			palette[colors_in_new_palette++] = original_palette[i];
 		}
 
-		if (colors_in_new_palette != colors_in_PLTE) {
-			palette = realloc(palette,
-					  sizeof(*palette) *
-					  colors_in_new_palette);
-			if (!palette)
-				err(1, "%s: Failed to allocate memory for palette",
-				    __func__);
-		}
-
 		/*
 		 * Setting and validating palette before reading
 		 * allows us to error out *before* doing the data
@@ -254,51 +382,26 @@ static struct RawIndexedImage *indexed_png_to_raw(struct PNGImage *img)
 		 */
 		set_raw_image_palette(raw_image, palette,
 				      colors_in_new_palette);
-		read_png(img);
-
-		for (y = 0; y < img->height; y++) {
-			for (x = 0; x < img->width; x++) {
-				raw_image->data[y][x] =
-					old_to_new_palette[img->data[y][x]];
-			}
-		}
-
 		free(palette);
-		free(old_to_new_palette);
 	} else {
 		set_raw_image_palette(raw_image, palette, colors_in_PLTE);
-		read_png(img);
-
-		for (y = 0; y < img->height; y++) {
-			for (x = 0; x < img->width; x++)
-				raw_image->data[y][x] = img->data[y][x];
-		}
 	}
 
+	read_rows(img, gb != NULL, convert_row, &converter);
+	free(converter.row);
+
 	return raw_image;
 }
 
-static struct RawIndexedImage *grayscale_png_to_raw(struct PNGImage *img)
+/* Makes libpng output RGBA pixels, whatever the image's color type */
+static void set_rgba_transforms(struct PNGImage *img)
 {
-	if (img->depth < 8)
-		png_set_expand_gray_1_2_4_to_8(img->png);
-
-	png_set_gray_to_rgb(img->png);
-	return truecolor_png_to_raw(img);
-}
+	if (!(img->type & PNG_COLOR_MASK_COLOR)) {
+		if (img->depth < 8)
+			png_set_expand_gray_1_2_4_to_8(img->png);
 
-static void rgba_png_palette(struct PNGImage *img,
-			     png_color **palette_ptr_ptr, int *num_colors);
-static struct RawIndexedImage
-	*processed_rgba_png_to_raw(const struct PNGImage *img,
-				   const png_color *palette,
-				   int colors_in_palette);
-
-static struct RawIndexedImage *truecolor_png_to_raw(struct PNGImage *img)
-{
-	struct RawIndexedImage *raw_image;
-	png_color *palette;
-	int colors_in_palette;
+		png_set_gray_to_rgb(img->png);
+	}
 
 	if (img->depth == 16) {
 #if PNG_LIBPNG_VER >= 10504
@@ -314,29 +417,66 @@ static struct RawIndexedImage *truecolor_png_to_raw(struct PNGImage *img)
 		else
 			png_set_add_alpha(img->png, 0xFF, PNG_FILLER_AFTER);
 	}
-
-	read_png(img);
-
-	rgba_png_palette(img, &palette, &colors_in_palette);
-	raw_image = processed_rgba_png_to_raw(img, palette, colors_in_palette);
-
-	free(palette);
-
-	return raw_image;
 }
 
 static void rgba_PLTE_palette(struct PNGImage *img,
 			      png_color **palette_ptr_ptr, int *num_colors);
 static void rgba_build_palette(struct PNGImage *img,
-			       png_color **palette_ptr_ptr, int *num_colors);
+			       png_color **palette_ptr_ptr, int *num_colors,
+			       uint8_t **indices_ptr);
 
-static void rgba_png_palette(struct PNGImage *img,
-			     png_color **palette_ptr_ptr, int *num_colors)
+static struct RawIndexedImage *truecolor_png_to_raw(struct PNGImage *img,
+						    struct GBImage *gb)
 {
+	struct RawIndexedImage *raw_image;
+	struct RowConverter converter;
+	png_color *palette;
+	int colors_in_palette;
+	uint8_t *indices = NULL;
+	int i, y;
+
+	set_rgba_transforms(img);
+
+	/*
+	 * Without a PLTE, every pixel must be seen before the palette is known.
+	 * When streaming, the rows can't be decoded a second time (the input
+	 * may be a pipe), so their pixels' palette indices are kept instead.
+	 */
 	if (png_get_valid(img->png, img->info, PNG_INFO_PLTE))
-		rgba_PLTE_palette(img, palette_ptr_ptr, num_colors);
+		rgba_PLTE_palette(img, &palette, &colors_in_palette);
 	else
-		rgba_build_palette(img, palette_ptr_ptr, num_colors);
+		rgba_build_palette(img, &palette, &colors_in_palette,
+				   gb ? &indices : NULL);
+
+	raw_image = create_raw_image(img->width, img->height, colors, !gb);
+	init_row_converter(&converter, raw_image, gb, !indices);
+
+	if (indices) {
+		set_raw_image_palette(raw_image, palette, colors_in_palette);
+		for (i = 0; i < 256; i++)
+			converter.index_map[i] = i;
+		for (y = 0; y < img->height; y++)
+			convert_row(&indices[y * img->width], y, &converter);
+		free(converter.row);
+		free(indices);
+		free(palette);
+		return raw_image;
+	}
+
+	/* This guarantees that `packed_palette` is large enough */
+	set_raw_image_palette(raw_image, palette, colors_in_palette);
+	for (i = 0; i < colors_in_palette; i++)
+		converter.packed_palette[i] = pack_color(palette[i].red,
+							 palette[i].green,
+							 palette[i].blue);
+	converter.num_colors = colors_in_palette;
+
+	read_rows(img, gb != NULL, convert_row, &converter);
+	free(converter.row);
+
+	free(palette);
+
+	return raw_image;
 }
 
 static void rgba_PLTE_palette(struct PNGImage *img,
@@ -351,90 +491,154 @@ static void rgba_PLTE_palette(struct PNGImage *img,
 		       PNG_USER_WILL_FREE_DATA, PNG_FREE_PLTE);
 }
 
-static void update_built_palette(png_color *palette,
-				 const png_color *pixel_color, png_byte alpha,
-				 int *num_colors, bool *only_grayscale);
+/* Marks transparent pixels in a `PaletteBuilder`'s indices */
+#define TRANSPARENT_INDEX MAX_COLORS
+
+struct PaletteBuilder {
+	png_color *palette;
+	uint32_t packed_palette[MAX_COLORS];
+	int num_colors;
+	int width;
+	uint8_t *indices; /* If non-NULL, each pixel's index in `palette` */
+	uint32_t last_color;
+	uint8_t last_index;
+	bool has_last_color;
+	bool only_grayscale;
+};
+
+static void add_row_to_palette(const png_byte *pixels, int y, void *arg);
 static int fit_grayscale_palette(png_color *palette, int *num_colors);
 static void order_color_palette(png_color *palette, int num_colors);
 
+/*
+ * If `indices_ptr` is non-NULL, the image is decoded one row at a time, and
+ * each pixel's index in the returned palette is stored in a buffer instead.
+ */
 static void rgba_build_palette(struct PNGImage *img,
-			       png_color **palette_ptr_ptr, int *num_colors)
+			       png_color **palette_ptr_ptr, int *num_colors,
+			       uint8_t **indices_ptr)
 {
-	png_color *palette;
-	int y, value_index;
-	png_color cur_pixel_color;
-	png_byte cur_alpha;
-	bool only_grayscale = true;
+	struct PaletteBuilder builder;
+	uint8_t index_map[MAX_COLORS + 1];
+	uint32_t packed_palette[MAX_COLORS];
+	size_t nb_pixels = (size_t)img->width * img->height;
+	size_t i;
 
 	/*
 	 * By filling the palette up with black by default, if the image
 	 * doesn't have enough colors, the palette gets padded with black.
 	 */
-	*palette_ptr_ptr = calloc(colors, sizeof(**palette_ptr_ptr));
-	if (!*palette_ptr_ptr)
+	builder.palette = calloc(colors, sizeof(*builder.palette));
+	if (!builder.palette)
 		err(1, "%s: Failed to allocate memory for palette", __func__);
-	palette = *palette_ptr_ptr;
-	*num_colors = 0;
-
-	for (y = 0; y < img->height; y++) {
-		value_index = 0;
-		while (value_index < img->width * 4) {
-			cur_pixel_color.red   = img->data[y][value_index++];
-			cur_pixel_color.green = img->data[y][value_index++];
-			cur_pixel_color.blue  = img->data[y][value_index++];
-			cur_alpha = img->data[y][value_index++];
-
-			update_built_palette(palette, &cur_pixel_color,
-					     cur_alpha,
-					     num_colors, &only_grayscale);
-		}
+	builder.num_colors = 0;
+	builder.width = img->width;
+	builder.indices = NULL;
+	builder.has_last_color = false;
+	builder.only_grayscale = true;
+
+	if (indices_ptr) {
+		builder.indices = malloc(nb_pixels);
+		if (!builder.indices)
+			err(1, "%s: Failed to allocate memory for indices",
+			    __func__);
 	}
 
+	read_rows(img, indices_ptr != NULL, add_row_to_palette, &builder);
+
+	*palette_ptr_ptr = builder.palette;
+	*num_colors = builder.num_colors;
+
 	/* In order not to count 100% transparent images as grayscale. */
-	only_grayscale = *num_colors ? only_grayscale : false;
+	if (!*num_colors)
+		builder.only_grayscale = false;
+
+	if (!builder.only_grayscale
+	 || !fit_grayscale_palette(*palette_ptr_ptr, num_colors))
+		order_color_palette(*palette_ptr_ptr, *num_colors);
+
+	if (!indices_ptr)
+		return;
 
-	if (!only_grayscale || !fit_grayscale_palette(palette, num_colors))
-		order_color_palette(palette, *num_colors);
+	/* Now that the palette is final, remap the colors' indices to it */
+	for (i = 0; i < (size_t)*num_colors; i++)
+		packed_palette[i] = pack_color((*palette_ptr_ptr)[i].red,
+					       (*palette_ptr_ptr)[i].green,
+					       (*palette_ptr_ptr)[i].blue);
+	for (i = 0; i < (size_t)builder.num_colors; i++)
+		index_map[i] = palette_index_of(packed_palette, *num_colors,
+						builder.packed_palette[i]);
+	index_map[TRANSPARENT_INDEX] = 0;
+	for (i = 0; i < nb_pixels; i++)
+		builder.indices[i] = index_map[builder.indices[i]];
+
+	*indices_ptr = builder.indices;
 }
 
-static void update_built_palette(png_color *palette,
-				 const png_color *pixel_color, png_byte alpha,
-				 int *num_colors, bool *only_grayscale)
+static uint8_t update_built_palette(struct PaletteBuilder *builder,
+				    uint32_t color);
+
+static void add_row_to_palette(const png_byte *pixels, int y, void *arg)
 {
-	bool color_exists;
-	png_color cur_palette_color;
-	int i;
+	struct PaletteBuilder *builder = arg;
+	uint8_t *indices = builder->indices
+			 ? &builder->indices[(size_t)y * builder->width] : NULL;
+	uint32_t color;
+	int x;
 
-	/*
-	 * Transparent pixels don't count toward the palette,
-	 * as they'll be replaced with color #0 later.
-	 */
-	if (alpha == 0)
-		return;
+	for (x = 0; x < builder->width; x++, pixels += 4) {
+		/*
+		 * Transparent pixels don't count toward the palette,
+		 * as they'll be replaced with color #0 later.
+		 */
+		if (pixels[3] == 0) {
+			if (indices)
+				indices[x] = TRANSPARENT_INDEX;
+			continue;
+		}
 
-	if (*only_grayscale && !(pixel_color->red == pixel_color->green &&
-				 pixel_color->red == pixel_color->blue)) {
-		*only_grayscale = false;
+		/* Runs of the same color are common, skip them */
+		color = pack_color(pixels[0], pixels[1], pixels[2]);
+		if (!builder->has_last_color || color != builder->last_color) {
+			builder->last_index =
+				update_built_palette(builder, color);
+			builder->last_color = color;
+			builder->has_last_color = true;
+		}
+		if (indices)
+			indices[x] = builder->last_index;
 	}
+}
 
-	color_exists = false;
-	for (i = 0; i < *num_colors; i++) {
-		cur_palette_color = palette[i];
-		if (pixel_color->red   == cur_palette_color.red   &&
-		    pixel_color->green == cur_palette_color.green &&
-		    pixel_color->blue  == cur_palette_color.blue) {
-			color_exists = true;
-			break;
-		}
+/* @return The color's index in the built palette */
+static uint8_t update_built_palette(struct PaletteBuilder *builder,
+				    uint32_t color)
+{
+	png_color *new_color;
+	int i;
+
+	for (i = 0; i < builder->num_colors; i++) {
+		if (builder->packed_palette[i] == color)
+			return i;
 	}
-	if (!color_exists) {
-		if (*num_colors == colors) {
-			errx(1, "Too many colors in input PNG file to fit into a %d-bit palette (max %d).",
-			     depth, colors);
-		}
-		palette[*num_colors] = *pixel_color;
-		(*num_colors)++;
+
+	if (builder->num_colors == colors) {
+		errx(1, "Too many colors in input PNG file to fit into a %d-bit palette (max %d).",
+		     depth, colors);
 	}
+	new_color = &builder->palette[builder->num_colors];
+	new_color->red   = color >> 16;
+	new_color->green = color >> 8;
+	new_color->blue  = color;
+	builder->packed_palette[builder->num_colors] = color;
+	builder->num_colors++;
+
+	/* Colors already in the palette have been checked when added */
+	if (builder->only_grayscale && !(new_color->red == new_color->green &&
+					 new_color->red == new_color->blue)) {
+		builder->only_grayscale = false;
+	}
+	return builder->num_colors - 1;
 }
 
 static int fit_grayscale_palette(png_color *palette, int *num_colors)
@@ -528,77 +732,14 @@ static void order_color_palette(png_color *palette, int num_colors)
 	free(palette_with_luminance);
 }
 
-static void put_raw_image_pixel(struct RawIndexedImage *raw_image,
-				const struct PNGImage *img,
-				int *value_index, int x, int y,
-				const png_color *palette,
-				int colors_in_palette);
-
-static struct RawIndexedImage
-	*processed_rgba_png_to_raw(const struct PNGImage *img,
-				   const png_color *palette,
-				   int colors_in_palette)
-{
-	struct RawIndexedImage *raw_image;
-	int x, y, value_index;
-
-	raw_image = create_raw_image(img->width, img->height, colors);
-
-	set_raw_image_palette(raw_image, palette, colors_in_palette);
-
-	for (y = 0; y < img->height; y++) {
-		x = raw_image->width - 1;
-		value_index = img->width * 4 - 1;
-
-		while (x >= 0) {
-			put_raw_image_pixel(raw_image, img,
-					    &value_index, x, y,
-					    palette, colors_in_palette);
-			x--;
-		}
-	}
-
-	return raw_image;
-}
-
-static uint8_t palette_index_of(const png_color *palette,
-				int num_colors, const png_color *color);
-
-static void put_raw_image_pixel(struct RawIndexedImage *raw_image,
-				const struct PNGImage *img,
-				int *value_index, int x, int y,
-				const png_color *palette,
-				int colors_in_palette)
-{
-	png_color pixel_color;
-	png_byte alpha;
-
-	alpha = img->data[y][*value_index];
-	if (alpha == 0) {
-		raw_image->data[y][x] = 0;
-		*value_index -= 4;
-	} else {
-		(*value_index)--;
-		pixel_color.blue  = img->data[y][(*value_index)--];
-		pixel_color.green = img->data[y][(*value_index)--];
-		pixel_color.red   = img->data[y][(*value_index)--];
-		raw_image->data[y][x] = palette_index_of(palette,
-							 colors_in_palette,
-							 &pixel_color);
-	}
-}
-
-static uint8_t palette_index_of(const png_color *palette,
-				int num_colors, const png_color *color)
+static uint8_t palette_index_of(const uint32_t *packed_palette,
+				int num_colors, uint32_t color)
 {
 	uint8_t i;
 
 	for (i = 0; i < num_colors; i++) {
-		if (palette[i].red   == color->red   &&
-		    palette[i].green == color->green &&
-		    palette[i].blue  == color->blue) {
+		if (packed_palette[i] == color)
 			return i;
-		}
 	}
 	errx(1, "The input PNG file contains colors that don't appear in its embedded palette.");
 }
@@ -625,7 +766,7 @@ static void read_png(struct PNGImage *img)
 }
 
 static struct RawIndexedImage *create_raw_image(int width, int height,
-						int num_colors)
+						int num_colors, bool with_data)
 {
 	struct RawIndexedImage *raw_image;
 	int y;
@@ -644,6 +785,10 @@ static struct RawIndexedImage *create_raw_image(int width, int height,
 		err(1, "%s: Failed to allocate memory for raw image palette",
 		    __func__);
 
+	raw_image->data = NULL;
+	if (!with_data)
+		return raw_image;
+
 	raw_image->data = malloc(sizeof(*raw_image->data) * height);
 	if (!raw_image->data)
 		err(1, "%s: Failed to allocate memory for raw image data",
@@ -800,6 +945,9 @@ static void free_png_data(const struct PNGImage *img)
 {
 	int y;
 
+	if (!img->data)
+		return;
+
 	for (y = 0; y < img->height; y++)
 		free(img->data[y]);
 
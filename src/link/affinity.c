@@ -0,0 +1,199 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2021, RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "link/affinity.h"
+#include "link/main.h"
+
+#include "extern/err.h"
+
+struct AffinityEntry {
+	struct Affinity affinity;
+	size_t index; /* To keep the file's order between equal counts */
+};
+
+static struct AffinityEntry *entries;
+static struct Affinity *affinities;
+static size_t nbAffinities;
+
+static char const *profileName;
+static uint32_t lineNo;
+
+static inline bool isBlank(int c)
+{
+	/* CR is ignored, so that CRLF newlines work */
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static int readChar(FILE *file)
+{
+	int c = getc(file);
+
+	if (c == EOF && ferror(file))
+		err(1, "%s(%" PRIu32 "): Failed to read the affinity profile",
+		    profileName, lineNo);
+	return c;
+}
+
+static int skipBlanks(FILE *file)
+{
+	int c;
+
+	do
+		c = readChar(file);
+	while (isBlank(c));
+
+	/* Comments last until the end of the line */
+	if (c == ';') {
+		do
+			c = readChar(file);
+		while (c != '\n' && c != EOF);
+	}
+	return c;
+}
+
+/**
+ * Reads a section name, whose opening quote has already been read.
+ */
+static char *readName(FILE *file)
+{
+	size_t capacity = 32;
+	size_t len = 0;
+	char *name = malloc(capacity);
+
+	if (!name)
+		err(1, "Failed to read the affinity profile");
+
+	for (;;) {
+		int c = readChar(file);
+
+		if (c == EOF || c == '\n')
+			errx(1, "%s(%" PRIu32 "): Unterminated section name", profileName, lineNo);
+		if (len == capacity) {
+			capacity *= 2;
+			name = realloc(name, capacity);
+			if (!name)
+				err(1, "Failed to read the affinity profile");
+		}
+		if (c == '"')
+			c = '\0';
+		name[len++] = c;
+		if (!c)
+			return name;
+	}
+}
+
+/**
+ * Reads a line of the profile, adding the affinity it describes if any.
+ * @return False if the end of the file was reached
+ */
+static bool readLine(FILE *file)
+{
+	int c = skipBlanks(file);
+
+	if (c == EOF)
+		return false;
+	if (c == '\n')
+		return true;
+
+	struct Affinity affinity = { .count = 0 };
+
+	for (uint8_t i = 0; i < 2; i++) {
+		if (i != 0)
+			c = skipBlanks(file);
+		if (c != '"')
+			errx(1, "%s(%" PRIu32 "): Expected a section name", profileName, lineNo);
+		affinity.names[i] = readName(file);
+	}
+
+	c = skipBlanks(file);
+	if (c < '0' || c > '9')
+		errx(1, "%s(%" PRIu32 "): Expected a count", profileName, lineNo);
+	do {
+		if (affinity.count > (UINT64_MAX - (c - '0')) / 10)
+			errx(1, "%s(%" PRIu32 "): Count is too large", profileName, lineNo);
+		affinity.count = affinity.count * 10 + c - '0';
+		c = readChar(file);
+	} while (c >= '0' && c <= '9');
+
+	if (isBlank(c) || c == ';') {
+		ungetc(c, file);
+		c = skipBlanks(file);
+	}
+	if (c != '\n' && c != EOF)
+		errx(1, "%s(%" PRIu32 "): Expected the end of the line", profileName, lineNo);
+
+	/* A section paired with itself is always in its own bank */
+	if (strcmp(affinity.names[0], affinity.names[1]) && affinity.count) {
+		entries = realloc(entries, sizeof(*entries) * (nbAffinities + 1));
+		if (!entries)
+			err(1, "Failed to read the affinity profile");
+		entries[nbAffinities].affinity = affinity;
+		entries[nbAffinities].index = nbAffinities;
+		nbAffinities++;
+	} else {
+		free(affinity.names[0]);
+		free(affinity.names[1]);
+	}
+	return c != EOF;
+}
+
+static int compareEntries(void const *a, void const *b)
+{
+	struct AffinityEntry const *entry1 = a;
+	struct AffinityEntry const *entry2 = b;
+
+	if (entry1->affinity.count != entry2->affinity.count)
+		return entry1->affinity.count > entry2->affinity.count ? -1 : 1;
+	return entry1->index < entry2->index ? -1 : entry1->index > entry2->index;
+}
+
+void aff_Read(char const *fileName)
+{
+	FILE *file = openFile(fileName, "r");
+
+	profileName = fileName;
+	for (lineNo = 1; readLine(file); lineNo++)
+		;
+	closeFile(file);
+
+	qsort(entries, nbAffinities, sizeof(*entries), compareEntries);
+	affinities = malloc(sizeof(*affinities) * nbAffinities + 1);
+	if (!affinities)
+		err(1, "Failed to read the affinity profile");
+	for (size_t i = 0; i < nbAffinities; i++)
+		affinities[i] = entries[i].affinity;
+	free(entries);
+	entries = NULL;
+
+	verbosePrint("Read %zu affinities from \"%s\"\n", nbAffinities, fileName);
+}
+
+struct Affinity const *aff_GetAffinities(size_t *nb)
+{
+	*nb = nbAffinities;
+	return affinities;
+}
+
+void aff_Cleanup(void)
+{
+	for (size_t i = 0; i < nbAffinities; i++) {
+		free(affinities[i].names[0]);
+		free(affinities[i].names[1]);
+	}
+	free(affinities);
+	affinities = NULL;
+	nbAffinities = 0;
+}
@@ -18,9 +18,13 @@
 #include "link/main.h"
 #include "link/script.h"
 #include "link/output.h"
+#include "link/state.h"
+#include "link/affinity.h"
 
 #include "extern/err.h"
+#include "hashmap.h"
 #include "helpers.h"
+#include "parallel.h"
 
 struct MemoryLocation {
 	uint16_t address;
@@ -38,28 +42,59 @@ struct FreeSpace *memory[SECTTYPE_INVALID];
 
 uint64_t nbSectionsToAssign;
 
+/* What happened when placing each region */
+static struct {
+	uint32_t nbPlacedAsBefore;
+	uint32_t nbClustered; /* Placed in the same bank as sections they have affinity with */
+	struct Section const *unplacedSection; /* The first that could not be placed */
+	/* Added to the output by the main thread, in this order, once all regions are placed */
+	struct Section **placed;
+	uint32_t nbPlaced;
+	uint32_t placedCapacity;
+} regions[SECTTYPE_INVALID];
+
 /**
- * Init the free space-modelling structs
+ * Init the free space-modelling structs of a region
+ * @param type The region's section type
  */
-static void initFreeSpace(void)
+static void initFreeSpace(enum SectionType type)
 {
-	for (enum SectionType type = 0; type < SECTTYPE_INVALID; type++) {
-		memory[type] = malloc(sizeof(*memory[type]) * nbbanks(type));
-		if (!memory[type])
-			err(1, "Failed to init free space for region %d", type);
-
-		for (uint32_t bank = 0; bank < nbbanks(type); bank++) {
-			memory[type][bank].next =
-				malloc(sizeof(*memory[type][0].next));
-			if (!memory[type][bank].next)
-				err(1, "Failed to init free space for region %d bank %" PRIu32,
-				    type, bank);
-			memory[type][bank].next->address = startaddr[type];
-			memory[type][bank].next->size    = maxsize[type];
-			memory[type][bank].next->next    = NULL;
-			memory[type][bank].next->prev    = &memory[type][bank];
+	memory[type] = malloc(sizeof(*memory[type]) * nbbanks(type));
+	if (!memory[type])
+		err(1, "Failed to init free space for region %d", type);
+
+	for (uint32_t bank = 0; bank < nbbanks(type); bank++) {
+		memory[type][bank].next =
+			malloc(sizeof(*memory[type][0].next));
+		if (!memory[type][bank].next)
+			err(1, "Failed to init free space for region %d bank %" PRIu32,
+			    type, bank);
+		memory[type][bank].next->address = startaddr[type];
+		memory[type][bank].next->size    = maxsize[type];
+		memory[type][bank].next->next    = NULL;
+		memory[type][bank].next->prev    = &memory[type][bank];
+	}
+}
+
+/**
+ * Frees the free space-modelling structs of a region
+ * @param type The region's section type
+ */
+static void freeFreeSpace(enum SectionType type)
+{
+	for (uint32_t bank = 0; bank < nbbanks(type); bank++) {
+		struct FreeSpace *ptr =
+			memory[type][bank].next;
+
+		while (ptr) {
+			struct FreeSpace *next = ptr->next;
+
+			free(ptr);
+			ptr = next;
 		}
 	}
+
+	free(memory[type]);
 }
 
 /**
@@ -112,9 +147,29 @@ static inline void assignSection(struct Section *section,
 	section->org = location->address;
 	section->bank = location->bank;
 
-	nbSectionsToAssign--;
+	/* PC-relative patches in fragments and unions are relative to their own part */
+	for (struct Section *part = section->nextu; part; part = part->nextu) {
+		part->org = section->org + part->offset;
+		part->bank = section->bank;
+	}
 
-	out_AddSection(section);
+	/* Sections folded into this one are placed with it */
+	for (struct Section *folded = section->folded; folded; folded = folded->folded) {
+		folded->org = section->org;
+		folded->bank = section->bank;
+	}
+
+	/* The output isn't thread-safe, so leave adding to it to the main thread */
+	enum SectionType type = section->type;
+
+	if (regions[type].nbPlaced == regions[type].placedCapacity) {
+		regions[type].placedCapacity = regions[type].placedCapacity * 2 + 16;
+		regions[type].placed = realloc(regions[type].placed,
+			sizeof(*regions[type].placed) * regions[type].placedCapacity);
+		if (!regions[type].placed)
+			err(1, "Failed to allocate memory for section assignment");
+	}
+	regions[type].placed[regions[type].nbPlaced++] = section;
 }
 
 /**
@@ -222,12 +277,62 @@ static struct FreeSpace *getPlacement(struct Section const *section,
 }
 
 /**
- * Places a section in a suitable location, or error out if it fails to.
+ * Removes the space a section was just assigned from the free space it's in.
+ * @param freeSpace The free space the section was placed in
+ * @param section The section that was placed
+ */
+static void allocateSpace(struct FreeSpace *freeSpace, struct Section const *section)
+{
+	bool noLeftSpace  = freeSpace->address == section->org;
+	bool noRightSpace = freeSpace->address + freeSpace->size
+				== section->org + section->size;
+	if (noLeftSpace && noRightSpace) {
+		/* The free space is entirely deleted */
+		freeSpace->prev->next = freeSpace->next;
+		if (freeSpace->next)
+			freeSpace->next->prev = freeSpace->prev;
+		/*
+		 * If the space is the last one on the list, set its
+		 * size to 0 so it doesn't get picked, but don't free()
+		 * it as it will be freed when cleaning up
+		 */
+		free(freeSpace);
+	} else if (!noLeftSpace && !noRightSpace) {
+		/* The free space is split in two */
+		struct FreeSpace *newSpace = malloc(sizeof(*newSpace));
+
+		if (!newSpace)
+			err(1, "Failed to split new free space");
+		/* Append the new space after the chosen one */
+		newSpace->prev = freeSpace;
+		newSpace->next = freeSpace->next;
+		if (freeSpace->next)
+			freeSpace->next->prev = newSpace;
+		freeSpace->next = newSpace;
+		/* Set its parameters */
+		newSpace->address = section->org + section->size;
+		newSpace->size = freeSpace->address + freeSpace->size -
+			newSpace->address;
+		/* Set the original space's new parameters */
+		freeSpace->size = section->org - freeSpace->address;
+		/* address is unmodified */
+	} else {
+		/* The amount of free spaces doesn't change: resize! */
+		freeSpace->size -= section->size;
+		if (noLeftSpace)
+			/* The free space is moved *and* resized */
+			freeSpace->address += section->size;
+	}
+}
+
+/**
+ * Places a section in a suitable location.
  * @warning Due to the implemented algorithm, this should be called with
  *          sections of decreasing size.
  * @param section The section to place
+ * @return False if the section could not be placed
  */
-static void placeSection(struct Section *section)
+static bool placeSection(struct Section *section)
 {
 	struct MemoryLocation location;
 
@@ -244,7 +349,7 @@ static void placeSection(struct Section *section)
 						? section->bank
 						: bankranges[section->type][0];
 		assignSection(section, &location);
-		return;
+		return true;
 	}
 
 	/*
@@ -255,51 +360,18 @@ static void placeSection(struct Section *section)
 
 	if (freeSpace) {
 		assignSection(section, &location);
-
-		/* Split the free space */
-		bool noLeftSpace  = freeSpace->address == section->org;
-		bool noRightSpace = freeSpace->address + freeSpace->size
-					== section->org + section->size;
-		if (noLeftSpace && noRightSpace) {
-			/* The free space is entirely deleted */
-			freeSpace->prev->next = freeSpace->next;
-			if (freeSpace->next)
-				freeSpace->next->prev = freeSpace->prev;
-			/*
-			 * If the space is the last one on the list, set its
-			 * size to 0 so it doesn't get picked, but don't free()
-			 * it as it will be freed when cleaning up
-			 */
-			free(freeSpace);
-		} else if (!noLeftSpace && !noRightSpace) {
-			/* The free space is split in two */
-			struct FreeSpace *newSpace = malloc(sizeof(*newSpace));
-
-			if (!newSpace)
-				err(1, "Failed to split new free space");
-			/* Append the new space after the chosen one */
-			newSpace->prev = freeSpace;
-			newSpace->next = freeSpace->next;
-			if (freeSpace->next)
-				freeSpace->next->prev = newSpace;
-			freeSpace->next = newSpace;
-			/* Set its parameters */
-			newSpace->address = section->org + section->size;
-			newSpace->size = freeSpace->address + freeSpace->size -
-				newSpace->address;
-			/* Set the original space's new parameters */
-			freeSpace->size = section->org - freeSpace->address;
-			/* address is unmodified */
-		} else {
-			/* The amount of free spaces doesn't change: resize! */
-			freeSpace->size -= section->size;
-			if (noLeftSpace)
-				/* The free space is moved *and* resized */
-				freeSpace->address += section->size;
-		}
-		return;
+		allocateSpace(freeSpace, section);
+		return true;
 	}
+	return false;
+}
 
+/**
+ * Reports that a section could not be placed, and why if possible.
+ * @param section The section that could not be placed
+ */
+static _Noreturn void reportUnplacedSection(struct Section const *section)
+{
 	/* Please adjust depending on longest message below */
 	char where[64];
 
@@ -341,6 +413,34 @@ static void placeSection(struct Section *section)
 		     out_OverlappingSection(section)->name);
 }
 
+/**
+ * Places a section where the previous link placed it, if it still fits there.
+ * @param section The section to place
+ * @return True if the section was placed
+ */
+static bool placeSectionAsBefore(struct Section *section)
+{
+	struct MemoryLocation location;
+
+	if (!state_GetPlacement(section, &location.bank, &location.address)
+	 || (section->isBankFixed && section->bank != location.bank)
+	 || location.bank < bankranges[section->type][0]
+	 || location.bank > bankranges[section->type][1])
+		return false;
+
+	uint32_t bankIndex = location.bank - bankranges[section->type][0];
+
+	for (struct FreeSpace *space = memory[section->type][bankIndex].next; space;
+	     space = space->next) {
+		if (isLocationSuitable(section, space, &location)) {
+			assignSection(section, &location);
+			allocateSpace(space, section);
+			return true;
+		}
+	}
+	return false;
+}
+
 struct UnassignedSection {
 	struct Section *section;
 	struct UnassignedSection *next;
@@ -349,18 +449,34 @@ struct UnassignedSection {
 #define  BANK_CONSTRAINED (1 << 2)
 #define   ORG_CONSTRAINED (1 << 1)
 #define ALIGN_CONSTRAINED (1 << 0)
-static struct UnassignedSection *unassignedSections[1 << 3] = {0};
+/* Each region is placed on its own, since its sections can't overlap the others' */
+static struct UnassignedSection *unassignedSections[SECTTYPE_INVALID][1 << 3];
+/* Sections that the previous link placed, to be placed there again if possible */
+static struct UnassignedSection *placedSections[SECTTYPE_INVALID];
 static struct UnassignedSection *sections;
+static uint64_t nbUnfixedSections;
 
 /**
- * Categorize a section depending on how constrained it is
- * This is so the most-constrained sections are placed first
+ * Inserts a section in a list, keeping it sorted by decreasing size
+ * @param ptr The list to insert into
+ * @param section The list element of the section to insert
+ */
+static void insertSection(struct UnassignedSection **ptr, struct UnassignedSection *section)
+{
+	while (*ptr && (*ptr)->section->size > section->section->size)
+		ptr = &(*ptr)->next;
+
+	section->next = *ptr;
+	*ptr = section;
+}
+
+/**
+ * Gets how constrained a section is
  * @param section The section to categorize
- * @param arg Callback arg, unused
+ * @return A combination of the `_CONSTRAINED` flags
  */
-static void categorizeSection(struct Section *section, void *arg)
+static uint8_t getConstraints(struct Section const *section)
 {
-	(void)arg;
 	uint8_t constraints = 0;
 
 	if (section->isBankFixed)
@@ -371,17 +487,297 @@ static void categorizeSection(struct Section *section, void *arg)
 	else if (section->isAlignFixed)
 		constraints |= ALIGN_CONSTRAINED;
 
-	struct UnassignedSection **ptr = &unassignedSections[constraints];
+	return constraints;
+}
 
-	/* Insert section while keeping the list sorted by decreasing size */
-	while (*ptr && (*ptr)->section->size > section->size)
-		ptr = &(*ptr)->next;
+/**
+ * Categorize a section depending on how constrained it is
+ * This is so the most-constrained sections are placed first
+ * @param section The section to categorize
+ * @param arg Callback arg, unused
+ */
+static void categorizeSection(struct Section *section, void *arg)
+{
+	(void)arg;
+	uint8_t constraints = getConstraints(section);
+	uint32_t bank;
+	uint16_t org;
+	/* Fully-constrained and empty sections can only be placed one way anyway */
+	bool wasPlaced = constraints != (BANK_CONSTRAINED | ORG_CONSTRAINED)
+		&& section->size != 0 && state_GetPlacement(section, &bank, &org);
 
 	sections[nbSectionsToAssign].section = section;
-	sections[nbSectionsToAssign].next = *ptr;
-	*ptr = &sections[nbSectionsToAssign];
+	insertSection(wasPlaced ? &placedSections[section->type]
+				: &unassignedSections[section->type][constraints],
+		      &sections[nbSectionsToAssign]);
 
 	nbSectionsToAssign++;
+	if (constraints != (BANK_CONSTRAINED | ORG_CONSTRAINED))
+		nbUnfixedSections++;
+}
+
+/**
+ * Places a list of sections, stopping at the first that can't be placed.
+ * @param list The sections to place
+ * @param type The region they are in
+ * @return False if a section could not be placed
+ */
+static bool placeSections(struct UnassignedSection const *list, enum SectionType type)
+{
+	for (; list; list = list->next) {
+		if (!placeSection(list->section)) {
+			regions[type].unplacedSection = list->section;
+			return false;
+		}
+	}
+	return true;
+}
+
+/* A section that may be placed in the same bank as those it has affinity with */
+struct ClusterNode {
+	struct UnassignedSection *node;
+	struct ClusterNode *parent; /* NULL for the root of a cluster */
+	/* Only meaningful for roots */
+	uint32_t size;
+	size_t rank; /* The index of the highest affinity within the cluster */
+	struct UnassignedSection *members;
+};
+
+/* Only used by the thread placing ROMX sections */
+static HashMap clusterNodes;
+
+static struct ClusterNode *getRoot(struct ClusterNode *node)
+{
+	while (node->parent)
+		node = node->parent;
+	return node;
+}
+
+static int compareClusters(void const *a, void const *b)
+{
+	struct ClusterNode const *root1 = *(struct ClusterNode * const *)a;
+	struct ClusterNode const *root2 = *(struct ClusterNode * const *)b;
+
+	return root1->rank < root2->rank ? -1 : root1->rank > root2->rank;
+}
+
+/**
+ * Gets how many bytes are free in a bank, regardless of fragmentation.
+ */
+static uint32_t getFreeSize(enum SectionType type, uint32_t bank)
+{
+	uint32_t size = 0;
+
+	for (struct FreeSpace const *space = memory[type][bank].next; space; space = space->next)
+		size += space->size;
+	return size;
+}
+
+/**
+ * Places floating sections that are used together in the same bank, following
+ * the affinity profile. Sections that can't be are left in the lists.
+ * @param lists The region's lists of sections to place, by constraints
+ * @param type The region's section type
+ */
+static void placeClusters(struct UnassignedSection **lists, enum SectionType type)
+{
+	size_t nbAffinities;
+	struct Affinity const *affinities = aff_GetAffinities(&nbAffinities);
+	size_t nbNodes = 0;
+
+	for (int8_t constraints = ORG_CONSTRAINED | ALIGN_CONSTRAINED; constraints >= 0;
+	     constraints--) {
+		for (struct UnassignedSection *ptr = lists[constraints]; ptr; ptr = ptr->next)
+			nbNodes++;
+	}
+
+	struct ClusterNode *nodes = malloc(sizeof(*nodes) * nbNodes + 1);
+	struct ClusterNode **roots = malloc(sizeof(*roots) * nbNodes + 1);
+
+	if (!nodes || !roots)
+		err(1, "Failed to allocate memory for section clusters");
+
+	nbNodes = 0;
+	for (int8_t constraints = ORG_CONSTRAINED | ALIGN_CONSTRAINED; constraints >= 0;
+	     constraints--) {
+		for (struct UnassignedSection *ptr = lists[constraints]; ptr; ptr = ptr->next) {
+			struct ClusterNode *node = &nodes[nbNodes++];
+
+			node->node = ptr;
+			node->parent = NULL;
+			node->size = ptr->section->size;
+			node->rank = SIZE_MAX;
+			node->members = NULL;
+			hash_AddElement(clusterNodes, ptr->section->name, node);
+		}
+	}
+
+	/* Greedily merge clusters, by decreasing affinity, as long as they fit in a bank */
+	for (size_t i = 0; i < nbAffinities; i++) {
+		struct ClusterNode *node1 = hash_GetElement(clusterNodes, affinities[i].names[0]);
+		struct ClusterNode *node2 = hash_GetElement(clusterNodes, affinities[i].names[1]);
+
+		if (!node1 || !node2)
+			continue;
+		node1 = getRoot(node1);
+		node2 = getRoot(node2);
+		if (node1 == node2 || node1->size + node2->size > maxsize[type])
+			continue;
+
+		node2->parent = node1;
+		node1->size += node2->size;
+		if (node1->rank > i)
+			node1->rank = i;
+		if (node1->rank > node2->rank)
+			node1->rank = node2->rank;
+	}
+
+	/* Move the clustered sections out of the lists, keeping the others in order */
+	for (int8_t constraints = ORG_CONSTRAINED | ALIGN_CONSTRAINED; constraints >= 0;
+	     constraints--) {
+		struct UnassignedSection **ptr = &lists[constraints];
+
+		while (*ptr) {
+			struct UnassignedSection *node = *ptr;
+			struct ClusterNode *root =
+				getRoot(hash_GetElement(clusterNodes, node->section->name));
+
+			if (root->rank == SIZE_MAX) {
+				ptr = &node->next;
+				continue;
+			}
+			*ptr = node->next;
+			insertSection(&root->members, node);
+		}
+	}
+
+	size_t nbClusters = 0;
+
+	for (size_t i = 0; i < nbNodes; i++) {
+		if (!nodes[i].parent && nodes[i].rank != SIZE_MAX)
+			roots[nbClusters++] = &nodes[i];
+	}
+	qsort(roots, nbClusters, sizeof(*roots), compareClusters);
+
+	/* Place each cluster in the first bank with enough room for it */
+	for (size_t i = 0; i < nbClusters; i++) {
+		uint32_t bank = 0;
+
+		while (bank < nbbanks(type) && getFreeSize(type, bank) < roots[i]->size)
+			bank++;
+
+		while (roots[i]->members) {
+			struct UnassignedSection *node = roots[i]->members;
+			struct Section *section = node->section;
+			bool isPlaced = false;
+
+			roots[i]->members = node->next;
+			if (bank < nbbanks(type)) {
+				section->isBankFixed = true;
+				section->bank = bank + bankranges[type][0];
+				isPlaced = placeSection(section);
+				section->isBankFixed = false;
+			}
+			if (isPlaced)
+				regions[type].nbClustered++;
+			else
+				insertSection(&lists[getConstraints(section)], node);
+		}
+	}
+
+	hash_EmptyMap(clusterNodes);
+	free(roots);
+	free(nodes);
+}
+
+/**
+ * Places all sections of a region, starting with the most constrained.
+ * @param type The region's section type
+ * @return False if a section could not be placed
+ */
+static bool placeRegionSections(enum SectionType type)
+{
+	struct UnassignedSection **lists = unassignedSections[type];
+
+	/* Specially process fully-constrained sections because of overlaying */
+	if (!placeSections(lists[BANK_CONSTRAINED | ORG_CONSTRAINED], type))
+		return false;
+	lists[BANK_CONSTRAINED | ORG_CONSTRAINED] = NULL;
+
+	/* Sections constrained to a bank can't go elsewhere, so don't let previous placements block them */
+	for (int8_t constraints = BANK_CONSTRAINED | ALIGN_CONSTRAINED;
+	     constraints >= BANK_CONSTRAINED; constraints--) {
+		if (!placeSections(lists[constraints], type))
+			return false;
+		lists[constraints] = NULL;
+	}
+
+	/* Keep the previous link's placements when possible, larger sections first */
+	while (placedSections[type]) {
+		struct UnassignedSection *next = placedSections[type]->next;
+
+		if (placeSectionAsBefore(placedSections[type]->section))
+			regions[type].nbPlacedAsBefore++;
+		else
+			insertSection(&lists[getConstraints(placedSections[type]->section)],
+				      placedSections[type]);
+		placedSections[type] = next;
+	}
+
+	/* Assign all remaining sections by decreasing constraint order */
+	for (int8_t constraints = BANK_CONSTRAINED | ALIGN_CONSTRAINED;
+	     constraints >= 0; constraints--) {
+		/* Once only floating sections are left, keep those used together in the same bank */
+		if (constraints == (ORG_CONSTRAINED | ALIGN_CONSTRAINED)
+		 && type == SECTTYPE_ROMX && affinityFileName)
+			placeClusters(lists, type);
+		if (!placeSections(lists[constraints], type))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Forgets everything placed in a region, and the previous link's placements
+ * @param type The region's section type
+ */
+static void resetRegion(enum SectionType type)
+{
+	freeFreeSpace(type);
+	initFreeSpace(type);
+
+	regions[type].nbPlacedAsBefore = 0;
+	regions[type].nbClustered = 0;
+	regions[type].unplacedSection = NULL;
+	regions[type].nbPlaced = 0;
+
+	placedSections[type] = NULL;
+	for (uint8_t constraints = 0; constraints < 1 << 3; constraints++)
+		unassignedSections[type][constraints] = NULL;
+	for (uint64_t i = 0; i < nbSectionsToAssign; i++) {
+		if (sections[i].section->type == type)
+			insertSection(&unassignedSections[type][getConstraints(sections[i].section)],
+				      &sections[i]);
+	}
+}
+
+/**
+ * Places all sections of a region.
+ * @param index The region's section type
+ * @param arg Callback arg, unused
+ */
+static void placeRegion(size_t index, void *arg)
+{
+	(void)arg;
+	enum SectionType type = index;
+	bool hasPlacements = placedSections[type] != NULL;
+
+	if (placeRegionSections(type) || !hasPlacements)
+		return;
+
+	/* Keeping the previous placements may have left no room, so try without them */
+	resetRegion(type);
+	placeRegionSections(type);
 }
 
 void assign_AssignSections(void)
@@ -395,69 +791,58 @@ void assign_AssignSections(void)
 	if (!sections)
 		err(1, "Failed to allocate memory for section assignment");
 
-	initFreeSpace();
+	for (enum SectionType type = 0; type < SECTTYPE_INVALID; type++)
+		initFreeSpace(type);
 
 	/* Process linker script, if any */
 	processLinkerScript();
 
+	/* Sections placed by the linker script are now fixed, and thus kept */
+	if (collectGarbage)
+		obj_CollectGarbage();
+	if (foldIdenticalSections)
+		sect_FoldIdenticalSections();
+
 	nbSectionsToAssign = 0;
+	nbUnfixedSections = 0;
 	sect_ForEach(categorizeSection, NULL);
 
-	/** Place sections, starting with the most constrained **/
-
-	/* Specially process fully-constrained sections because of overlaying */
-	struct UnassignedSection *sectionPtr =
-		unassignedSections[BANK_CONSTRAINED | ORG_CONSTRAINED];
-
-	verbosePrint("Assigning bank+org-constrained...\n");
-	while (sectionPtr) {
-		placeSection(sectionPtr->section);
-		sectionPtr = sectionPtr->next;
-	}
-
-	/* If all sections were fully constrained, we have nothing left to do */
-	if (!nbSectionsToAssign)
-		return;
-
 	/* Overlaying requires only fully-constrained sections */
-	verbosePrint("Assigning other sections...\n");
-	if (overlayFileName)
+	if (overlayFileName && nbUnfixedSections)
 		errx(1, "All sections must be fixed when using an overlay file; %" PRIu64 " %sn't",
-		     nbSectionsToAssign, nbSectionsToAssign == 1 ? "is" : "are");
+		     nbUnfixedSections, nbUnfixedSections == 1 ? "is" : "are");
 
-	/* Assign all remaining sections by decreasing constraint order */
-	for (int8_t constraints = BANK_CONSTRAINED | ALIGN_CONSTRAINED;
-	     constraints >= 0; constraints--) {
-		sectionPtr = unassignedSections[constraints];
+	/** Place sections, starting with the most constrained **/
 
-		while (sectionPtr) {
-			placeSection(sectionPtr->section);
-			sectionPtr = sectionPtr->next;
-		}
+	verbosePrint("Assigning sections...\n");
+	par_Run(SECTTYPE_INVALID, nbThreads, placeRegion, NULL);
 
-		if (!nbSectionsToAssign)
-			return;
+	/* Add to the output in a fixed order, whichever region finished first */
+	for (enum SectionType type = 0; type < SECTTYPE_INVALID; type++) {
+		for (uint32_t i = 0; i < regions[type].nbPlaced; i++)
+			out_AddSection(regions[type].placed[i]);
 	}
 
-	unreachable_();
+	/* Report after that, since it looks for overlapping sections in the output */
+	uint32_t nbPlacedAsBefore = 0;
+
+	for (enum SectionType type = 0; type < SECTTYPE_INVALID; type++) {
+		if (regions[type].unplacedSection)
+			reportUnplacedSection(regions[type].unplacedSection);
+		nbPlacedAsBefore += regions[type].nbPlacedAsBefore;
+	}
+	if (stateFileName)
+		verbosePrint("%" PRIu32 " sections were placed as previously\n", nbPlacedAsBefore);
+	if (affinityFileName)
+		verbosePrint("%" PRIu32 " sections were placed with those they have affinity with\n",
+			     regions[SECTTYPE_ROMX].nbClustered);
 }
 
 void assign_Cleanup(void)
 {
 	for (enum SectionType type = 0; type < SECTTYPE_INVALID; type++) {
-		for (uint32_t bank = 0; bank < nbbanks(type); bank++) {
-			struct FreeSpace *ptr =
-				memory[type][bank].next;
-
-			while (ptr) {
-				struct FreeSpace *next = ptr->next;
-
-				free(ptr);
-				ptr = next;
-			}
-		}
-
-		free(memory[type]);
+		freeFreeSpace(type);
+		free(regions[type].placed);
 	}
 
 	free(sections);
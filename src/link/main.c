@@ -23,12 +23,17 @@
 #include "link/assign.h"
 #include "link/patch.h"
 #include "link/output.h"
+#include "link/state.h"
+#include "link/affinity.h"
 
 #include "extern/err.h"
 #include "extern/getopt.h"
+#include "romheader.h"
+#include "stats.h"
 #include "version.h"
 
 bool isDmgMode;               /* -d */
+unsigned long nbThreads = 1;  /* -J */
 char       *linkerScriptName; /* -l */
 char const *mapFileName;      /* -m */
 char const *symFileName;      /* -n */
@@ -39,6 +44,14 @@ bool is32kMode;               /* -t */
 bool beVerbose;               /* -v */
 bool isWRA0Mode;              /* -w */
 bool disablePadding;          /* -x */
+bool collectGarbage;          /* --gc-sections */
+char const **rootSymbols;     /* -s */
+uint32_t nbRootSymbols;
+bool foldIdenticalSections;   /* --icf */
+char const *stateFileName;    /* --incremental */
+char const *affinityFileName; /* --affinity */
+static bool makeLibrary;      /* --make-lib */
+static bool isRelocatable;    /* -r */
 
 static uint32_t nbErrors = 0;
 
@@ -141,8 +154,10 @@ FILE *openFile(char const *fileName, char const *mode)
 	return file;
 }
 
+static int headerOption; /* Which of rgbfix's options was given */
+
 /* Short options */
-static char const *optstring = "dl:m:n:O:o:p:s:tVvwx";
+static char const *optstring = "dJ:l:m:n:O:o:p:rs:tVvwx";
 
 /*
  * Equivalent long options
@@ -155,20 +170,42 @@ static char const *optstring = "dl:m:n:O:o:p:s:tVvwx";
  * over short opt matching
  */
 static struct option const longopts[] = {
-	{ "dmg",          no_argument,       NULL, 'd' },
-	{ "linkerscript", required_argument, NULL, 'l' },
-	{ "map",          required_argument, NULL, 'm' },
-	{ "sym",          required_argument, NULL, 'n' },
-	{ "overlay",      required_argument, NULL, 'O' },
-	{ "output",       required_argument, NULL, 'o' },
-	{ "pad",          required_argument, NULL, 'p' },
-	{ "smart",        required_argument, NULL, 's' },
-	{ "tiny",         no_argument,       NULL, 't' },
-	{ "version",      no_argument,       NULL, 'V' },
-	{ "verbose",      no_argument,       NULL, 'v' },
-	{ "wramx",        no_argument,       NULL, 'w' },
-	{ "nopad",        no_argument,       NULL, 'x' },
-	{ NULL,           no_argument,       NULL, 0   }
+	{ "affinity",         required_argument, NULL,          'A' },
+	{ "dmg",              no_argument,       NULL,          'd' },
+	{ "gc-sections",      no_argument,       NULL,          'G' },
+	{ "icf",              no_argument,       NULL,          'I' },
+	{ "incremental",      required_argument, NULL,          'i' },
+	{ "jobs",             required_argument, NULL,          'J' },
+	{ "linkerscript",     required_argument, NULL,          'l' },
+	{ "map",              required_argument, NULL,          'm' },
+	{ "make-lib",         no_argument,       NULL,          'L' },
+	{ "sym",              required_argument, NULL,          'n' },
+	{ "overlay",          required_argument, NULL,          'O' },
+	{ "output",           required_argument, NULL,          'o' },
+	{ "pad",              required_argument, NULL,          'p' },
+	{ "relocatable",      no_argument,       NULL,          'r' },
+	{ "smart",            required_argument, NULL,          's' },
+	{ "stats",            optional_argument, NULL,          'S' },
+	{ "tiny",             no_argument,       NULL,          't' },
+	{ "version",          no_argument,       NULL,          'V' },
+	{ "verbose",          no_argument,       NULL,          'v' },
+	{ "wramx",            no_argument,       NULL,          'w' },
+	{ "nopad",            no_argument,       NULL,          'x' },
+	/* Header fixing, with the same names as rgbfix's options */
+	{ "color-only",       no_argument,       &headerOption, 'C' },
+	{ "color-compatible", no_argument,       &headerOption, 'c' },
+	{ "fix-spec",         required_argument, &headerOption, 'f' },
+	{ "game-id",          required_argument, &headerOption, 'i' },
+	{ "non-japanese",     no_argument,       &headerOption, 'j' },
+	{ "new-licensee",     required_argument, &headerOption, 'k' },
+	{ "old-licensee",     required_argument, &headerOption, 'l' },
+	{ "mbc-type",         required_argument, &headerOption, 'm' },
+	{ "rom-version",      required_argument, &headerOption, 'n' },
+	{ "ram-size",         required_argument, &headerOption, 'r' },
+	{ "sgb-compatible",   no_argument,       &headerOption, 's' },
+	{ "title",            required_argument, &headerOption, 't' },
+	{ "validate",         no_argument,       &headerOption, 'v' },
+	{ NULL,               no_argument,       NULL,          0   }
 };
 
 /**
@@ -177,28 +214,75 @@ static struct option const longopts[] = {
 static void printUsage(void)
 {
 	fputs(
-"Usage: rgblink [-dtVvwx] [-l script] [-m map_file] [-n sym_file]\n"
+"Usage: rgblink [-dtVvwx] [-J jobs] [-l script] [-m map_file] [-n sym_file]\n"
 "               [-O overlay_file] [-o out_file] [-p pad_value] [-s symbol]\n"
-"               <file> ...\n"
+"               [--affinity profile] [--gc-sections] [--icf]\n"
+"               [--incremental state_file] [--stats[=json]]\n"
+"               [<rgbfix header options>] <file> ...\n"
+"       rgblink --make-lib -o lib_file <file> ...\n"
+"       rgblink -r -o out_file <file> ...\n"
 "Useful options:\n"
+"    --affinity <path>          place sections used together in the same bank\n"
+"    --gc-sections              remove the sections that nothing refers to\n"
+"    --icf                      fold identical sections together\n"
+"    --incremental <path>       reuse and update the previous link's state\n"
+"    -J, --jobs <count>         use up to this many threads\n"
 "    -l, --linkerscript <path>  set the input linker script\n"
 "    -m, --map <path>           set the output map file\n"
+"    --make-lib                 bundle the object files into a library\n"
 "    -n, --sym <path>           set the output symbol list file\n"
 "    -o, --output <path>        set the output file\n"
 "    -p, --pad <value>          set the value to pad between sections with\n"
+"    -r, --relocatable          link into a single relocatable object file\n"
 "    -x, --nopad                disable padding of output binary\n"
+"    --validate                 fix the header logo and both checksums\n"
 "    -V, --version              print RGBLINK version and exits\n"
 "\n"
 "For help, use `man rgblink' or go to https://rgbds.gbdev.io/docs/\n",
 	      stderr);
 }
 
+static void countSymbol(struct Symbol *symbol, void *arg)
+{
+	(void)symbol;
+	(*(uint64_t *)arg)++;
+}
+
+static void countSection(struct Section *section, void *arg)
+{
+	uint64_t *counts = arg;
+
+	counts[0]++;
+	counts[1] += section->nbPatches;
+}
+
+static void printStats(unsigned int nbObjects)
+{
+	if (statsFormat == STATS_NONE)
+		return;
+
+	uint64_t nbSymbols = 0;
+	uint64_t sectionCounts[2] = {0, 0}; /* Sections, patches */
+
+	sym_ForEach(countSymbol, &nbSymbols);
+	sect_ForEach(countSection, sectionCounts);
+
+	stats_SetCounter("objects", nbObjects);
+	stats_SetCounter("symbols", nbSymbols);
+	stats_SetCounter("sections", sectionCounts[0]);
+	stats_SetCounter("patches", sectionCounts[1]);
+	stats_Print("rgblink");
+}
+
 /**
  * Cleans up what has been done
  * Mostly here to please tools such as `valgrind` so actual errors can be seen
  */
 static void cleanup(void)
 {
+	free(rootSymbols);
+	state_Cleanup();
+	aff_Cleanup();
 	obj_Cleanup();
 }
 
@@ -212,10 +296,25 @@ int main(int argc, char *argv[])
 	while ((optionChar = musl_getopt_long_only(argc, argv, optstring,
 						   longopts, NULL)) != -1) {
 		switch (optionChar) {
+		case 0:
+			if (!hdr_ParseOption(headerOption, musl_optarg))
+				nbErrors++;
+			break;
+		case 'A':
+			affinityFileName = musl_optarg;
+			break;
 		case 'd':
 			isDmgMode = true;
 			isWRA0Mode = true;
 			break;
+		case 'J':
+			nbThreads = strtoul(musl_optarg, &endptr, 0);
+			if (musl_optarg[0] == '\0' || *endptr != '\0'
+			 || nbThreads == 0 || nbThreads > 256) {
+				error(NULL, 0, "Argument for 'J' must be between 1 and 256");
+				nbThreads = 1;
+			}
+			break;
 		case 'l':
 			linkerScriptName = musl_optarg;
 			break;
@@ -244,9 +343,31 @@ int main(int argc, char *argv[])
 			padValue = value;
 			break;
 		case 's':
-			/* FIXME: nobody knows what this does, figure it out */
-			(void)musl_optarg;
-			warning(NULL, 0, "Nobody has any idea what `-s` does");
+			rootSymbols = realloc(rootSymbols,
+					      sizeof(*rootSymbols) * (nbRootSymbols + 1));
+			if (!rootSymbols)
+				err(1, "Failed to allocate memory for root symbols");
+			rootSymbols[nbRootSymbols++] = musl_optarg;
+			break;
+		case 'G':
+			collectGarbage = true;
+			break;
+		case 'I':
+			foldIdenticalSections = true;
+			break;
+		case 'i':
+			stateFileName = musl_optarg;
+			break;
+		case 'L':
+			makeLibrary = true;
+			break;
+		case 'r':
+			isRelocatable = true;
+			break;
+		case 'S':
+			if (!stats_SetFormat(musl_optarg))
+				fatal(NULL, 0, "Invalid argument for option '--stats': \"%s\" (expected \"text\" or \"json\")",
+				      musl_optarg);
 			break;
 		case 't':
 			is32kMode = true;
@@ -271,6 +392,8 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	hdr_CheckOptions();
+
 	int curArgIndex = musl_optind;
 
 	/* If no input files were specified, the user must have screwed up */
@@ -280,6 +403,16 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	if (makeLibrary) {
+		if (!outputFileName)
+			fatal(NULL, 0, "--make-lib requires an output file");
+		obj_MakeLibrary(outputFileName, &argv[curArgIndex], argc - curArgIndex);
+		return 0;
+	}
+
+	if (isRelocatable && !outputFileName)
+		fatal(NULL, 0, "-r requires an output file");
+
 	/* Patch the size array depending on command-line options */
 	if (!is32kMode)
 		maxsize[SECTTYPE_ROM0] = 0x4000;
@@ -290,24 +423,59 @@ int main(int argc, char *argv[])
 	if (isDmgMode)
 		bankranges[SECTTYPE_VRAM][1] = BANK_MIN_VRAM;
 
+	unsigned int nbObjects = argc - curArgIndex;
+
 	/* Read all object files first, */
-	for (obj_Setup(argc - curArgIndex); curArgIndex < argc; curArgIndex++)
+	stats_StartPhase("object read");
+	for (obj_Setup(nbObjects); curArgIndex < argc; curArgIndex++)
 		obj_ReadFile(argv[curArgIndex], argc - curArgIndex - 1);
+	obj_ReadLibraryMembers();
 
 	/* then process them, */
+	stats_StartPhase("sanity checks");
+	sect_ConcatFragments();
 	obj_DoSanityChecks();
+	if (isRelocatable) {
+		if (nbErrors) {
+			fprintf(stderr, "Linking failed with %" PRIu32 " error%s\n",
+				nbErrors, nbErrors != 1 ? "s" : "");
+			exit(1);
+		}
+		stats_StartPhase("output");
+		obj_WriteRelocatable(outputFileName);
+		stats_EndPhase();
+
+		printStats(nbObjects);
+		cleanup();
+		return 0;
+	}
+	stats_StartPhase("assignment");
+	if (stateFileName)
+		state_Read(stateFileName);
+	if (affinityFileName)
+		aff_Read(affinityFileName);
 	assign_AssignSections();
+	stats_StartPhase("relaxation");
+	obj_RelaxJumps();
+	stats_StartPhase("assertions");
 	obj_CheckAssertions();
 	assign_Cleanup();
 
 	/* and finally output the result. */
+	stats_StartPhase("patching");
 	patch_ApplyPatches();
 	if (nbErrors) {
 		fprintf(stderr, "Linking failed with %" PRIu32 " error%s\n",
 			nbErrors, nbErrors != 1 ? "s" : "");
 		exit(1);
 	}
+	stats_StartPhase("output");
 	out_WriteFiles();
+	if (stateFileName)
+		state_Write(stateFileName);
+	stats_EndPhase();
+
+	printStats(nbObjects);
 
 	/* Do cleanup before quitting, though. */
 	cleanup();
@@ -22,6 +22,7 @@
 #include "link/symbol.h"
 
 #include "extern/err.h"
+#include "hashmap.h"
 #include "helpers.h"
 #include "linkdefs.h"
 
@@ -38,6 +39,25 @@ static struct {
 } *nodes;
 static struct Assertion *assertions;
 
+struct LibraryMember {
+	char *name; /* As displayed, i.e. "library(member)" */
+	long offset;
+	bool isLoaded;
+	struct Library *library;
+};
+
+static struct Library {
+	FILE *file;
+	uint32_t nbMembers;
+	struct LibraryMember *members;
+	uint32_t nbSymbols;
+	char **symbolNames;
+	struct Library *next;
+} *libraries;
+
+/* Maps each symbol exported by a library to the member defining it */
+static HashMap libraryIndex;
+
 /***** Helper functions for reading object files *****/
 
 /*
@@ -399,32 +419,72 @@ static void readSection(FILE *file, struct Section *section, char const *fileNam
 }
 
 /**
- * Links a symbol to a section, keeping the section's symbol list sorted.
+ * Links a symbol to a section; the section's symbol list is sorted later.
  * @param symbol The symbol to link
  * @param section The section to link
  */
-static void linkSymToSect(struct Symbol const *symbol, struct Section *section)
+static void linkSymToSect(struct Symbol *symbol, struct Section *section)
+{
+	section->symbols[section->nbSymbols++] = symbol;
+}
+
+/**
+ * Merge sorts symbols by offset, keeping symbols at the same offset in order.
+ * @param symbols The symbols to sort
+ * @param tmp Scratch space, as large as `symbols`
+ * @param nbSymbols How many symbols there are
+ */
+static void mergeSortSymbols(struct Symbol **symbols,
+			     struct Symbol **tmp, uint32_t nbSymbols)
 {
-	uint32_t a = 0, b = section->nbSymbols;
+	if (nbSymbols < 2)
+		return;
+
+	uint32_t half = nbSymbols / 2;
+
+	mergeSortSymbols(symbols, tmp, half);
+	mergeSortSymbols(&symbols[half], tmp, nbSymbols - half);
+
+	/* Nothing to do if both halves are already in order */
+	if (symbols[half - 1]->offset <= symbols[half]->offset)
+		return;
 
-	while (a != b) {
-		uint32_t c = (a + b) / 2;
+	memcpy(tmp, symbols, sizeof(*tmp) * half);
 
-		if (section->symbols[c]->offset > symbol->offset)
-			b = c;
+	uint32_t a = 0, b = half, i = 0;
+
+	while (a != half && b != nbSymbols) {
+		if (symbols[b]->offset < tmp[a]->offset)
+			symbols[i++] = symbols[b++];
 		else
-			a = c + 1;
+			symbols[i++] = tmp[a++];
 	}
+	while (a != half)
+		symbols[i++] = tmp[a++];
+}
 
-	struct Symbol const *tmp = symbol;
+/**
+ * Sorts a section's symbol list by offset, once all its symbols are linked.
+ * @param section The section whose symbols to sort
+ * @param fileName The filename to report in errors
+ */
+static void sortSectSymbols(struct Section *section, char const *fileName)
+{
+	uint32_t i = 1;
 
-	for (uint32_t i = a; i <= section->nbSymbols; i++) {
-		symbol = tmp;
-		tmp = section->symbols[i];
-		section->symbols[i] = symbol;
-	}
+	/* Symbols are usually emitted in order already */
+	while (i < section->nbSymbols
+	    && section->symbols[i - 1]->offset <= section->symbols[i]->offset)
+		i++;
+	if (i >= section->nbSymbols)
+		return;
 
-	section->nbSymbols++;
+	struct Symbol **tmp = malloc(sizeof(*tmp) * (section->nbSymbols / 2));
+
+	if (!tmp)
+		err(1, "%s: Couldn't sort \"%s\"'s symbols", fileName, section->name);
+	mergeSortSymbols(section->symbols, tmp, section->nbSymbols);
+	free(tmp);
 }
 
 /**
@@ -454,13 +514,16 @@ static inline struct Section *getMainSection(struct Section *section)
 	return section;
 }
 
-void obj_ReadFile(char const *fileName, unsigned int fileID)
+/**
+ * Reads an object file's header, checking that it can be linked.
+ * @param file The file to read from
+ * @param fileName The filename to report in errors
+ * @param nbSymbols Set to the number of symbols in the file
+ * @param nbSections Set to the number of sections in the file
+ */
+static void readHeader(FILE *file, char const *fileName, uint32_t *nbSymbols,
+		       uint32_t *nbSections)
 {
-	FILE *file = strcmp("-", fileName) ? fopen(fileName, "rb") : stdin;
-
-	if (!file)
-		err(1, "Could not open file %s", fileName);
-
 	/* Begin by reading the magic bytes and version number */
 	unsigned versionNumber;
 	int matchedElems = fscanf(file, RGBDS_OBJECT_VERSION_STRING,
@@ -484,13 +547,24 @@ void obj_ReadFile(char const *fileName, unsigned int fileID)
 		errx(1, "%s is a revision 0x%04" PRIx32 " object file; only 0x%04x is supported",
 		     fileName, revNum, RGBDS_OBJECT_REV);
 
+	tryReadlong(*nbSymbols, file, "%s: Cannot read number of symbols: %s",
+		    fileName);
+	tryReadlong(*nbSections, file, "%s: Cannot read number of sections: %s",
+		    fileName);
+}
+
+/**
+ * Reads an object, and adds its info to the data structures.
+ * @param file The file to read from, positioned at the start of the object
+ * @param fileName The filename to report in errors
+ * @param fileID The ID of the file
+ */
+static void readObject(FILE *file, char const *fileName, unsigned int fileID)
+{
 	uint32_t nbSymbols;
 	uint32_t nbSections;
 
-	tryReadlong(nbSymbols, file, "%s: Cannot read number of symbols: %s",
-		    fileName);
-	tryReadlong(nbSections, file, "%s: Cannot read number of sections: %s",
-		    fileName);
+	readHeader(file, fileName, &nbSymbols, &nbSections);
 
 	nbSectionsToAssign += nbSections;
 
@@ -549,6 +623,8 @@ void obj_ReadFile(char const *fileName, unsigned int fileID)
 			err(1, "%s: Couldn't create new section", fileName);
 
 		fileSections[i]->nextu = NULL;
+		fileSections[i]->isReferenced = false;
+		fileSections[i]->folded = NULL;
 		readSection(file, fileSections[i], fileName, fileSections, nodes[fileID].nodes);
 		fileSections[i]->fileSymbols = fileSymbols;
 		if (nbSymPerSect[i]) {
@@ -589,6 +665,9 @@ void obj_ReadFile(char const *fileName, unsigned int fileID)
 		}
 	}
 
+	for (uint32_t i = 0; i < nbSections; i++)
+		sortSectSymbols(fileSections[i], fileName);
+
 	uint32_t nbAsserts;
 
 	tryReadlong(nbAsserts, file, "%s: Cannot read number of assertions: %s",
@@ -606,14 +685,202 @@ void obj_ReadFile(char const *fileName, unsigned int fileID)
 	}
 
 	free(fileSections);
+}
+
+/**
+ * Checks whether a file is a library, rather than an object file.
+ * If it isn't, the file is rewound to be read as an object.
+ * @param file The file to check
+ * @return True if the file is a library, with its ID having been read
+ */
+static bool isLibrary(FILE *file)
+{
+	char id[sizeof(RGBDS_LIBRARY_ID) - 1];
+
+	/* Standard input can't be rewound, but libraries need seeking anyway */
+	if (file == stdin)
+		return false;
+	if (fread(id, 1, sizeof(id), file) == sizeof(id)
+	 && !memcmp(id, RGBDS_LIBRARY_ID, sizeof(id)))
+		return true;
+	rewind(file);
+	return false;
+}
+
+/**
+ * Reads a library's table of contents; its members are only read on demand.
+ * @param file The file to read from, positioned after the library's ID
+ * @param fileName The filename to report in errors
+ */
+static void readLibrary(FILE *file, char const *fileName)
+{
+	struct Library *library = malloc(sizeof(*library));
+
+	if (!library)
+		err(1, "%s: Couldn't create new library", fileName);
+	library->file = file;
+
+	uint32_t revNum;
+
+	tryReadlong(revNum, file, "%s: Cannot read revision number: %s", fileName);
+	if (revNum != RGBDS_LIBRARY_REV)
+		errx(1, "%s is a revision 0x%04" PRIx32 " library; only 0x%04x is supported",
+		     fileName, revNum, RGBDS_LIBRARY_REV);
+
+	tryReadlong(library->nbMembers, file, "%s: Cannot read number of members: %s",
+		    fileName);
+	verbosePrint("Reading library %s, with %" PRIu32 " members\n",
+		     fileName, library->nbMembers);
+	library->members = malloc(sizeof(*library->members) * library->nbMembers + 1);
+	if (!library->members)
+		err(1, "%s: Couldn't create library members", fileName);
+
+	long offset = 0;
+
+	for (uint32_t i = 0; i < library->nbMembers; i++) {
+		struct LibraryMember *member = &library->members[i];
+		char *memberName;
+		uint32_t size;
+
+		tryReadstr(memberName, file, "%s: Cannot read member #%" PRIu32 "'s name: %s",
+			   fileName, i);
+		tryReadlong(size, file, "%s: Cannot read \"%s\"'s size: %s",
+			    fileName, memberName);
+
+		member->name = malloc(strlen(fileName) + strlen(memberName) + 3);
+		if (!member->name)
+			err(1, "%s: Couldn't create member \"%s\"", fileName, memberName);
+		sprintf(member->name, "%s(%s)", fileName, memberName);
+		free(memberName);
+		member->offset = offset;
+		member->isLoaded = false;
+		member->library = library;
+		offset += size;
+	}
+
+	tryReadlong(library->nbSymbols, file, "%s: Cannot read number of symbols: %s",
+		    fileName);
+	library->symbolNames = malloc(sizeof(*library->symbolNames) * library->nbSymbols + 1);
+	if (!library->symbolNames)
+		err(1, "%s: Couldn't create library index", fileName);
+
+	for (uint32_t i = 0; i < library->nbSymbols; i++) {
+		uint32_t memberID;
+
+		tryReadstr(library->symbolNames[i], file,
+			   "%s: Cannot read symbol #%" PRIu32 "'s name: %s", fileName, i);
+		tryReadlong(memberID, file, "%s: Cannot read \"%s\"'s member: %s",
+			    fileName, library->symbolNames[i]);
+		if (memberID >= library->nbMembers)
+			errx(1, "%s: \"%s\"'s member (%" PRIu32 ") is invalid",
+			     fileName, library->symbolNames[i], memberID);
+
+		/* Libraries given first take precedence */
+		if (!hash_GetElement(libraryIndex, library->symbolNames[i]))
+			hash_AddElement(libraryIndex, library->symbolNames[i],
+					&library->members[memberID]);
+	}
+
+	/* Members are stored right after the table of contents */
+	long dataStart = ftell(file);
+
+	if (dataStart == -1)
+		err(1, "%s: Cannot locate the library's members", fileName);
+	for (uint32_t i = 0; i < library->nbMembers; i++)
+		library->members[i].offset += dataStart;
+
+	library->next = libraries;
+	libraries = library;
+}
+
+void obj_ReadFile(char const *fileName, unsigned int fileID)
+{
+	FILE *file = strcmp("-", fileName) ? fopen(fileName, "rb") : stdin;
+
+	if (!file)
+		err(1, "Could not open file %s", fileName);
+
+	if (isLibrary(file)) {
+		/* The file is kept open to read the members from */
+		readLibrary(file, fileName);
+		nodes[fileID].nodes = NULL;
+		nodes[fileID].nbNodes = 0;
+		return;
+	}
+
+	readObject(file, fileName, fileID);
 	fclose(file);
 }
 
+/**
+ * Reads a library member, which gets a new file ID.
+ * @param member The member to read
+ */
+static void readMember(struct LibraryMember *member)
+{
+	if (fseek(member->library->file, member->offset, SEEK_SET) != 0)
+		err(1, "Cannot seek to %s", member->name);
+
+	nodes = realloc(nodes, sizeof(*nodes) * (nbObjFiles + 1));
+	if (!nodes)
+		err(1, "Failed to get memory for %s's nodes", member->name);
+
+	member->isLoaded = true;
+	readObject(member->library->file, member->name, nbObjFiles++);
+}
+
+void obj_ReadLibraryMembers(void)
+{
+	/* Symbol lists are prepended, so the newest ones are scanned until the last scanned one */
+	struct SymbolList *scanned = NULL;
+
+	while (symbolLists != scanned) {
+		struct SymbolList *newest = symbolLists;
+
+		for (struct SymbolList *list = newest; list != scanned; list = list->next) {
+			for (size_t i = 0; i < list->nbSymbols; i++) {
+				struct Symbol const *symbol = list->symbolList[i];
+
+				if (symbol->type != SYMTYPE_IMPORT || sym_GetSymbol(symbol->name))
+					continue;
+
+				/* Undefined symbols not in any library are reported when patching */
+				struct LibraryMember *member = hash_GetElement(libraryIndex,
+									       symbol->name);
+
+				if (member && !member->isLoaded)
+					readMember(member);
+			}
+		}
+		scanned = newest;
+	}
+
+	for (struct Library *library = libraries; library; library = library->next) {
+		fclose(library->file);
+		library->file = NULL;
+	}
+}
+
 void obj_DoSanityChecks(void)
 {
 	sect_DoSanityChecks();
 }
 
+void obj_CollectGarbage(void)
+{
+	/* Whatever assertions check must be kept */
+	for (struct Assertion *assert = assertions; assert; assert = assert->next)
+		patch_ForEachSectionRef(&assert->patch,
+					(struct Symbol const * const *)assert->fileSymbols,
+					sect_MarkReferenced);
+	sect_CollectGarbage();
+}
+
+void obj_RelaxJumps(void)
+{
+	patch_RelaxJumps(assertions);
+}
+
 void obj_CheckAssertions(void)
 {
 	patch_CheckAssertions(assertions);
@@ -628,19 +895,494 @@ void obj_Setup(unsigned int nbFiles)
 	nodes = malloc(sizeof(*nodes) * nbFiles);
 }
 
+/* Write a long to a file (little-endian) */
+static void writeLong(uint32_t value, FILE *file)
+{
+	putc(value, file);
+	putc(value >> 8, file);
+	putc(value >> 16, file);
+	putc(value >> 24, file);
+}
+
+/* Write a NUL-terminated string to a file */
+static void writeString(char const *str, FILE *file)
+{
+	fwrite(str, 1, strlen(str) + 1, file);
+}
+
+struct LibrarySymbol {
+	char *name;
+	uint32_t memberID;
+};
+
+void obj_MakeLibrary(char const *libName, char * const *fileNames, unsigned int nbFiles)
+{
+	uint32_t *sizes = malloc(sizeof(*sizes) * nbFiles);
+	/* Which member exports each symbol, pointed to by `exporters` */
+	uint32_t *memberIDs = malloc(sizeof(*memberIDs) * nbFiles);
+	struct LibrarySymbol *index = NULL;
+	uint32_t nbIndexed = 0;
+	uint32_t capacity = 0;
+	static HashMap exporters;
+
+	if (!sizes || !memberIDs)
+		err(1, "Failed to allocate memory for %s's members", libName);
+
+	/* Index the symbols exported by each object */
+	for (unsigned int fileID = 0; fileID < nbFiles; fileID++) {
+		char const *fileName = fileNames[fileID];
+		FILE *file = fopen(fileName, "rb");
+
+		memberIDs[fileID] = fileID;
+
+		if (!file)
+			err(1, "Could not open file %s", fileName);
+
+		uint32_t nbSymbols;
+		uint32_t nbSections;
+		uint32_t nbNodes;
+
+		readHeader(file, fileName, &nbSymbols, &nbSections);
+		tryReadlong(nbNodes, file, "%s: Cannot read number of nodes: %s", fileName);
+
+		struct FileStackNode *fileNodes = calloc(nbNodes, sizeof(*fileNodes));
+
+		if (!fileNodes)
+			err(1, "Failed to get memory for %s's nodes", fileName);
+		for (uint32_t i = nbNodes; i--; )
+			readFileStackNode(file, fileNodes, i, fileName);
+
+		for (uint32_t i = 0; i < nbSymbols; i++) {
+			struct Symbol symbol;
+
+			readSymbol(file, &symbol, fileName, fileNodes);
+			if (symbol.type != SYMTYPE_EXPORT) {
+				free(symbol.name);
+				continue;
+			}
+
+			uint32_t const *other = hash_GetElement(exporters, symbol.name);
+
+			if (other)
+				errx(1, "\"%s\" is exported by both %s and %s",
+				     symbol.name, fileNames[*other], fileName);
+
+			if (nbIndexed == capacity) {
+				capacity = capacity ? capacity * 2 : 64;
+				index = realloc(index, sizeof(*index) * capacity);
+				if (!index)
+					err(1, "Failed to allocate memory for %s's index", libName);
+			}
+			index[nbIndexed].name = symbol.name;
+			index[nbIndexed].memberID = fileID;
+			nbIndexed++;
+			hash_AddElement(exporters, symbol.name, &memberIDs[fileID]);
+		}
+
+		for (uint32_t i = 0; i < nbNodes; i++) {
+			if (fileNodes[i].type == NODE_REPT)
+				free(fileNodes[i].iters);
+			else
+				free(fileNodes[i].name);
+		}
+		free(fileNodes);
+
+		if (fseek(file, 0, SEEK_END) != 0)
+			err(1, "Cannot get the size of %s", fileName);
+
+		long size = ftell(file);
+
+		if (size == -1 || size > UINT32_MAX)
+			errx(1, "Cannot get the size of %s", fileName);
+		sizes[fileID] = size;
+		fclose(file);
+	}
+	hash_EmptyMap(exporters);
+	free(memberIDs);
+
+	FILE *libFile = openFile(libName, "wb");
+
+	fputs(RGBDS_LIBRARY_ID, libFile);
+	writeLong(RGBDS_LIBRARY_REV, libFile);
+	writeLong(nbFiles, libFile);
+	for (unsigned int fileID = 0; fileID < nbFiles; fileID++) {
+		writeString(fileNames[fileID], libFile);
+		writeLong(sizes[fileID], libFile);
+	}
+	writeLong(nbIndexed, libFile);
+	for (uint32_t i = 0; i < nbIndexed; i++) {
+		writeString(index[i].name, libFile);
+		writeLong(index[i].memberID, libFile);
+		free(index[i].name);
+	}
+	free(index);
+
+	/* Then copy the objects themselves */
+	for (unsigned int fileID = 0; fileID < nbFiles; fileID++) {
+		FILE *file = fopen(fileNames[fileID], "rb");
+		uint8_t buffer[BUFSIZ];
+		size_t nbRead;
+
+		if (!file)
+			err(1, "Could not open file %s", fileNames[fileID]);
+		while ((nbRead = fread(buffer, 1, sizeof(buffer), file)) != 0)
+			fwrite(buffer, 1, nbRead, libFile);
+		if (ferror(file))
+			err(1, "Cannot read %s", fileNames[fileID]);
+		fclose(file);
+	}
+
+	if (fclose(libFile) != 0)
+		err(1, "Cannot write %s", libName);
+	free(sizes);
+}
+
+/* The IDs that an object file's symbols have in the relocatable object */
+struct RelocSymbols {
+	struct Symbol **fileSymbols;
+	size_t nbSymbols;
+	uint32_t *IDs;
+};
+
+struct Relocatable {
+	FILE *file;
+	uint32_t *nodeBases; /* The ID of each object file's first node */
+	unsigned int lastNodeFile;
+	struct RelocSymbols *files; /* In the order the files were read */
+	size_t nbFiles;
+	size_t lastSymbolFile;
+	HashMap sectionIDs; /* Maps section names to their ID */
+};
+
+static uint32_t getRelocNodeID(struct Relocatable *reloc, struct FileStackNode const *node)
+{
+	/* Consecutive lookups are usually made for the same file */
+	for (unsigned int n = 0; n < nbObjFiles; n++) {
+		unsigned int i = (reloc->lastNodeFile + n) % nbObjFiles;
+
+		if (node >= nodes[i].nodes && node < nodes[i].nodes + nodes[i].nbNodes) {
+			reloc->lastNodeFile = i;
+			return reloc->nodeBases[i] + (node - nodes[i].nodes);
+		}
+	}
+	errx(1, "Internal error: file stack node not found");
+}
+
+static struct RelocSymbols const *getRelocSymbols(struct Relocatable *reloc,
+						 struct Symbol * const *fileSymbols)
+{
+	for (size_t n = 0; n < reloc->nbFiles; n++) {
+		size_t i = (reloc->lastSymbolFile + n) % reloc->nbFiles;
+
+		if (reloc->files[i].fileSymbols == fileSymbols) {
+			reloc->lastSymbolFile = i;
+			return &reloc->files[i];
+		}
+	}
+	errx(1, "Internal error: symbol table not found");
+}
+
+/* Fragments and unions share their name with the section they belong to */
+static uint32_t getRelocSectionID(struct Relocatable *reloc, struct Section const *section)
+{
+	uint32_t const *ID = hash_GetElement(reloc->sectionIDs, section->name);
+
+	if (!ID)
+		errx(1, "Internal error: section \"%s\" not found", section->name);
+	return *ID;
+}
+
+/**
+ * Writes a patch to a relocatable object, rebasing it onto the merged sections
+ * @param reloc The relocatable object being written
+ * @param patch The patch to write
+ * @param fileSymbols The symbols of the object file the patch comes from
+ * @param offset The offset of the patch's section within the merged section
+ */
+static void writeRelocPatch(struct Relocatable *reloc, struct Patch const *patch,
+			    struct Symbol * const *fileSymbols, uint16_t offset)
+{
+	FILE *file = reloc->file;
+	struct RelocSymbols const *symbols = getRelocSymbols(reloc, fileSymbols);
+
+	writeLong(getRelocNodeID(reloc, patch->src), file);
+	writeLong(patch->lineNo, file);
+	writeLong(patch->offset + offset, file);
+	if (patch->pcSection) {
+		writeLong(getRelocSectionID(reloc, patch->pcSection), file);
+		writeLong(patch->pcOffset + patch->pcSection->offset, file);
+	} else {
+		writeLong(-1, file);
+		writeLong(patch->pcOffset, file);
+	}
+	putc(patch->type, file);
+	writeLong(patch->rpnSize, file);
+
+	/* Copy the expression, only renumbering the symbols it refers to */
+	uint8_t const *expression = patch->rpnExpression;
+	int32_t i = 0;
+
+	while (i < patch->rpnSize) {
+		uint8_t command = expression[i++];
+		uint32_t value;
+
+		putc(command, file);
+		switch (command) {
+		case RPN_SYM:
+		case RPN_BANK_SYM:
+			if (patch->rpnSize - i < 4)
+				break; /* Reported when linking */
+			value = expression[i] | expression[i + 1] << 8
+				| expression[i + 2] << 16 | (uint32_t)expression[i + 3] << 24;
+			i += 4;
+			/* PC is not a symbol, and invalid IDs are reported when linking */
+			writeLong(value < symbols->nbSymbols ? symbols->IDs[value] : value, file);
+			break;
+
+		case RPN_CONST:
+			for (int32_t end = i + 4; i < end && i < patch->rpnSize; i++)
+				putc(expression[i], file);
+			break;
+
+		case RPN_BANK_SECT:
+			while (i < patch->rpnSize) {
+				putc(expression[i], file);
+				if (!expression[i++])
+					break;
+			}
+			break;
+		}
+	}
+}
+
+static void writeRelocSymbol(struct Relocatable *reloc, struct Symbol const *symbol)
+{
+	FILE *file = reloc->file;
+
+	writeString(symbol->name, file);
+	putc(symbol->type, file);
+	if (symbol->type != SYMTYPE_IMPORT) {
+		writeLong(getRelocNodeID(reloc, symbol->src), file);
+		writeLong(symbol->lineNo, file);
+		/* Symbols in fragments have already been rebased onto their section */
+		writeLong(symbol->section ? getRelocSectionID(reloc, symbol->section) : -1, file);
+		writeLong(symbol->offset, file);
+	}
+}
+
+static void writeRelocSection(struct Relocatable *reloc, struct Section const *section)
+{
+	FILE *file = reloc->file;
+	uint8_t alignment = 0;
+
+	while (section->isAlignFixed && alignment < 16 && section->alignMask >> alignment & 1)
+		alignment++;
+
+	writeString(section->name, file);
+	writeLong(section->size, file);
+	putc(section->type | (section->modifier == SECTION_UNION) << 7
+			   | (section->modifier == SECTION_FRAGMENT) << 6, file);
+	writeLong(section->isAddressFixed ? section->org : -1, file);
+	writeLong(section->isBankFixed ? section->bank : -1, file);
+	putc(alignment, file);
+	writeLong(section->alignOfs, file);
+
+	if (!sect_HasData(section->type))
+		return;
+
+	/* The fragments' data has already been concatenated, but not their patches */
+	uint32_t nbPatches = 0;
+
+	fwrite(section->data, 1, section->size, file);
+	for (struct Section const *part = section; part; part = part->nextu)
+		nbPatches += part->nbPatches;
+	writeLong(nbPatches, file);
+	for (struct Section const *part = section; part; part = part->nextu) {
+		for (uint32_t i = 0; i < part->nbPatches; i++)
+			writeRelocPatch(reloc, &part->patches[i], part->fileSymbols, part->offset);
+	}
+}
+
+struct RelocSections {
+	struct Section **sections;
+	uint32_t nbSections;
+	uint32_t capacity;
+};
+
+static void collectRelocSection(struct Section *section, void *arg)
+{
+	struct RelocSections *list = arg;
+
+	if (list->nbSections == list->capacity) {
+		list->capacity = list->capacity ? list->capacity * 2 : 64;
+		list->sections = realloc(list->sections,
+					 sizeof(*list->sections) * list->capacity);
+		if (!list->sections)
+			err(1, "Failed to collect sections");
+	}
+	list->sections[list->nbSections++] = section;
+}
+
+void obj_WriteRelocatable(char const *fileName)
+{
+	struct Relocatable reloc = { .file = NULL };
+
+	/* Number the file stack nodes, keeping each file's nodes together */
+	uint32_t nbNodes = 0;
+
+	reloc.nodeBases = malloc(sizeof(*reloc.nodeBases) * (nbObjFiles ? nbObjFiles : 1));
+	if (!reloc.nodeBases)
+		err(1, "Failed to number the file stack nodes");
+	for (unsigned int i = 0; i < nbObjFiles; i++) {
+		reloc.nodeBases[i] = nbNodes;
+		nbNodes += nodes[i].nbNodes;
+	}
+
+	/* Number the sections; only the one merging all of its fragments is written */
+	struct RelocSections list = { .sections = NULL, .nbSections = 0, .capacity = 0 };
+
+	sect_ForEach(collectRelocSection, &list);
+
+	uint32_t *sectionIDs = malloc(sizeof(*sectionIDs) * (list.nbSections + 1));
+
+	if (!sectionIDs)
+		err(1, "Failed to number the sections");
+	for (uint32_t i = 0; i < list.nbSections; i++) {
+		sectionIDs[i] = i;
+		hash_AddElement(reloc.sectionIDs, list.sections[i]->name, &sectionIDs[i]);
+	}
+
+	/* Gather the files' symbol tables, in the order they were read */
+	reloc.nbFiles = 0;
+	for (struct SymbolList *symList = symbolLists; symList; symList = symList->next)
+		reloc.nbFiles++;
+	reloc.files = malloc(sizeof(*reloc.files) * (reloc.nbFiles + 1));
+	if (!reloc.files)
+		err(1, "Failed to number the symbols");
+
+	size_t maxSymbols = 0;
+	size_t i = reloc.nbFiles;
+
+	for (struct SymbolList *symList = symbolLists; symList; symList = symList->next) {
+		i--;
+		reloc.files[i].fileSymbols = symList->symbolList;
+		reloc.files[i].nbSymbols = symList->nbSymbols;
+		reloc.files[i].IDs = malloc(sizeof(*reloc.files[i].IDs) * symList->nbSymbols + 1);
+		if (!reloc.files[i].IDs)
+			err(1, "Failed to number the symbols");
+		maxSymbols += symList->nbSymbols;
+	}
+
+	struct Symbol const **symbols = malloc(sizeof(*symbols) * maxSymbols + 1);
+	uint32_t nbSymbols = 0;
+	/* Maps the names of exported symbols, then of imported ones, to their ID */
+	HashMap globalIDs = {0};
+
+	if (!symbols)
+		err(1, "Failed to number the symbols");
+	for (i = 0; i < reloc.nbFiles; i++) {
+		for (size_t j = 0; j < reloc.files[i].nbSymbols; j++) {
+			struct Symbol const *symbol = reloc.files[i].fileSymbols[j];
+
+			if (symbol->type == SYMTYPE_IMPORT)
+				continue;
+			reloc.files[i].IDs[j] = nbSymbols;
+			symbols[nbSymbols++] = symbol;
+			if (symbol->type == SYMTYPE_EXPORT)
+				hash_AddElement(globalIDs, symbol->name, &reloc.files[i].IDs[j]);
+		}
+	}
+	/* Imports defined by another of the files are resolved, the others merged */
+	for (i = 0; i < reloc.nbFiles; i++) {
+		for (size_t j = 0; j < reloc.files[i].nbSymbols; j++) {
+			struct Symbol const *symbol = reloc.files[i].fileSymbols[j];
+
+			if (symbol->type != SYMTYPE_IMPORT)
+				continue;
+
+			uint32_t const *ID = hash_GetElement(globalIDs, symbol->name);
+
+			if (ID) {
+				reloc.files[i].IDs[j] = *ID;
+			} else {
+				reloc.files[i].IDs[j] = nbSymbols;
+				symbols[nbSymbols++] = symbol;
+				hash_AddElement(globalIDs, symbol->name, &reloc.files[i].IDs[j]);
+			}
+		}
+	}
+	hash_EmptyMap(globalIDs);
+
+	reloc.file = openFile(fileName, "wb");
+	fprintf(reloc.file, RGBDS_OBJECT_VERSION_STRING, RGBDS_OBJECT_VERSION_NUMBER);
+	writeLong(RGBDS_OBJECT_REV, reloc.file);
+	writeLong(nbSymbols, reloc.file);
+	writeLong(list.nbSections, reloc.file);
+
+	/* Nodes are read in decreasing ID order */
+	writeLong(nbNodes, reloc.file);
+	for (unsigned int fileID = nbObjFiles; fileID--; ) {
+		for (uint32_t j = nodes[fileID].nbNodes; j--; ) {
+			struct FileStackNode const *node = &nodes[fileID].nodes[j];
+
+			writeLong(node->parent ? getRelocNodeID(&reloc, node->parent) : -1,
+				  reloc.file);
+			writeLong(node->lineNo, reloc.file);
+			putc(node->type, reloc.file);
+			if (node->type != NODE_REPT) {
+				writeString(node->name, reloc.file);
+			} else {
+				writeLong(node->reptDepth, reloc.file);
+				for (uint32_t k = 0; k < node->reptDepth; k++)
+					writeLong(node->iters[k], reloc.file);
+			}
+		}
+	}
+
+	for (uint32_t j = 0; j < nbSymbols; j++)
+		writeRelocSymbol(&reloc, symbols[j]);
+	for (uint32_t j = 0; j < list.nbSections; j++)
+		writeRelocSection(&reloc, list.sections[j]);
+
+	/* Write the assertions in the order they were read */
+	uint32_t nbAsserts = 0;
+
+	for (struct Assertion const *assert = assertions; assert; assert = assert->next)
+		nbAsserts++;
+
+	struct Assertion const **asserts = malloc(sizeof(*asserts) * nbAsserts + 1);
+
+	if (!asserts)
+		err(1, "Failed to collect assertions");
+	nbAsserts = 0;
+	for (struct Assertion const *assert = assertions; assert; assert = assert->next)
+		asserts[nbAsserts++] = assert;
+	writeLong(nbAsserts, reloc.file);
+	while (nbAsserts--) {
+		writeRelocPatch(&reloc, &asserts[nbAsserts]->patch,
+				asserts[nbAsserts]->fileSymbols, 0);
+		writeString(asserts[nbAsserts]->message, reloc.file);
+	}
+	free(asserts);
+
+	if (fclose(reloc.file) != 0)
+		err(1, "Cannot write %s", fileName);
+
+	hash_EmptyMap(reloc.sectionIDs);
+	free(sectionIDs);
+	free(list.sections);
+	for (i = 0; i < reloc.nbFiles; i++)
+		free(reloc.files[i].IDs);
+	free(reloc.files);
+	free(symbols);
+	free(reloc.nodeBases);
+}
+
 static void freeSection(struct Section *section, void *arg)
 {
 	(void)arg;
 
-	free(section->name);
-	if (sect_HasData(section->type)) {
-		free(section->data);
-		for (int32_t i = 0; i < section->nbPatches; i++)
-			free(section->patches[i].rpnExpression);
-		free(section->patches);
-	}
-	free(section->symbols);
-	free(section);
+	sect_FreeSection(section);
 }
 
 static void freeSymbol(struct Symbol *symbol)
@@ -660,6 +1402,20 @@ void obj_Cleanup(void)
 	}
 	free(nodes);
 
+	hash_EmptyMap(libraryIndex);
+	while (libraries) {
+		struct Library *next = libraries->next;
+
+		for (uint32_t i = 0; i < libraries->nbMembers; i++)
+			free(libraries->members[i].name);
+		free(libraries->members);
+		for (uint32_t i = 0; i < libraries->nbSymbols; i++)
+			free(libraries->symbolNames[i]);
+		free(libraries->symbolNames);
+		free(libraries);
+		libraries = next;
+	}
+
 	sym_CleanupSymbols();
 
 	sect_ForEach(freeSection, NULL);
@@ -7,23 +7,30 @@
  */
 
 #include <inttypes.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "link/output.h"
 #include "link/main.h"
 #include "link/section.h"
+#include "link/state.h"
 #include "link/symbol.h"
 
 #include "extern/err.h"
 
+#include "helpers.h"
 #include "linkdefs.h"
+#include "parallel.h"
 
 #include "platform.h" // MIN_NB_ELMS
+#include "romheader.h"
 
 #define BANK_SIZE 0x4000
 
 FILE *outputFile;
+static bool isUpdatingOutput; /* Only the banks that changed are written */
 FILE *overlayFile;
 FILE *symFile;
 FILE *mapFile;
@@ -53,6 +60,48 @@ static enum SectionType typeMap[SECTTYPE_INVALID] = {
 	SECTTYPE_HRAM
 };
 
+/* Text formatted ahead of being written to the sym or map file */
+struct Text {
+	FILE *file; /* If non-NULL, the text is written there directly instead */
+	char *data;
+	size_t len;
+	size_t capacity;
+};
+
+static format_(printf, 2, 3) void textPrintf(struct Text *text, char const *fmt, ...)
+{
+	va_list ap;
+
+	if (text->file) {
+		va_start(ap, fmt);
+		vfprintf(text->file, fmt, ap);
+		va_end(ap);
+		return;
+	}
+
+	va_start(ap, fmt);
+	int len = vsnprintf(NULL, 0, fmt, ap);
+
+	va_end(ap);
+	if (len < 0)
+		err(1, "Failed to format output text");
+
+	if (text->len + len + 1 > text->capacity) {
+		if (!text->capacity)
+			text->capacity = 256;
+		while (text->len + len + 1 > text->capacity)
+			text->capacity *= 2;
+		text->data = realloc(text->data, text->capacity);
+		if (!text->data)
+			err(1, "Failed to grow output text");
+	}
+
+	va_start(ap, fmt);
+	vsnprintf(&text->data[text->len], len + 1, fmt, ap);
+	va_end(ap);
+	text->len += len;
+}
+
 void out_AddSection(struct Section const *section)
 {
 	static uint32_t maxNbBanks[] = {
@@ -181,74 +230,164 @@ static void coverOverlayBanks(uint32_t nbOverlayBanks)
 }
 
 /**
- * Write a ROM bank's sections to the output file.
+ * Renders a ROM bank's sections, along with the padding between them.
+ * @param bank The buffer to render the bank into, `size` bytes large
  * @param bankSections The bank's sections, ordered by increasing address
  * @param baseOffset The address of the bank's first byte in GB address space
  * @param size The size of the bank
+ * @return How many bytes of the bank are to be output
  */
-static void writeBank(struct SortedSection *bankSections, uint16_t baseOffset,
-		      uint16_t size)
+static uint16_t renderBank(uint8_t *bank, struct SortedSection *bankSections,
+			   uint16_t baseOffset, uint16_t size)
 {
-	uint16_t offset = 0;
-
-	while (bankSections) {
-		struct Section const *section = bankSections->section;
+	/* Lay down what goes between the sections first... */
+	if (overlayFile) {
+		size_t nbRead = fread(bank, sizeof(*bank), size, overlayFile);
+
+		/* A short overlay file reads as $FF past its end */
+		memset(&bank[nbRead], 0xFF, size - nbRead);
+	} else {
+		memset(bank, padValue, size);
+	}
 
-		/* Output padding up to the next SECTION */
-		while (offset + baseOffset < section->org) {
-			putc(overlayFile ? getc(overlayFile) : padValue,
-			     outputFile);
-			offset++;
-		}
+	/* ...then the sections on top of it */
+	uint16_t len = 0;
 
-		/* Output the section itself */
-		fwrite(section->data, sizeof(*section->data), section->size,
-		       outputFile);
-		if (overlayFile) {
-			/* Skip bytes even with pipes */
-			for (uint16_t i = 0; i < section->size; i++)
-				getc(overlayFile);
-		}
-		offset += section->size;
+	for (; bankSections; bankSections = bankSections->next) {
+		struct Section const *section = bankSections->section;
+		uint16_t offset = section->org - baseOffset;
 
-		bankSections = bankSections->next;
+		memcpy(&bank[offset], section->data, section->size);
+		len = offset + section->size;
 	}
 
-	if (!disablePadding) {
-		while (offset < size) {
-			putc(overlayFile ? getc(overlayFile)
-					 : padValue,
-			     outputFile);
-			offset++;
-		}
-	}
+	return disablePadding ? len : size;
 }
 
 /**
- * Writes a ROM file to the output.
+ * Computes how many bytes of a bank are to be output, without rendering it.
+ * @param bankSections The bank's sections, ordered by increasing address
+ * @param baseOffset The address of the bank's first byte in GB address space
+ * @param size The size of the bank
  */
-static void writeROM(void)
+static uint16_t bankLength(struct SortedSection const *bankSections, uint16_t baseOffset,
+			   uint16_t size)
 {
-	outputFile = openFile(outputFileName, "wb");
-	overlayFile = openFile(overlayFileName, "rb");
+	if (!disablePadding)
+		return size;
 
-	uint32_t nbOverlayBanks = checkOverlaySize();
+	uint16_t len = 0;
 
-	if (nbOverlayBanks > 0)
-		coverOverlayBanks(nbOverlayBanks);
+	/* Sections don't overlap, so the last one ends last */
+	for (; bankSections; bankSections = bankSections->next)
+		len = bankSections->section->org - baseOffset + bankSections->section->size;
+	return len;
+}
+
+/**
+ * Writes a ROM bank to the output, unless it's already there.
+ * @param index The index of the bank in the output, ROM0 being 0
+ * @param bank The bank's contents
+ * @param len The length of the bank
+ * @param offset Where the bank goes in the output
+ */
+static void writeBank(uint32_t index, uint8_t const *bank, uint16_t len, long offset)
+{
+	if (!state_UpdateBank(index, bank, len))
+		return;
+	if (isUpdatingOutput && fseek(outputFile, offset, SEEK_SET) != 0)
+		err(1, "Failed to seek to bank %" PRIu32 " of the output", index);
+	fwrite(bank, sizeof(*bank), len, outputFile);
+}
 
+/**
+ * Writes a ROM file to the output, fixing its header if requested.
+ */
+static void writeROM(void)
+{
 	if (outputFile) {
+		uint8_t rom0[0x8000]; /* ROM0 spans two banks in tiny mode */
+		uint16_t rom0Len = 0;
+
 		if (sections[SECTTYPE_ROM0].nbBanks > 0)
-			writeBank(sections[SECTTYPE_ROM0].banks[0].sections,
-				  startaddr[SECTTYPE_ROM0], maxsize[SECTTYPE_ROM0]);
+			rom0Len = renderBank(rom0, sections[SECTTYPE_ROM0].banks[0].sections,
+					     startaddr[SECTTYPE_ROM0], maxsize[SECTTYPE_ROM0]);
+
+		bool fixGlobalSum = hdr_FixesGlobalSum();
+		uint16_t globalSum = 0;
+
+		if (hdr_IsFixing()) {
+			if (rom0Len < HEADER_SIZE)
+				errx(1, "Cannot fix the header of a ROM smaller than $%x bytes",
+				     HEADER_SIZE);
+			hdr_FixFields(rom0);
+			hdr_FixHeaderSum(rom0);
+		}
+		if (fixGlobalSum) {
+			/* Computation of the global checksum assumes 0s being stored in its place */
+			rom0[0x14e] = 0;
+			rom0[0x14f] = 0;
+			globalSum = hdr_SumBytes(rom0, rom0Len);
+		}
 
-		for (uint32_t i = 0 ; i < sections[SECTTYPE_ROMX].nbBanks; i++)
-			writeBank(sections[SECTTYPE_ROMX].banks[i].sections,
-				  startaddr[SECTTYPE_ROMX], maxsize[SECTTYPE_ROMX]);
-	}
+		/*
+		 * The global checksum is only known once all banks have been rendered, but it's
+		 * stored in ROM0; so either patch it in afterwards, or if the output file is not
+		 * seekable, hold off writing anything until then.
+		 */
+		bool deferOutput = fixGlobalSum && fseek(outputFile, 0, SEEK_CUR) != 0;
+		uint32_t nbRomxBanks = sections[SECTTYPE_ROMX].nbBanks;
+		uint8_t *romx = NULL;
+		size_t romxLen = 0;
+		uint8_t bank[BANK_SIZE];
+
+		if (deferOutput) {
+			romx = malloc((size_t)nbRomxBanks * BANK_SIZE);
+			if (!romx && nbRomxBanks)
+				err(1, "Failed to allocate ROMX buffer");
+		} else if (!isUpdatingOutput) {
+			/* When updating the output, ROM0 is written last, checksum included */
+			fwrite(rom0, sizeof(*rom0), rom0Len, outputFile);
+		}
 
-	closeFile(outputFile);
-	closeFile(overlayFile);
+		long offset = rom0Len;
+
+		for (uint32_t i = 0 ; i < nbRomxBanks; i++) {
+			uint8_t *dest = deferOutput ? &romx[romxLen] : bank;
+			uint16_t bankLen = renderBank(dest, sections[SECTTYPE_ROMX].banks[i].sections,
+						      startaddr[SECTTYPE_ROMX],
+						      maxsize[SECTTYPE_ROMX]);
+
+			if (fixGlobalSum)
+				globalSum += hdr_SumBytes(dest, bankLen);
+			if (deferOutput) {
+				state_UpdateBank(i + 1, dest, bankLen);
+				romxLen += bankLen;
+			} else {
+				writeBank(i + 1, bank, bankLen, offset);
+			}
+			offset += bankLen;
+		}
+
+		if (fixGlobalSum) {
+			hdr_FixGlobalSum(rom0, globalSum);
+			if (deferOutput) {
+				fwrite(rom0, sizeof(*rom0), rom0Len, outputFile);
+				fwrite(romx, sizeof(*romx), romxLen, outputFile);
+			} else if (isUpdatingOutput) {
+				/* ROM0 is written below */
+			} else if (fseek(outputFile, 0x14e, SEEK_SET) == 0) {
+				fwrite(&rom0[0x14e], sizeof(*rom0), 2, outputFile);
+			} else {
+				err(1, "Failed to write global checksum");
+			}
+		}
+		if (isUpdatingOutput)
+			writeBank(0, rom0, rom0Len, 0);
+		else
+			state_UpdateBank(0, rom0, rom0Len);
+		free(romx);
+	}
 }
 
 /**
@@ -270,13 +409,11 @@ static struct SortedSection const **nextSection(struct SortedSection const **s1,
 
 /**
  * Write a bank's contents to the sym file
+ * @param text The text to append the bank's symbols to
  * @param bankSections The bank's sections
  */
-static void writeSymBank(struct SortedSections const *bankSections)
+static void writeSymBank(struct Text *text, struct SortedSections const *bankSections)
 {
-	if (!symFile)
-		return;
-
 	struct {
 		struct SortedSection const *sections;
 #define sect sections->section /* Fake member as a shortcut */
@@ -325,9 +462,9 @@ static void writeSymBank(struct SortedSections const *bankSections)
 
 			minSectList = &zlSectList;
 		}
-		fprintf(symFile, "%02" PRIx32 ":%04" PRIx16 " %s\n",
-			minSectList->sect->bank, minSectList->addr,
-			minSectList->sym->name);
+		textPrintf(text, "%02" PRIx32 ":%04" PRIx16 " %s\n",
+			   minSectList->sect->bank, minSectList->addr,
+			   minSectList->sym->name);
 		minSectList->i++;
 	}
 #undef sect
@@ -335,20 +472,18 @@ static void writeSymBank(struct SortedSections const *bankSections)
 
 /**
  * Write a bank's contents to the map file
+ * @param text The text to append the bank's description to
  * @param bankSections The bank's sections
  * @return The bank's slack space
  */
-static uint16_t writeMapBank(struct SortedSections const *sectList,
+static uint16_t writeMapBank(struct Text *text, struct SortedSections const *sectList,
 			     enum SectionType type, uint32_t bank)
 {
-	if (!mapFile)
-		return 0;
-
 	struct SortedSection const *section        = sectList->sections;
 	struct SortedSection const *zeroLenSection = sectList->zeroLenSections;
 
-	fprintf(mapFile, "%s bank #%" PRIu32 ":\n", typeNames[type],
-		bank + bankranges[type][0]);
+	textPrintf(text, "%s bank #%" PRIu32 ":\n", typeNames[type],
+		   bank + bankranges[type][0]);
 
 	uint16_t slack = maxsize[type];
 
@@ -360,27 +495,31 @@ static uint16_t writeMapBank(struct SortedSections const *sectList,
 		slack -= sect->size;
 
 		if (sect->size != 0)
-			fprintf(mapFile, "  SECTION: $%04" PRIx16 "-$%04" PRIx16 " ($%04" PRIx16 " byte%s) [\"%s\"]\n",
-				sect->org, sect->org + sect->size - 1,
-				sect->size, sect->size == 1 ? "" : "s",
-				sect->name);
+			textPrintf(text, "  SECTION: $%04" PRIx16 "-$%04" PRIx16 " ($%04" PRIx16 " byte%s) [\"%s\"]\n",
+				   sect->org, sect->org + sect->size - 1,
+				   sect->size, sect->size == 1 ? "" : "s",
+				   sect->name);
 		else
-			fprintf(mapFile, "  SECTION: $%04" PRIx16 " (0 bytes) [\"%s\"]\n",
-				sect->org, sect->name);
+			textPrintf(text, "  SECTION: $%04" PRIx16 " (0 bytes) [\"%s\"]\n",
+				   sect->org, sect->name);
 
 		for (size_t i = 0; i < sect->nbSymbols; i++)
-			fprintf(mapFile, "           $%04" PRIx32 " = %s\n",
-				sect->symbols[i]->offset + sect->org,
-				sect->symbols[i]->name);
+			textPrintf(text, "           $%04" PRIx32 " = %s\n",
+				   sect->symbols[i]->offset + sect->org,
+				   sect->symbols[i]->name);
+
+		for (struct Section const *folded = sect->folded; folded;
+		     folded = folded->folded)
+			textPrintf(text, "           FOLDED: [\"%s\"]\n", folded->name);
 
 		*pickedSection = (*pickedSection)->next;
 	}
 
 	if (slack == maxsize[type])
-		fputs("  EMPTY\n\n", mapFile);
+		textPrintf(text, "  EMPTY\n\n");
 	else
-		fprintf(mapFile, "    SLACK: $%04" PRIx16 " byte%s\n\n", slack,
-			slack == 1 ? "" : "s");
+		textPrintf(text, "    SLACK: $%04" PRIx16 " byte%s\n\n", slack,
+			   slack == 1 ? "" : "s");
 
 	return slack;
 }
@@ -409,39 +548,14 @@ static void writeMapSlack(uint32_t slackMap[MIN_NB_ELMS(SECTTYPE_INVALID)])
 				sections[type].nbBanks, sections[type].nbBanks == 1 ? "" : "s");
 		}
 	}
-}
-
-/**
- * Writes the sym and/or map files, if applicable.
- */
-static void writeSymAndMap(void)
-{
-	if (!symFileName && !mapFileName)
-		return;
 
-	uint32_t slackMap[SECTTYPE_INVALID] = {0};
+	uint32_t nbFolded;
+	uint32_t foldedSize = sect_GetFoldedSize(&nbFolded);
 
-	symFile = openFile(symFileName, "w");
-	mapFile = openFile(mapFileName, "w");
-
-	if (symFileName)
-		fputs("; File generated by rgblink\n", symFile);
-
-	for (uint8_t i = 0; i < SECTTYPE_INVALID; i++) {
-		enum SectionType type = typeMap[i];
-
-		for (uint32_t bank = 0; bank < sections[type].nbBanks; bank++) {
-			struct SortedSections const *sect = &sections[type].banks[bank];
-
-			writeSymBank(sect);
-			slackMap[type] += writeMapBank(sect, type, bank);
-		}
-	}
-
-	writeMapSlack(slackMap);
-
-	closeFile(symFile);
-	closeFile(mapFile);
+	if (nbFolded)
+		fprintf(mapFile, "FOLDED:\n    $%04" PRIx32 " byte%s in %" PRIu32 " section%s\n",
+			foldedSize, foldedSize == 1 ? "" : "s",
+			nbFolded, nbFolded == 1 ? "" : "s");
 }
 
 static void cleanupSections(struct SortedSection *section)
@@ -470,10 +584,130 @@ static void cleanup(void)
 	}
 }
 
+/* The sym and map file contents of a single bank */
+struct BankOutput {
+	enum SectionType type;
+	uint32_t bank;
+	struct Text sym;
+	struct Text map;
+	uint16_t slack;
+};
+
+/**
+ * Formats one of the outputs; the first task writes the ROM, the others format a bank each.
+ */
+static void writeOutput(size_t index, void *arg)
+{
+	struct BankOutput *banks = arg;
+
+	if (index == 0) {
+		writeROM();
+		return;
+	}
+
+	struct BankOutput *output = &banks[index - 1];
+	struct SortedSections const *sect = &sections[output->type].banks[output->bank];
+
+	if (symFile)
+		writeSymBank(&output->sym, sect);
+	if (mapFile)
+		output->slack = writeMapBank(&output->map, sect, output->type, output->bank);
+}
+
+static void writeText(struct Text *text, FILE *file)
+{
+	if (file && text->len)
+		fwrite(text->data, sizeof(*text->data), text->len, file);
+	free(text->data);
+}
+
 void out_WriteFiles(void)
 {
-	writeROM();
-	writeSymAndMap();
+	overlayFile = openFile(overlayFileName, "rb");
+
+	/* This may add banks, so it must be done before anything reads them */
+	uint32_t nbOverlayBanks = checkOverlaySize();
+
+	if (nbOverlayBanks > 0)
+		coverOverlayBanks(nbOverlayBanks);
+
+	/* With a state file, the output may be updated instead of being rewritten */
+	if (stateFileName && outputFileName) {
+		uint32_t nbRomBanks = 1 + sections[SECTTYPE_ROMX].nbBanks;
+		uint16_t *bankLens = malloc(sizeof(*bankLens) * nbRomBanks);
+
+		if (!bankLens)
+			err(1, "Failed to allocate the output's banks");
+		bankLens[0] = sections[SECTTYPE_ROM0].nbBanks == 0 ? 0
+			: bankLength(sections[SECTTYPE_ROM0].banks[0].sections,
+				     startaddr[SECTTYPE_ROM0], maxsize[SECTTYPE_ROM0]);
+		for (uint32_t i = 1; i < nbRomBanks; i++)
+			bankLens[i] = bankLength(sections[SECTTYPE_ROMX].banks[i - 1].sections,
+						 startaddr[SECTTYPE_ROMX], maxsize[SECTTYPE_ROMX]);
+		isUpdatingOutput = state_CanUpdateOutput(outputFileName, bankLens, nbRomBanks);
+		free(bankLens);
+	}
+
+	outputFile = openFile(outputFileName, isUpdatingOutput ? "r+b" : "wb");
+	symFile = openFile(symFileName, "w");
+	mapFile = openFile(mapFileName, "w");
+
+	/*
+	 * The outputs only read the sections from here on, so the ROM is written while the
+	 * banks' sym and map contents are formatted in parallel, then written in order.
+	 * On a single thread, the tasks run in order, so the text is written directly.
+	 */
+	bool isStreaming = nbThreads == 1;
+	size_t nbBanks = 0;
+
+	if (symFile || mapFile) {
+		for (enum SectionType type = 0; type < SECTTYPE_INVALID; type++)
+			nbBanks += sections[type].nbBanks;
+	}
+
+	struct BankOutput *banks = malloc(sizeof(*banks) * nbBanks);
+
+	if (!banks && nbBanks)
+		err(1, "Failed to allocate sym and map outputs");
+
+	size_t nbOutputs = 0;
+
+	for (uint8_t i = 0; nbBanks && i < SECTTYPE_INVALID; i++) {
+		enum SectionType type = typeMap[i];
+
+		for (uint32_t bank = 0; bank < sections[type].nbBanks; bank++)
+			banks[nbOutputs++] = (struct BankOutput){
+				.type = type,
+				.bank = bank,
+				.sym = { .file = isStreaming ? symFile : NULL,
+					 .data = NULL, .len = 0, .capacity = 0 },
+				.map = { .file = isStreaming ? mapFile : NULL,
+					 .data = NULL, .len = 0, .capacity = 0 },
+				.slack = 0
+			};
+	}
+
+	if (symFile)
+		fputs("; File generated by rgblink\n", symFile);
+
+	par_Run(nbBanks + 1, nbThreads, writeOutput, banks);
+
+	closeFile(outputFile);
+	closeFile(overlayFile);
+
+	uint32_t slackMap[SECTTYPE_INVALID] = {0};
+
+	for (size_t i = 0; i < nbBanks; i++) {
+		writeText(&banks[i].sym, symFile);
+		writeText(&banks[i].map, mapFile);
+		slackMap[banks[i].type] += banks[i].slack;
+	}
+	free(banks);
+
+	writeMapSlack(slackMap);
+
+	closeFile(symFile);
+	closeFile(mapFile);
 
 	cleanup();
 }
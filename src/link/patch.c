@@ -81,6 +81,8 @@ static void pushRPN(int32_t value, bool comesFromError)
 // This flag tracks whether the RPN op that is currently being evaluated
 // has popped any values with the error flag set.
 static bool isError = false;
+// Set while relaxing jumps, whose errors are reported when patching instead
+static bool isQuiet = false;
 
 static int32_t popRPN(struct FileStackNode const *node, uint32_t lineNo)
 {
@@ -135,6 +137,10 @@ static int32_t computeRPNExpr(struct Patch const *patch,
 {
 /* Small shortcut to avoid a lot of repetition */
 #define popRPN() popRPN(patch->src, patch->lineNo)
+#define error(...) do { \
+		if (!isQuiet) \
+			error(__VA_ARGS__); \
+	} while (0)
 
 	uint8_t const *expression = patch->rpnExpression;
 	int32_t size = patch->rpnSize;
@@ -396,6 +402,210 @@ static int32_t computeRPNExpr(struct Patch const *patch,
 	return popRPN();
 
 #undef popRPN
+#undef error
+}
+
+void patch_ForEachSectionRef(struct Patch const *patch,
+			     struct Symbol const * const *fileSymbols,
+			     void (*callback)(struct Section *section))
+{
+	uint8_t const *expression = patch->rpnExpression;
+	int32_t size = patch->rpnSize;
+
+	while (size > 0) {
+		enum RPNCommand command = getRPNByte(&expression, &size,
+						     patch->src, patch->lineNo);
+		int32_t value;
+		char const *name;
+		struct Symbol const *symbol;
+		struct Section *sect;
+
+		switch (command) {
+		case RPN_CONST:
+			for (uint8_t shift = 0; shift < 32; shift += 8)
+				getRPNByte(&expression, &size, patch->src, patch->lineNo);
+			break;
+
+		case RPN_SYM:
+		case RPN_BANK_SYM:
+			value = 0;
+			for (uint8_t shift = 0; shift < 32; shift += 8)
+				value |= getRPNByte(&expression, &size,
+						    patch->src, patch->lineNo) << shift;
+
+			if (value == -1) { /* PC */
+				if (patch->pcSection)
+					callback(patch->pcSection);
+			} else {
+				symbol = getSymbol(fileSymbols, value);
+				/* Unknown symbols are reported when patching */
+				if (symbol && symbol->section)
+					callback(symbol->section);
+			}
+			break;
+
+		case RPN_BANK_SECT:
+			name = (char const *)expression;
+			while (getRPNByte(&expression, &size, patch->src, patch->lineNo))
+				;
+
+			sect = sect_GetSection(name);
+			if (sect)
+				callback(sect);
+			break;
+
+		case RPN_BANK_SELF:
+			if (patch->pcSection)
+				callback(patch->pcSection);
+			break;
+
+		/* The other commands don't refer to anything */
+		case RPN_ADD:
+		case RPN_SUB:
+		case RPN_MUL:
+		case RPN_DIV:
+		case RPN_MOD:
+		case RPN_UNSUB:
+		case RPN_EXP:
+		case RPN_OR:
+		case RPN_AND:
+		case RPN_XOR:
+		case RPN_UNNOT:
+		case RPN_LOGAND:
+		case RPN_LOGOR:
+		case RPN_LOGUNNOT:
+		case RPN_LOGEQ:
+		case RPN_LOGNE:
+		case RPN_LOGGT:
+		case RPN_LOGLT:
+		case RPN_LOGGE:
+		case RPN_LOGLE:
+		case RPN_SHL:
+		case RPN_SHR:
+		case RPN_HRAM:
+		case RPN_RST:
+			break;
+		}
+	}
+}
+
+/**
+ * Checks whether two symbols have the same value, once their sections have
+ * been folded together
+ */
+static bool areSymbolsEquivalent(struct Symbol const *symbol1,
+				 struct Section const *section1,
+				 struct Symbol const *symbol2,
+				 struct Section const *section2)
+{
+	/* Unknown symbols are reported when patching, don't fold them */
+	if (!symbol1 || !symbol2)
+		return false;
+	if (symbol1 == symbol2)
+		return true;
+	if (!symbol1->section && !symbol2->section)
+		return symbol1->value == symbol2->value;
+	/* Labels at the same place, e.g. in a section that duplicates were folded into */
+	if (symbol1->section == symbol2->section && symbol1->offset == symbol2->offset)
+		return true;
+	/* Labels inside the sections themselves, e.g. loops */
+	return symbol1->section == section1 && symbol2->section == section2
+		&& symbol1->offset == symbol2->offset;
+}
+
+bool patch_AreEquivalent(struct Patch const *patch1, struct Section const *section1,
+			 struct Patch const *patch2, struct Section const *section2)
+{
+	if (patch1->offset != patch2->offset || patch1->type != patch2->type
+	 || patch1->pcOffset != patch2->pcOffset || patch1->rpnSize != patch2->rpnSize)
+		return false;
+	if (patch1->pcSection != patch2->pcSection
+	 && (patch1->pcSection != section1 || patch2->pcSection != section2))
+		return false;
+
+	uint8_t const *expression1 = patch1->rpnExpression;
+	uint8_t const *expression2 = patch2->rpnExpression;
+	int32_t size1 = patch1->rpnSize;
+	int32_t size2 = patch2->rpnSize;
+
+	while (size1 > 0) {
+		enum RPNCommand command = getRPNByte(&expression1, &size1,
+						     patch1->src, patch1->lineNo);
+		int32_t id1 = 0, id2 = 0;
+
+		if (getRPNByte(&expression2, &size2, patch2->src, patch2->lineNo) != command)
+			return false;
+
+		switch (command) {
+		case RPN_CONST:
+			for (uint8_t i = 0; i < 4; i++) {
+				if (getRPNByte(&expression1, &size1, patch1->src, patch1->lineNo)
+				 != getRPNByte(&expression2, &size2, patch2->src, patch2->lineNo))
+					return false;
+			}
+			break;
+
+		case RPN_SYM:
+		case RPN_BANK_SYM:
+			for (uint8_t shift = 0; shift < 32; shift += 8) {
+				id1 |= getRPNByte(&expression1, &size1,
+						  patch1->src, patch1->lineNo) << shift;
+				id2 |= getRPNByte(&expression2, &size2,
+						  patch2->src, patch2->lineNo) << shift;
+			}
+
+			if (id1 == -1 || id2 == -1) { /* PC, checked above */
+				if (id1 != id2)
+					return false;
+			} else if (!areSymbolsEquivalent(getSymbol((struct Symbol const * const *)
+									section1->fileSymbols, id1),
+							 section1,
+							 getSymbol((struct Symbol const * const *)
+									section2->fileSymbols, id2),
+							 section2)) {
+				return false;
+			}
+			break;
+
+		case RPN_BANK_SECT:
+			do {
+				if (getRPNByte(&expression2, &size2, patch2->src, patch2->lineNo)
+				 != *expression1)
+					return false;
+			} while (getRPNByte(&expression1, &size1, patch1->src, patch1->lineNo));
+			break;
+
+		/* The other commands have no operands */
+		case RPN_ADD:
+		case RPN_SUB:
+		case RPN_MUL:
+		case RPN_DIV:
+		case RPN_MOD:
+		case RPN_UNSUB:
+		case RPN_EXP:
+		case RPN_OR:
+		case RPN_AND:
+		case RPN_XOR:
+		case RPN_UNNOT:
+		case RPN_LOGAND:
+		case RPN_LOGOR:
+		case RPN_LOGUNNOT:
+		case RPN_LOGEQ:
+		case RPN_LOGNE:
+		case RPN_LOGGT:
+		case RPN_LOGLT:
+		case RPN_LOGGE:
+		case RPN_LOGLE:
+		case RPN_SHL:
+		case RPN_SHR:
+		case RPN_BANK_SELF:
+		case RPN_HRAM:
+		case RPN_RST:
+			break;
+		}
+	}
+
+	return true;
 }
 
 void patch_CheckAssertions(struct Assertion *assert)
@@ -442,6 +652,288 @@ void patch_CheckAssertions(struct Assertion *assert)
 	freeRPNStack();
 }
 
+/* A `jp` that the linker may shorten to a `jr` */
+struct RelaxableJump {
+	struct Patch *patch;
+	uint16_t offset; /* The opcode's offset in the section, before relaxing */
+	bool isShort;
+	bool isPinned; /* Lengthened back after being shortened, so it stays long */
+};
+
+struct RelaxableSection {
+	struct Section *section;
+	uint16_t size; /* Before relaxing */
+	int32_t *symbolOffsets; /* Before relaxing */
+	struct RelaxableJump *jumps; /* Sorted by offset */
+	uint32_t nbJumps;
+	uint32_t *nbShortBefore; /* How many of the jumps before each one are short */
+};
+
+struct Relaxation {
+	struct RelaxableSection *sections;
+	size_t nbSections;
+	size_t capacity;
+};
+
+static bool isRelaxableJump(struct Patch const *patch, struct Section const *section)
+{
+	if (patch->type != PATCHTYPE_JP || patch->pcSection != section || patch->offset < 1)
+		return false;
+
+	uint8_t opcode = section->data[patch->offset - 1];
+
+	/* `jp n16` or `jp cc, n16` */
+	return opcode == 0xC3 || (opcode & 0xE7) == 0xC2;
+}
+
+static int compareJumps(void const *a, void const *b)
+{
+	struct RelaxableJump const *jump1 = a;
+	struct RelaxableJump const *jump2 = b;
+
+	return jump1->offset < jump2->offset ? -1 : jump1->offset > jump2->offset;
+}
+
+/**
+ * Registers a section's `jp`s for relaxation
+ * @param section The section to scan
+ * @param arg The relaxation to add it to
+ */
+static void collectJumps(struct Section *section, void *arg)
+{
+	struct Relaxation *relaxation = arg;
+	uint32_t nbJumps = 0;
+
+	/* Shrinking a section in a union or with fragments would misalign the others */
+	if (!sect_HasData(section->type) || section->nextu)
+		return;
+	for (uint32_t i = 0; i < section->nbPatches; i++) {
+		if (isRelaxableJump(&section->patches[i], section))
+			nbJumps++;
+	}
+	if (!nbJumps)
+		return;
+
+	if (relaxation->nbSections == relaxation->capacity) {
+		relaxation->capacity = relaxation->capacity ? relaxation->capacity * 2 : 16;
+		relaxation->sections = realloc(relaxation->sections,
+					       sizeof(*relaxation->sections) * relaxation->capacity);
+		if (!relaxation->sections)
+			err(1, "Failed to relax jumps");
+	}
+
+	struct RelaxableSection *relaxable = &relaxation->sections[relaxation->nbSections++];
+
+	relaxable->section = section;
+	relaxable->size = section->size;
+	relaxable->symbolOffsets = malloc(sizeof(*relaxable->symbolOffsets) * (section->nbSymbols + 1));
+	relaxable->jumps = malloc(sizeof(*relaxable->jumps) * nbJumps);
+	relaxable->nbJumps = 0;
+	relaxable->nbShortBefore = malloc(sizeof(*relaxable->nbShortBefore) * (nbJumps + 1));
+	if (!relaxable->symbolOffsets || !relaxable->jumps || !relaxable->nbShortBefore)
+		err(1, "Failed to relax jumps in section \"%s\"", section->name);
+
+	for (uint32_t i = 0; i < section->nbSymbols; i++)
+		relaxable->symbolOffsets[i] = section->symbols[i]->offset;
+	for (uint32_t i = 0; i < section->nbPatches; i++) {
+		struct Patch *patch = &section->patches[i];
+
+		if (!isRelaxableJump(patch, section))
+			continue;
+		relaxable->jumps[relaxable->nbJumps++] = (struct RelaxableJump){
+			.patch = patch,
+			.offset = patch->offset - 1,
+			.isShort = false,
+			.isPinned = false
+		};
+	}
+	qsort(relaxable->jumps, relaxable->nbJumps, sizeof(*relaxable->jumps), compareJumps);
+}
+
+/**
+ * Gets where something in a section ends up once its jumps are relaxed
+ * @param relaxable The section
+ * @param offset The offset of the thing, before relaxing
+ * @return Its offset after relaxing
+ */
+static uint16_t getRelaxedOffset(struct RelaxableSection const *relaxable, int32_t offset)
+{
+	/* Shortening a jump removes the operand's high byte, two bytes after its opcode */
+	uint32_t low = 0, high = relaxable->nbJumps;
+
+	while (low < high) {
+		uint32_t mid = low + (high - low) / 2;
+
+		if (relaxable->jumps[mid].offset + 2 < offset)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return offset - relaxable->nbShortBefore[low];
+}
+
+/**
+ * Moves a section's symbols and updates its size according to its short jumps
+ * @param relaxable The section
+ */
+static void updateLayout(struct RelaxableSection *relaxable)
+{
+	struct Section *section = relaxable->section;
+
+	relaxable->nbShortBefore[0] = 0;
+	for (uint32_t i = 0; i < relaxable->nbJumps; i++)
+		relaxable->nbShortBefore[i + 1] =
+			relaxable->nbShortBefore[i] + relaxable->jumps[i].isShort;
+
+	section->size = relaxable->size - relaxable->nbShortBefore[relaxable->nbJumps];
+	for (uint32_t i = 0; i < section->nbSymbols; i++)
+		section->symbols[i]->offset =
+			getRelaxedOffset(relaxable, relaxable->symbolOffsets[i]);
+}
+
+/**
+ * Checks whether a jump's target is within reach of a `jr`, given the current layout
+ * @param relaxable The section containing the jump
+ * @param jump The jump
+ * @return False if the target is too far, or could not be computed
+ */
+static bool isTargetInReach(struct RelaxableSection const *relaxable,
+			    struct RelaxableJump const *jump)
+{
+	struct Section const *section = relaxable->section;
+	struct Patch patch = *jump->patch;
+
+	patch.pcOffset = getRelaxedOffset(relaxable, patch.pcOffset);
+
+	int32_t value = computeRPNExpr(&patch,
+				       (struct Symbol const * const *)section->fileSymbols);
+
+	if (isError)
+		return false;
+
+	/* Offset is relative to the byte *after* the `jr` */
+	uint16_t address = section->org + getRelaxedOffset(relaxable, jump->offset) + 2;
+	int16_t jumpOffset = value - address;
+
+	return jumpOffset >= -128 && jumpOffset <= 127;
+}
+
+/**
+ * Rewrites a section once its short jumps are final
+ * @param relaxable The section
+ * @return How many jumps were shortened
+ */
+static uint32_t rewriteSection(struct RelaxableSection *relaxable)
+{
+	struct Section *section = relaxable->section;
+	uint32_t nbShort = relaxable->nbShortBefore[relaxable->nbJumps];
+	uint32_t jumpID = 0;
+	uint16_t newOffset = 0;
+
+	for (uint16_t offset = 0; offset < relaxable->size; offset++) {
+		while (jumpID < relaxable->nbJumps && relaxable->jumps[jumpID].offset + 2 < offset)
+			jumpID++;
+		struct RelaxableJump const *jump = jumpID < relaxable->nbJumps
+							? &relaxable->jumps[jumpID] : NULL;
+		uint8_t byte = section->data[offset];
+
+		if (jump && jump->isShort && offset == jump->offset) {
+			/* `jp` is $C3, `jp cc` is $C2 + cc * 8; `jr` is $18, `jr cc` is $20 + cc * 8 */
+			byte = byte == 0xC3 ? 0x18 : byte - 0xC2 + 0x20;
+		} else if (jump && jump->isShort && offset == jump->offset + 2) {
+			continue; /* The high byte of the target goes away */
+		}
+		section->data[newOffset++] = byte;
+	}
+
+	for (uint32_t i = 0; i < relaxable->nbJumps; i++) {
+		if (relaxable->jumps[i].isShort)
+			relaxable->jumps[i].patch->type = PATCHTYPE_JR;
+	}
+	for (uint32_t i = 0; i < section->nbPatches; i++) {
+		struct Patch *patch = &section->patches[i];
+
+		patch->offset = getRelaxedOffset(relaxable, patch->offset);
+		if (patch->pcSection == section)
+			patch->pcOffset = getRelaxedOffset(relaxable, patch->pcOffset);
+	}
+	return nbShort;
+}
+
+void patch_RelaxJumps(struct Assertion *assertions)
+{
+	struct Relaxation relaxation = { .sections = NULL, .nbSections = 0, .capacity = 0 };
+
+	sect_ForEach(collectJumps, &relaxation);
+	if (!relaxation.nbSections)
+		return;
+
+	verbosePrint("Relaxing jumps in %zu sections...\n", relaxation.nbSections);
+	initRPNStack();
+	isQuiet = true;
+
+	/*
+	 * Shortening a jump may bring others out of reach, for example if it is
+	 * between a jump and a target in another section. Such jumps are lengthened
+	 * back for good, so this ends after each jump has changed at most twice.
+	 */
+	bool hasChanged;
+
+	do {
+		hasChanged = false;
+		for (size_t i = 0; i < relaxation.nbSections; i++)
+			updateLayout(&relaxation.sections[i]);
+
+		for (size_t i = 0; i < relaxation.nbSections; i++) {
+			struct RelaxableSection const *relaxable = &relaxation.sections[i];
+
+			for (uint32_t j = 0; j < relaxable->nbJumps; j++) {
+				struct RelaxableJump *jump = &relaxable->jumps[j];
+
+				if (jump->isPinned)
+					continue;
+				bool isInReach = isTargetInReach(relaxable, jump);
+
+				if (!jump->isShort && isInReach) {
+					jump->isShort = true;
+					hasChanged = true;
+				} else if (jump->isShort && !isInReach) {
+					jump->isShort = false;
+					jump->isPinned = true;
+					hasChanged = true;
+				}
+			}
+		}
+	} while (hasChanged);
+
+	isQuiet = false;
+	freeRPNStack();
+
+	uint32_t nbShort = 0;
+
+	for (size_t i = 0; i < relaxation.nbSections; i++)
+		nbShort += rewriteSection(&relaxation.sections[i]);
+
+	/* Assertions may refer to PC in a relaxed section */
+	for (struct Assertion *assert = assertions; assert; assert = assert->next) {
+		for (size_t i = 0; i < relaxation.nbSections; i++) {
+			if (assert->patch.pcSection == relaxation.sections[i].section) {
+				assert->patch.pcOffset = getRelaxedOffset(&relaxation.sections[i],
+									  assert->patch.pcOffset);
+				break;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < relaxation.nbSections; i++) {
+		free(relaxation.sections[i].symbolOffsets);
+		free(relaxation.sections[i].jumps);
+		free(relaxation.sections[i].nbShortBefore);
+	}
+	free(relaxation.sections);
+	verbosePrint("Shortened %" PRIu32 " jumps\n", nbShort);
+}
+
 /**
  * Applies all of a section's patches
  * @param section The section to patch
@@ -482,7 +974,9 @@ static void applyFilePatches(struct Section *section, struct Section *dataSectio
 			} const types[] = {
 				[PATCHTYPE_BYTE] = {1,      -128,       255},
 				[PATCHTYPE_WORD] = {2,    -32768,     65536},
-				[PATCHTYPE_LONG] = {4, INT32_MIN, INT32_MAX}
+				[PATCHTYPE_LONG] = {4, INT32_MIN, INT32_MAX},
+				/* `jp`s that could not be shortened */
+				[PATCHTYPE_JP]   = {2,    -32768,     65536}
 			};
 
 			if (!isError && (value < types[patch->type].min
@@ -12,13 +12,19 @@
 #include <string.h>
 
 #include "link/main.h"
+#include "link/patch.h"
 #include "link/section.h"
+#include "link/symbol.h"
 
 #include "extern/err.h"
 
 #include "hashmap.h"
 
 HashMap sections;
+/* Sections folded into another one, still looked up by name for `BANK()` */
+static HashMap foldedSections;
+static uint32_t nbFoldedSections;
+static uint32_t foldedSize;
 
 struct ForEachArg {
 	void (*callback)(struct Section *section, void *arg);
@@ -156,16 +162,12 @@ static void mergeSections(struct Section *target, struct Section *other, enum Se
 
 	case SECTION_FRAGMENT:
 		checkFragmentCompat(target, other);
+		if (target->size + other->size > UINT16_MAX)
+			errx(1, "Section \"%s\"'s fragments are too large (%" PRIu32 " bytes)",
+			     other->name, (uint32_t)target->size + other->size);
+		/* The data is only concatenated once all fragments are known */
+		other->offset = target->size;
 		target->size += other->size;
-		other->offset = target->size - other->size;
-		if (sect_HasData(target->type)) {
-			/* Ensure we're not allocating 0 bytes */
-			target->data = realloc(target->data,
-					       sizeof(*target->data) * target->size + 1);
-			if (!target->data)
-				errx(1, "Failed to concatenate \"%s\"'s fragments", target->name);
-			memcpy(target->data + target->size - other->size, other->data, other->size);
-		}
 		break;
 
 	case SECTION_NORMAL:
@@ -204,12 +206,367 @@ void sect_AddSection(struct Section *section)
 
 struct Section *sect_GetSection(char const *name)
 {
-	return (struct Section *)hash_GetElement(sections, name);
+	struct Section *section = hash_GetElement(sections, name);
+
+	return section ? section : hash_GetElement(foldedSections, name);
+}
+
+static void concatFragments(struct Section *section, void *arg)
+{
+	(void)arg;
+
+	if (section->modifier != SECTION_FRAGMENT || !sect_HasData(section->type)
+	 || !section->nextu)
+		return;
+
+	/*
+	 * Grow the first fragment's data, which is already at offset 0.
+	 * Ensure we're not allocating 0 bytes.
+	 */
+	uint8_t *data = realloc(section->data,
+				sizeof(*section->data) * section->size + 1);
+
+	if (!data)
+		err(1, "Failed to concatenate \"%s\"'s fragments", section->name);
+	section->data = data;
+
+	for (struct Section *fragment = section->nextu; fragment;
+	     fragment = fragment->nextu) {
+		memcpy(&data[fragment->offset], fragment->data, fragment->size);
+		/* Patches are applied to the concatenated data from now on */
+		free(fragment->data);
+		fragment->data = NULL;
+	}
+}
+
+void sect_ConcatFragments(void)
+{
+	sect_ForEach(concatFragments, NULL);
+}
+
+/* Sections that have been marked as referenced, but not scanned yet */
+static struct Section **unscannedSections;
+static size_t nbUnscannedSections;
+static size_t unscannedCapacity;
+
+void sect_MarkReferenced(struct Section *section)
+{
+	if (section->modifier != SECTION_NORMAL)
+		section = sect_GetSection(section->name);
+	if (section->isReferenced)
+		return;
+	section->isReferenced = true;
+
+	if (nbUnscannedSections == unscannedCapacity) {
+		unscannedCapacity = unscannedCapacity ? unscannedCapacity * 2 : 64;
+		unscannedSections = realloc(unscannedSections,
+					    sizeof(*unscannedSections) * unscannedCapacity);
+		if (!unscannedSections)
+			err(1, "Failed to allocate memory for garbage collection");
+	}
+	unscannedSections[nbUnscannedSections++] = section;
+}
+
+static void markFixedSection(struct Section *section, void *arg)
+{
+	(void)arg;
+
+	if (section->isAddressFixed)
+		sect_MarkReferenced(section);
+}
+
+struct UnreferencedSections {
+	struct Section **sections;
+	size_t nbSections;
+	size_t capacity;
+};
+
+static void collectUnreferenced(struct Section *section, void *arg)
+{
+	struct UnreferencedSections *unreferenced = arg;
+
+	if (section->isReferenced)
+		return;
+
+	if (unreferenced->nbSections == unreferenced->capacity) {
+		unreferenced->capacity = unreferenced->capacity
+						? unreferenced->capacity * 2 : 64;
+		unreferenced->sections =
+			realloc(unreferenced->sections,
+				sizeof(*unreferenced->sections) * unreferenced->capacity);
+		if (!unreferenced->sections)
+			err(1, "Failed to allocate memory for garbage collection");
+	}
+	unreferenced->sections[unreferenced->nbSections++] = section;
+}
+
+void sect_CollectGarbage(void)
+{
+	verbosePrint("Collecting unreferenced sections...\n");
+
+	sect_ForEach(markFixedSection, NULL);
+
+	for (uint32_t i = 0; i < nbRootSymbols; i++) {
+		struct Symbol const *symbol = sym_GetSymbol(rootSymbols[i]);
+
+		if (!symbol)
+			error(NULL, 0, "Root symbol \"%s\" was not found", rootSymbols[i]);
+		else if (!symbol->section)
+			error(NULL, 0, "Root symbol \"%s\" is not a label", rootSymbols[i]);
+		else
+			sect_MarkReferenced(symbol->section);
+	}
+
+	/* Whatever a kept section refers to must be kept as well */
+	while (nbUnscannedSections) {
+		struct Section *section = unscannedSections[--nbUnscannedSections];
+
+		if (!sect_HasData(section->type))
+			continue;
+		for (; section; section = section->nextu) {
+			for (uint32_t i = 0; i < section->nbPatches; i++)
+				patch_ForEachSectionRef(&section->patches[i],
+							(struct Symbol const * const *)
+								section->fileSymbols,
+							sect_MarkReferenced);
+		}
+	}
+	free(unscannedSections);
+	unscannedSections = NULL;
+	unscannedCapacity = 0;
+
+	/* Sections can't be removed while iterating over them */
+	struct UnreferencedSections unreferenced = {
+		.sections = NULL, .nbSections = 0, .capacity = 0
+	};
+
+	sect_ForEach(collectUnreferenced, &unreferenced);
+	for (size_t i = 0; i < unreferenced.nbSections; i++) {
+		struct Section *section = unreferenced.sections[i];
+
+		verbosePrint("Removing unreferenced section \"%s\"\n", section->name);
+		hash_RemoveElement(sections, section->name);
+		sect_FreeSection(section);
+	}
+	free(unreferenced.sections);
+}
+
+/* A section that may be folded, along with the hash of its contents */
+struct FoldCandidate {
+	struct Section *section;
+	uint32_t hash;
+};
+
+static uint32_t hashBytes(uint32_t hash, void const *bytes, size_t size)
+{
+	uint8_t const *ptr = bytes;
+
+	/* FNV-1a */
+	while (size--)
+		hash = (hash ^ *ptr++) * 16777619;
+	return hash;
+}
+
+static uint32_t hashSection(struct Section const *section)
+{
+	uint32_t hash = 2166136261;
+
+	/* Symbols in patches are resolved differently, so only hash their position */
+	hash = hashBytes(hash, &section->size, sizeof(section->size));
+	hash = hashBytes(hash, section->data, section->size);
+	hash = hashBytes(hash, &section->nbPatches, sizeof(section->nbPatches));
+	for (uint32_t i = 0; i < section->nbPatches; i++)
+		hash = hashBytes(hash, &section->patches[i].offset,
+				 sizeof(section->patches[i].offset));
+	return hash;
+}
+
+static void collectFoldCandidate(struct Section *section, void *arg)
+{
+	struct FoldCandidate **candidate = arg;
+
+	/* Only floating sections with data can be folded */
+	if (section->modifier != SECTION_NORMAL || !sect_HasData(section->type)
+	 || section->isAddressFixed || section->size == 0)
+		return;
+
+	(*candidate)->section = section;
+	(*candidate)->hash = hashSection(section);
+	(*candidate)++;
+}
+
+static void countSection(struct Section *section, void *arg)
+{
+	(void)section;
+	(*(size_t *)arg)++;
+}
+
+static int compareFoldCandidates(void const *a, void const *b)
+{
+	struct FoldCandidate const *candidate1 = a, *candidate2 = b;
+
+	if (candidate1->hash != candidate2->hash)
+		return candidate1->hash < candidate2->hash ? -1 : 1;
+	/* Keep the result independent of the hash map's order */
+	return strcmp(candidate1->section->name, candidate2->section->name);
+}
+
+static bool areSectionsIdentical(struct Section const *section1,
+				 struct Section const *section2)
+{
+	if (section1->type != section2->type || section1->size != section2->size
+	 || section1->isBankFixed != section2->isBankFixed
+	 || (section1->isBankFixed && section1->bank != section2->bank)
+	 || section1->isAlignFixed != section2->isAlignFixed
+	 || (section1->isAlignFixed && (section1->alignMask != section2->alignMask
+				     || section1->alignOfs != section2->alignOfs))
+	 || section1->nbPatches != section2->nbPatches
+	 || memcmp(section1->data, section2->data, section1->size))
+		return false;
+
+	for (uint32_t i = 0; i < section1->nbPatches; i++) {
+		if (!patch_AreEquivalent(&section1->patches[i], section1,
+					 &section2->patches[i], section2))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Folds a section into another, identical one
+ * @param section The section to keep
+ * @param folded The section to fold into it
+ */
+static void foldSection(struct Section *section, struct Section *folded)
+{
+	verbosePrint("Folding section \"%s\" into \"%s\"\n", folded->name, section->name);
+
+	hash_RemoveElement(sections, folded->name);
+	hash_AddElement(foldedSections, folded->name, folded);
+	folded->folded = section->folded;
+	section->folded = folded;
+	nbFoldedSections++;
+	foldedSize += folded->size;
+
+	if (!folded->nbSymbols)
+		return;
+
+	/* Merge both sorted symbol lists, the kept section's symbols first */
+	uint32_t nbSymbols = section->nbSymbols + folded->nbSymbols;
+	struct Symbol **symbols = malloc(sizeof(*symbols) * nbSymbols);
+
+	if (!symbols)
+		err(1, "Failed to fold section \"%s\"'s symbols", folded->name);
+
+	uint32_t a = 0, b = 0;
+
+	for (uint32_t i = 0; i < nbSymbols; i++) {
+		if (b == folded->nbSymbols
+		 || (a != section->nbSymbols
+		  && section->symbols[a]->offset <= folded->symbols[b]->offset))
+			symbols[i] = section->symbols[a++];
+		else
+			symbols[i] = folded->symbols[b++];
+	}
+
+	/* This is the only link from the symbols back to their section */
+	for (uint32_t i = 0; i < folded->nbSymbols; i++)
+		folded->symbols[i]->section = section;
+
+	free(section->symbols);
+	section->symbols = symbols;
+	section->nbSymbols = nbSymbols;
+	free(folded->symbols);
+	folded->symbols = NULL;
+	folded->nbSymbols = 0;
+}
+
+void sect_FoldIdenticalSections(void)
+{
+	verbosePrint("Folding identical sections...\n");
+
+	size_t nbSections = 0;
+
+	sect_ForEach(countSection, &nbSections);
+
+	struct FoldCandidate *candidates = malloc(sizeof(*candidates) * nbSections + 1);
+	struct FoldCandidate *end = candidates;
+
+	if (!candidates)
+		err(1, "Failed to allocate memory for section folding");
+	sect_ForEach(collectFoldCandidate, &end);
+	qsort(candidates, end - candidates, sizeof(*candidates), compareFoldCandidates);
+
+	/* Folding sections may make those referring to them identical, so repeat until it doesn't */
+	bool hasFolded;
+
+	do {
+		hasFolded = false;
+		/* Only sections with the same hash may be identical */
+		for (struct FoldCandidate *group = candidates; group != end; ) {
+			struct FoldCandidate *groupEnd = group + 1;
+
+			while (groupEnd != end && groupEnd->hash == group->hash)
+				groupEnd++;
+
+			for (struct FoldCandidate *kept = group; kept != groupEnd; kept++) {
+				if (!kept->section)
+					continue;
+				for (struct FoldCandidate *other = kept + 1; other != groupEnd;
+				     other++) {
+					if (other->section
+					 && areSectionsIdentical(kept->section, other->section)) {
+						foldSection(kept->section, other->section);
+						other->section = NULL;
+						hasFolded = true;
+					}
+				}
+			}
+			group = groupEnd;
+		}
+	} while (hasFolded);
+
+	free(candidates);
+}
+
+uint32_t sect_GetFoldedSize(uint32_t *nbSections)
+{
+	*nbSections = nbFoldedSections;
+	return foldedSize;
+}
+
+void sect_FreeSection(struct Section *section)
+{
+	struct Section *folded = section->folded;
+
+	while (folded) {
+		struct Section *next = folded->folded;
+
+		folded->folded = NULL;
+		sect_FreeSection(folded);
+		folded = next;
+	}
+
+	while (section) {
+		struct Section *next = section->nextu;
+
+		free(section->name);
+		if (sect_HasData(section->type)) {
+			free(section->data);
+			for (int32_t i = 0; i < section->nbPatches; i++)
+				free(section->patches[i].rpnExpression);
+			free(section->patches);
+		}
+		free(section->symbols);
+		free(section);
+		section = next;
+	}
 }
 
 void sect_CleanupSections(void)
 {
 	hash_EmptyMap(sections);
+	hash_EmptyMap(foldedSections);
 }
 
 static bool sanityChecksFailed;
@@ -0,0 +1,364 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2021, RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "link/main.h"
+#include "link/section.h"
+#include "link/state.h"
+
+#include "extern/err.h"
+#include "hashmap.h"
+#include "linkdefs.h"
+#include "platform.h"
+
+#define STATE_ID "RGBS"
+#define STATE_REV 2U
+
+struct Placement {
+	char *name;
+	enum SectionType type;
+	uint32_t bank;
+	uint16_t org;
+};
+
+struct BankState {
+	uint16_t len;
+	uint64_t hash;
+};
+
+static bool isRecording;
+
+/* What the previous link did */
+static struct Placement *placements;
+static uint32_t nbPlacements;
+static HashMap placementIndex;
+static bool hasOutput;
+static uint32_t outputSize;
+static uint32_t outputTime;
+static uint32_t outputTimeNsec;
+static uint64_t outputHeaderHash;
+static struct BankState *prevBanks;
+static uint32_t nbPrevBanks;
+
+/* What this link does */
+static bool isUpdatingOutput;
+static struct BankState *banks;
+static uint32_t nbBanks;
+
+static bool readLong(FILE *file, uint32_t *value)
+{
+	*value = 0;
+	for (uint8_t shift = 0; shift < 32; shift += 8) {
+		int byte = getc(file);
+
+		if (byte == EOF)
+			return false;
+		*value |= (uint32_t)byte << shift;
+	}
+	return true;
+}
+
+static char *readString(FILE *file)
+{
+	size_t capacity = 32;
+	size_t len = 0;
+	char *str = malloc(capacity);
+
+	if (!str)
+		return NULL;
+	for (;;) {
+		int byte = getc(file);
+
+		if (byte == EOF) {
+			free(str);
+			return NULL;
+		}
+		if (len == capacity) {
+			capacity *= 2;
+			char *newStr = realloc(str, capacity);
+
+			if (!newStr) {
+				free(str);
+				return NULL;
+			}
+			str = newStr;
+		}
+		str[len++] = byte;
+		if (!byte)
+			return str;
+	}
+}
+
+static void writeLong(uint32_t value, FILE *file)
+{
+	putc(value, file);
+	putc(value >> 8, file);
+	putc(value >> 16, file);
+	putc(value >> 24, file);
+}
+
+/**
+ * Reads the previous link's state.
+ * @return False if the file is not a valid state file
+ */
+static bool readState(FILE *file)
+{
+	char id[sizeof(STATE_ID) - 1];
+	uint32_t value;
+
+	if (fread(id, 1, sizeof(id), file) != sizeof(id) || memcmp(id, STATE_ID, sizeof(id))
+	 || !readLong(file, &value) || value != STATE_REV)
+		return false;
+
+	if (!readLong(file, &value))
+		return false;
+	hasOutput = value != 0;
+	if (!readLong(file, &outputSize) || !readLong(file, &outputTime)
+	 || !readLong(file, &outputTimeNsec))
+		return false;
+	uint32_t low, high;
+
+	if (!readLong(file, &low) || !readLong(file, &high))
+		return false;
+	outputHeaderHash = (uint64_t)high << 32 | low;
+
+	if (!readLong(file, &nbPrevBanks))
+		return false;
+	prevBanks = malloc(sizeof(*prevBanks) * nbPrevBanks + 1);
+	if (!prevBanks)
+		err(1, "Failed to read the state of the previous link");
+	for (uint32_t i = 0; i < nbPrevBanks; i++) {
+		if (!readLong(file, &value) || !readLong(file, &low) || !readLong(file, &high))
+			return false;
+		prevBanks[i].len = value;
+		prevBanks[i].hash = (uint64_t)high << 32 | low;
+	}
+
+	if (!readLong(file, &value))
+		return false;
+	placements = malloc(sizeof(*placements) * value + 1);
+	if (!placements)
+		err(1, "Failed to read the state of the previous link");
+	for (nbPlacements = 0; nbPlacements < value; nbPlacements++) {
+		struct Placement *placement = &placements[nbPlacements];
+		int type = getc(file);
+		uint32_t org;
+
+		if (type == EOF || type >= SECTTYPE_INVALID)
+			return false;
+		placement->type = type;
+		if (!readLong(file, &placement->bank) || !readLong(file, &org))
+			return false;
+		placement->org = org;
+		placement->name = readString(file);
+		if (!placement->name)
+			return false;
+	}
+
+	for (uint32_t i = 0; i < nbPlacements; i++)
+		hash_AddElement(placementIndex, placements[i].name, &placements[i]);
+	return true;
+}
+
+void state_Read(char const *fileName)
+{
+	isRecording = true;
+
+	FILE *file = fopen(fileName, "rb");
+
+	if (!file) {
+		if (errno != ENOENT)
+			warn("Ignoring state file \"%s\"", fileName);
+		else
+			verbosePrint("No state file, linking from scratch\n");
+		return;
+	}
+
+	if (!readState(file)) {
+		warnx("Ignoring state file \"%s\", which is invalid", fileName);
+		state_Cleanup();
+		isRecording = true;
+	} else {
+		verbosePrint("Read the placement of %" PRIu32 " sections from \"%s\"\n",
+			     nbPlacements, fileName);
+	}
+	fclose(file);
+}
+
+bool state_GetPlacement(struct Section const *section, uint32_t *bank, uint16_t *org)
+{
+	struct Placement const *placement = hash_GetElement(placementIndex, section->name);
+
+	if (!placement || placement->type != section->type)
+		return false;
+	*bank = placement->bank;
+	*org = placement->org;
+	return true;
+}
+
+/* FNV-1a, to tell whether a bank changed since the previous link */
+static uint64_t hashBank(uint8_t const *data, uint16_t len)
+{
+	uint64_t hash = 0xcbf29ce484222325;
+
+	for (uint16_t i = 0; i < len; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+/**
+ * Hashes the ROM header of a file, which e.g. `rgbfix` changes without altering the size
+ * @return False if the file could not be read
+ */
+static bool hashHeader(char const *fileName, uint64_t *hash)
+{
+	FILE *file = fopen(fileName, "rb");
+	uint8_t header[0x150 - 0x100];
+	size_t len = 0;
+
+	if (!file)
+		return false;
+	if (fseek(file, 0x100, SEEK_SET) == 0)
+		len = fread(header, 1, sizeof(header), file);
+	bool isRead = !ferror(file);
+
+	fclose(file);
+	*hash = hashBank(header, len);
+	return isRead;
+}
+
+bool state_CanUpdateOutput(char const *fileName, uint16_t const *bankLens, uint32_t nbBankLens)
+{
+	banks = malloc(sizeof(*banks) * nbBankLens + 1);
+	if (!banks)
+		err(1, "Failed to record the output's banks");
+	nbBanks = nbBankLens;
+	for (uint32_t i = 0; i < nbBanks; i++)
+		banks[i].len = bankLens[i];
+
+	struct stat fileInfo;
+	uint64_t headerHash;
+
+	/*
+	 * The file must still be the one written by the previous link; the modification time
+	 * may not be precise enough to tell, so the header (which is often fixed) is checked too
+	 */
+	if (!hasOutput || !strcmp(fileName, "-") || nbBanks != nbPrevBanks
+	 || stat(fileName, &fileInfo) != 0 || !S_ISREG(fileInfo.st_mode)
+	 || (uint32_t)fileInfo.st_size != outputSize
+	 || (uint32_t)fileInfo.st_mtime != outputTime
+	 || (uint32_t)STAT_MTIME_NSEC(fileInfo) != outputTimeNsec
+	 || !hashHeader(fileName, &headerHash) || headerHash != outputHeaderHash)
+		return false;
+	/* Each bank must be at the same place as before */
+	for (uint32_t i = 0; i < nbBanks; i++) {
+		if (banks[i].len != prevBanks[i].len)
+			return false;
+	}
+
+	isUpdatingOutput = true;
+	verbosePrint("Only writing the banks that changed\n");
+	return true;
+}
+
+bool state_UpdateBank(uint32_t index, uint8_t const *data, uint16_t len)
+{
+	if (!isRecording)
+		return true;
+
+	uint64_t hash = hashBank(data, len);
+
+	banks[index].hash = hash;
+	return !isUpdatingOutput || prevBanks[index].hash != hash;
+}
+
+struct StateWriter {
+	FILE *file;
+	uint32_t nbSections;
+};
+
+static void writePlacement(struct Section *section, void *arg)
+{
+	struct StateWriter *writer = arg;
+
+	/* The sections are counted first, then written */
+	if (!writer->file) {
+		writer->nbSections++;
+		return;
+	}
+	putc(section->type, writer->file);
+	writeLong(section->bank, writer->file);
+	writeLong(section->org, writer->file);
+	fwrite(section->name, 1, strlen(section->name) + 1, writer->file);
+}
+
+void state_Write(char const *fileName)
+{
+	struct StateWriter writer = { .file = NULL, .nbSections = 0 };
+	struct stat fileInfo;
+	uint64_t headerHash;
+	/* Only a regular file can be updated in place */
+	bool hasFile = banks && strcmp(outputFileName, "-")
+		&& !stat(outputFileName, &fileInfo) && S_ISREG(fileInfo.st_mode)
+		&& hashHeader(outputFileName, &headerHash);
+
+	sect_ForEach(writePlacement, &writer);
+
+	writer.file = openFile(fileName, "wb");
+	fputs(STATE_ID, writer.file);
+	writeLong(STATE_REV, writer.file);
+
+	writeLong(hasFile, writer.file);
+	writeLong(hasFile ? fileInfo.st_size : 0, writer.file);
+	writeLong(hasFile ? fileInfo.st_mtime : 0, writer.file);
+	writeLong(hasFile ? STAT_MTIME_NSEC(fileInfo) : 0, writer.file);
+	writeLong(hasFile ? headerHash : 0, writer.file);
+	writeLong(hasFile ? headerHash >> 32 : 0, writer.file);
+
+	writeLong(hasFile ? nbBanks : 0, writer.file);
+	for (uint32_t i = 0; hasFile && i < nbBanks; i++) {
+		writeLong(banks[i].len, writer.file);
+		writeLong(banks[i].hash, writer.file);
+		writeLong(banks[i].hash >> 32, writer.file);
+	}
+
+	writeLong(writer.nbSections, writer.file);
+	sect_ForEach(writePlacement, &writer);
+
+	if (fclose(writer.file) != 0)
+		err(1, "Cannot write %s", fileName);
+}
+
+void state_Cleanup(void)
+{
+	hash_EmptyMap(placementIndex);
+	for (uint32_t i = 0; i < nbPlacements; i++)
+		free(placements[i].name);
+	free(placements);
+	placements = NULL;
+	nbPlacements = 0;
+	free(prevBanks);
+	prevBanks = NULL;
+	nbPrevBanks = 0;
+	hasOutput = false;
+	free(banks);
+	banks = NULL;
+	nbBanks = 0;
+	isRecording = false;
+	isUpdatingOutput = false;
+}
@@ -0,0 +1,79 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2021, RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+/* MSVC doesn't provide pthreads, so everything runs on a single thread there */
+#ifndef _MSC_VER
+# include <pthread.h>
+# define HAS_THREADS
+#endif
+
+#include "parallel.h"
+
+#ifdef HAS_THREADS
+struct TaskQueue {
+	pthread_mutex_t mutex;
+	size_t nextTask;
+	size_t nbTasks;
+	void (*task)(size_t index, void *arg);
+	void *arg;
+};
+
+static void *runTasks(void *arg)
+{
+	struct TaskQueue *queue = arg;
+
+	for (;;) {
+		pthread_mutex_lock(&queue->mutex);
+		size_t i = queue->nextTask < queue->nbTasks ? queue->nextTask++ : queue->nbTasks;
+
+		pthread_mutex_unlock(&queue->mutex);
+		if (i == queue->nbTasks)
+			return NULL;
+		queue->task(i, queue->arg);
+	}
+}
+#endif
+
+void par_Run(size_t nbTasks, unsigned long nbThreads,
+	     void (*task)(size_t index, void *arg), void *arg)
+{
+#ifdef HAS_THREADS
+	if (nbThreads > nbTasks)
+		nbThreads = nbTasks;
+	/* The calling thread also takes part, so it needs no extra thread */
+	pthread_t *threads = nbThreads > 1 ? malloc(sizeof(*threads) * (nbThreads - 1)) : NULL;
+
+	if (threads) {
+		struct TaskQueue queue = {
+			.mutex = PTHREAD_MUTEX_INITIALIZER,
+			.nextTask = 0,
+			.nbTasks = nbTasks,
+			.task = task,
+			.arg = arg
+		};
+		unsigned long nbStarted = 0;
+
+		while (nbStarted < nbThreads - 1
+		    && !pthread_create(&threads[nbStarted], NULL, runTasks, &queue))
+			nbStarted++;
+		runTasks(&queue);
+		for (unsigned long i = 0; i < nbStarted; i++)
+			pthread_join(threads[i], NULL);
+
+		pthread_mutex_destroy(&queue.mutex);
+		free(threads);
+		return;
+	}
+#else
+	(void)nbThreads;
+#endif
+	for (size_t i = 0; i < nbTasks; i++)
+		task(i, arg);
+}
@@ -0,0 +1,825 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2020, Eldred habert and RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+#include "helpers.h"
+#include "romheader.h"
+
+#define UNSPECIFIED 0x100 // May not be in byte range
+
+enum MbcType {
+	ROM  = 0x00,
+	ROM_RAM = 0x08,
+	ROM_RAM_BATTERY = 0x09,
+
+	MBC1 = 0x01,
+	MBC1_RAM = 0x02,
+	MBC1_RAM_BATTERY = 0x03,
+
+	MBC2 = 0x05,
+	MBC2_BATTERY = 0x06,
+
+	MMM01 = 0x0B,
+	MMM01_RAM = 0x0C,
+	MMM01_RAM_BATTERY = 0x0D,
+
+	MBC3 = 0x11,
+	MBC3_TIMER_BATTERY = 0x0F,
+	MBC3_TIMER_RAM_BATTERY = 0x10,
+	MBC3_RAM = 0x12,
+	MBC3_RAM_BATTERY = 0x13,
+
+	MBC5 = 0x19,
+	MBC5_RAM = 0x1A,
+	MBC5_RAM_BATTERY = 0x1B,
+	MBC5_RUMBLE = 0x1C,
+	MBC5_RUMBLE_RAM = 0x1D,
+	MBC5_RUMBLE_RAM_BATTERY = 0x1E,
+
+	MBC6 = 0x20,
+
+	MBC7_SENSOR_RUMBLE_RAM_BATTERY = 0x22,
+
+	POCKET_CAMERA = 0xFC,
+
+	BANDAI_TAMA5 = 0xFD,
+
+	HUC3 = 0xFE,
+
+	HUC1_RAM_BATTERY = 0xFF,
+
+	// Error values
+	MBC_NONE = UNSPECIFIED, // No MBC specified, do not act on it
+	MBC_BAD, // Specified MBC does not exist / syntax error
+	MBC_WRONG_FEATURES, // MBC incompatible with specified features
+	MBC_BAD_RANGE, // MBC number out of range
+};
+
+/**
+ * @return False on failure
+ */
+static bool readMBCSlice(char const **name, char const *expected)
+{
+	while (*expected) {
+		char c = *(*name)++;
+
+		if (c == '\0') // Name too short
+			return false;
+
+		if (c >= 'a' && c <= 'z') // Perform the comparison case-insensitive
+			c = c - 'a' + 'A';
+		else if (c == '_') // Treat underscores as spaces
+			c = ' ';
+
+		if (c != *expected++)
+			return false;
+	}
+	return true;
+}
+
+static enum MbcType parseMBC(char const *name)
+{
+	if (name[0] >= '0' && name[0] <= '9') {
+		// Parse number, and return it as-is (unless it's too large)
+		char *endptr;
+		unsigned long mbc = strtoul(name, &endptr, 0);
+
+		if (*endptr)
+			return MBC_BAD;
+		if (mbc > 0xFF)
+			return MBC_BAD_RANGE;
+		return mbc;
+
+	} else {
+		// Begin by reading the MBC type:
+		uint16_t mbc;
+		char const *ptr = name;
+
+		// Trim off leading whitespace
+		while (*ptr == ' ' || *ptr == '\t')
+			ptr++;
+
+#define tryReadSlice(expected) \
+do { \
+	if (!readMBCSlice(&ptr, expected)) \
+		return MBC_BAD; \
+} while (0)
+
+		switch (*ptr++) {
+		case 'R': // ROM / ROM_ONLY
+		case 'r':
+			tryReadSlice("OM");
+			// Handle optional " ONLY"
+			while (*ptr == ' ' || *ptr == '\t' || *ptr == '_')
+				ptr++;
+			if (*ptr == 'O' || *ptr == 'o') {
+				ptr++;
+				tryReadSlice("NLY");
+			}
+			mbc = ROM;
+			break;
+
+		case 'M': // MBC{1, 2, 3, 5, 6, 7} / MMM01
+		case 'm':
+			switch (*ptr++) {
+			case 'B':
+			case 'b':
+				switch (*ptr++) {
+				case 'C':
+				case 'c':
+					break;
+				default:
+					return MBC_BAD;
+				}
+				switch (*ptr++) {
+				case '1':
+					mbc = MBC1;
+					break;
+				case '2':
+					mbc = MBC2;
+					break;
+				case '3':
+					mbc = MBC3;
+					break;
+				case '5':
+					mbc = MBC5;
+					break;
+				case '6':
+					mbc = MBC6;
+					break;
+				case '7':
+					mbc = MBC7_SENSOR_RUMBLE_RAM_BATTERY;
+					break;
+				default:
+					return MBC_BAD;
+				}
+				break;
+			case 'M':
+			case 'm':
+				tryReadSlice("M01");
+				mbc = MMM01;
+				break;
+			default:
+				return MBC_BAD;
+			}
+			break;
+
+		case 'P': // POCKET_CAMERA
+		case 'p':
+			tryReadSlice("OCKET CAMERA");
+			mbc = POCKET_CAMERA;
+			break;
+
+		case 'B': // BANDAI_TAMA5
+		case 'b':
+			tryReadSlice("ANDAI TAMA5");
+			mbc = BANDAI_TAMA5;
+			break;
+
+		case 'T': // TAMA5
+		case 't':
+			tryReadSlice("AMA5");
+			mbc = BANDAI_TAMA5;
+			break;
+
+		case 'H': // HuC{1, 3}
+		case 'h':
+			tryReadSlice("UC");
+			switch (*ptr++) {
+			case '1':
+				mbc = HUC1_RAM_BATTERY;
+				break;
+			case '3':
+				mbc = HUC3;
+				break;
+			default:
+				return MBC_BAD;
+			}
+			break;
+
+		default:
+			return MBC_BAD;
+		}
+
+		// Read "additional features"
+		uint8_t features = 0;
+#define RAM 0x80
+#define BATTERY 0x40
+#define TIMER 0x20
+#define RUMBLE 0x10
+#define SENSOR 0x08
+
+		for (;;) {
+			// Trim off trailing whitespace
+			while (*ptr == ' ' || *ptr == '\t' || *ptr == '_')
+				ptr++;
+
+			// If done, start processing "features"
+			if (!*ptr)
+				break;
+			// We expect a '+' at this point
+			if (*ptr++ != '+')
+				return MBC_BAD;
+			// Trim off leading whitespace
+			while (*ptr == ' ' || *ptr == '\t' || *ptr == '_')
+				ptr++;
+
+			switch (*ptr++) {
+			case 'B': // BATTERY
+			case 'b':
+				tryReadSlice("ATTERY");
+				features |= BATTERY;
+				break;
+
+			case 'R': // RAM or RUMBLE
+			case 'r':
+				switch (*ptr++) {
+				case 'U':
+				case 'u':
+					tryReadSlice("MBLE");
+					features |= RUMBLE;
+					break;
+				case 'A':
+				case 'a':
+					if (*ptr != 'M' && *ptr != 'm')
+						return MBC_BAD;
+					ptr++;
+					features |= RAM;
+					break;
+				default:
+					return MBC_BAD;
+				}
+				break;
+
+			case 'S': // SENSOR
+			case 's':
+				tryReadSlice("ENSOR");
+				features |= SENSOR;
+				break;
+
+			case 'T': // TIMER
+			case 't':
+				tryReadSlice("IMER");
+				features |= TIMER;
+				break;
+
+			default:
+				return MBC_BAD;
+			}
+		}
+#undef tryReadSlice
+
+		switch (mbc) {
+		case ROM:
+			if (!features)
+				break;
+			mbc = ROM_RAM - 1;
+			static_assert(ROM_RAM + 1 == ROM_RAM_BATTERY, "Enum sanity check failed!");
+			static_assert(MBC1 + 1 == MBC1_RAM, "Enum sanity check failed!");
+			static_assert(MBC1 + 2 == MBC1_RAM_BATTERY, "Enum sanity check failed!");
+			static_assert(MMM01 + 1 == MMM01_RAM, "Enum sanity check failed!");
+			static_assert(MMM01 + 2 == MMM01_RAM_BATTERY, "Enum sanity check failed!");
+			// fallthrough
+		case MBC1:
+		case MMM01:
+			if (features == RAM)
+				mbc++;
+			else if (features == (RAM | BATTERY))
+				mbc += 2;
+			else if (features)
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case MBC2:
+			if (features == BATTERY)
+				mbc = MBC2_BATTERY;
+			else if (features)
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case MBC3:
+			// Handle timer, which also requires battery
+			if (features & (TIMER & BATTERY)) {
+				features &= ~(TIMER | BATTERY); // Reset those bits
+				mbc = MBC3_TIMER_BATTERY;
+				// RAM is handled below
+			}
+			static_assert(MBC3 + 1 == MBC3_RAM, "Enum sanity check failed!");
+			static_assert(MBC3 + 2 == MBC3_RAM_BATTERY, "Enum sanity check failed!");
+			static_assert(MBC3_TIMER_BATTERY + 1 == MBC3_TIMER_RAM_BATTERY,
+				      "Enum sanity check failed!");
+			if (features == RAM)
+				mbc++;
+			else if (features == (RAM | BATTERY))
+				mbc += 2;
+			else if (features)
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case MBC5:
+			if (features & RUMBLE) {
+				features &= ~RUMBLE;
+				mbc = MBC5_RUMBLE;
+			}
+			static_assert(MBC5 + 1 == MBC5_RAM, "Enum sanity check failed!");
+			static_assert(MBC5 + 2 == MBC5_RAM_BATTERY, "Enum sanity check failed!");
+			static_assert(MBC5_RUMBLE + 1 == MBC5_RUMBLE_RAM, "Enum sanity check failed!");
+			static_assert(MBC5_RUMBLE + 2 == MBC5_RUMBLE_RAM_BATTERY,
+				      "Enum sanity check failed!");
+			if (features == RAM)
+				mbc++;
+			else if (features == (RAM | BATTERY))
+				mbc += 2;
+			else if (features)
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case MBC6:
+		case POCKET_CAMERA:
+		case BANDAI_TAMA5:
+		case HUC3:
+			// No extra features accepted
+			if (features)
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case MBC7_SENSOR_RUMBLE_RAM_BATTERY:
+			if (features != (SENSOR | RUMBLE | RAM | BATTERY))
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case HUC1_RAM_BATTERY:
+			if (features != (RAM | BATTERY)) // HuC1 expects RAM+BATTERY
+				return MBC_WRONG_FEATURES;
+			break;
+		}
+
+		// Trim off trailing whitespace
+		while (*ptr == ' ' || *ptr == '\t')
+			ptr++;
+
+		// If there is still something past the whitespace, error out
+		if (*ptr)
+			return MBC_BAD;
+
+		return mbc;
+	}
+}
+
+static char const *mbcName(enum MbcType type)
+{
+	switch (type) {
+	case ROM:
+		return "ROM";
+	case ROM_RAM:
+		return "ROM+RAM";
+	case ROM_RAM_BATTERY:
+		return "ROM+RAM+BATTERY";
+	case MBC1:
+		return "MBC1";
+	case MBC1_RAM:
+		return "MBC1+RAM";
+	case MBC1_RAM_BATTERY:
+		return "MBC1+RAM+BATTERY";
+	case MBC2:
+		return "MBC2";
+	case MBC2_BATTERY:
+		return "MBC2+BATTERY";
+	case MMM01:
+		return "MMM01";
+	case MMM01_RAM:
+		return "MMM01+RAM";
+	case MMM01_RAM_BATTERY:
+		return "MMM01+RAM+BATTERY";
+	case MBC3:
+		return "MBC3";
+	case MBC3_TIMER_BATTERY:
+		return "MBC3+TIMER+BATTERY";
+	case MBC3_TIMER_RAM_BATTERY:
+		return "MBC3+TIMER+RAM+BATTERY";
+	case MBC3_RAM:
+		return "MBC3+RAM";
+	case MBC3_RAM_BATTERY:
+		return "MBC3+RAM+BATTERY";
+	case MBC5:
+		return "MBC5";
+	case MBC5_RAM:
+		return "MBC5+RAM";
+	case MBC5_RAM_BATTERY:
+		return "MBC5+RAM+BATTERY";
+	case MBC5_RUMBLE:
+		return "MBC5+RUMBLE";
+	case MBC5_RUMBLE_RAM:
+		return "MBC5+RUMBLE+RAM";
+	case MBC5_RUMBLE_RAM_BATTERY:
+		return "MBC5+RUMBLE+RAM+BATTERY";
+	case MBC6:
+		return "MBC6";
+	case MBC7_SENSOR_RUMBLE_RAM_BATTERY:
+		return "MBC7+SENSOR+RUMBLE+RAM+BATTERY";
+	case POCKET_CAMERA:
+		return "POCKET CAMERA";
+	case BANDAI_TAMA5:
+		return "BANDAI TAMA5";
+	case HUC3:
+		return "HUC3";
+	case HUC1_RAM_BATTERY:
+		return "HUC1+RAM+BATTERY";
+
+	// Error values
+	case MBC_NONE:
+	case MBC_BAD:
+	case MBC_WRONG_FEATURES:
+	case MBC_BAD_RANGE:
+		unreachable_();
+	}
+
+	unreachable_();
+}
+
+static bool hasRAM(enum MbcType type)
+{
+	switch (type) {
+	case ROM:
+	case MBC1:
+	case MBC2: // Technically has RAM, but not marked as such
+	case MBC2_BATTERY:
+	case MMM01:
+	case MBC3:
+	case MBC3_TIMER_BATTERY:
+	case MBC5:
+	case MBC5_RUMBLE:
+	case MBC6: // TODO: not sure
+	case BANDAI_TAMA5: // TODO: not sure
+	case MBC_NONE:
+	case MBC_BAD:
+	case MBC_WRONG_FEATURES:
+	case MBC_BAD_RANGE:
+		return false;
+
+	case ROM_RAM:
+	case ROM_RAM_BATTERY:
+	case MBC1_RAM:
+	case MBC1_RAM_BATTERY:
+	case MMM01_RAM:
+	case MMM01_RAM_BATTERY:
+	case MBC3_TIMER_RAM_BATTERY:
+	case MBC3_RAM:
+	case MBC3_RAM_BATTERY:
+	case MBC5_RAM:
+	case MBC5_RAM_BATTERY:
+	case MBC5_RUMBLE_RAM:
+	case MBC5_RUMBLE_RAM_BATTERY:
+	case MBC7_SENSOR_RUMBLE_RAM_BATTERY:
+	case POCKET_CAMERA:
+	case HUC3:
+	case HUC1_RAM_BATTERY:
+		return true;
+	}
+
+	unreachable_();
+}
+
+static const uint8_t ninLogo[] = {
+	0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B,
+	0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
+	0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E,
+	0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
+	0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC,
+	0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E
+};
+
+static enum { DMG, BOTH, CGB } model = DMG; // If DMG, byte is left alone
+#define   FIX_LOGO        0x80
+#define TRASH_LOGO        0x40
+#define   FIX_HEADER_SUM  0x20
+#define TRASH_HEADER_SUM  0x10
+#define   FIX_GLOBAL_SUM  0x08
+#define TRASH_GLOBAL_SUM  0x04
+static uint8_t fixSpec = 0;
+static const char *gameID = NULL;
+static uint8_t gameIDLen;
+static bool japanese = true;
+static const char *newLicensee = NULL;
+static uint8_t newLicenseeLen;
+static uint16_t oldLicensee = UNSPECIFIED;
+static enum MbcType cartridgeType = MBC_NONE;
+static uint16_t romVersion = UNSPECIFIED;
+static uint16_t ramSize = UNSPECIFIED;
+static bool sgb = false; // If false, SGB flags are left alone
+static const char *title = NULL;
+static uint8_t titleLen;
+
+static uint8_t maxTitleLen(void)
+{
+	return gameID ? 11 :  model != DMG ? 15 : 16;
+}
+
+
+bool hdr_ParseByte(uint16_t *value, char const *name, char const *arg)
+{
+	char *endptr;
+	unsigned long tmp;
+
+	if (arg[0] == 0) {
+		fprintf(stderr, "error: Argument to option '%s' may not be empty\n", name);
+		return false;
+	}
+	if (arg[0] == '$')
+		tmp = strtoul(&arg[1], &endptr, 16);
+	else
+		tmp = strtoul(arg, &endptr, 0);
+
+	if (*endptr) {
+		fprintf(stderr, "error: Expected number as argument to option '%s', got %s\n",
+			name, arg);
+		return false;
+	} else if (tmp > 0xFF) {
+		fprintf(stderr, "error: Argument to option '%s' is larger than 255: %lu\n",
+			name, tmp);
+		return false;
+	}
+	*value = tmp;
+	return true;
+}
+
+bool hdr_ParseOption(char option, char const *arg)
+{
+	size_t len;
+
+	switch (option) {
+	case 'C':
+	case 'c':
+		model = option == 'c' ? BOTH : CGB;
+		if (titleLen > 15) {
+			titleLen = 15;
+			fprintf(stderr, "warning: Truncating title \"%s\" to 15 chars\n", title);
+		}
+		break;
+
+	case 'f':
+		fixSpec = 0;
+		while (*arg) {
+			switch (*arg) {
+#define SPEC_l FIX_LOGO
+#define SPEC_L TRASH_LOGO
+#define SPEC_h FIX_HEADER_SUM
+#define SPEC_H TRASH_HEADER_SUM
+#define SPEC_g FIX_GLOBAL_SUM
+#define SPEC_G TRASH_GLOBAL_SUM
+#define or(new, bad) \
+do { \
+	if (fixSpec & SPEC_##bad) \
+		fprintf(stderr, \
+			"warning: '" #new "' overriding '" #bad "' in fix spec\n"); \
+	fixSpec = (fixSpec & ~SPEC_##bad) | SPEC_##new; \
+} while (0)
+			case 'l':
+				or(l, L);
+				break;
+			case 'L':
+				or(L, l);
+				break;
+
+			case 'h':
+				or(h, H);
+				break;
+			case 'H':
+				or(H, h);
+				break;
+
+			case 'g':
+				or(g, G);
+				break;
+			case 'G':
+				or(G, g);
+				break;
+
+			default:
+				fprintf(stderr, "warning: Ignoring '%c' in fix spec\n", *arg);
+#undef or
+			}
+			arg++;
+		}
+		break;
+
+	case 'i':
+		gameID = arg;
+		len = strlen(gameID);
+		if (len > 4) {
+			len = 4;
+			fprintf(stderr, "warning: Truncating game ID \"%s\" to 4 chars\n", gameID);
+		}
+		gameIDLen = len;
+		if (titleLen > 11) {
+			titleLen = 11;
+			fprintf(stderr, "warning: Truncating title \"%s\" to 11 chars\n", title);
+		}
+		break;
+
+	case 'j':
+		japanese = false;
+		break;
+
+	case 'k':
+		newLicensee = arg;
+		len = strlen(newLicensee);
+		if (len > 2) {
+			len = 2;
+			fprintf(stderr, "warning: Truncating new licensee \"%s\" to 2 chars\n",
+				newLicensee);
+		}
+		newLicenseeLen = len;
+		break;
+
+	case 'l':
+		return hdr_ParseByte(&oldLicensee, "l", arg);
+
+	case 'm':
+		cartridgeType = parseMBC(arg);
+		if (cartridgeType == MBC_BAD) {
+			fprintf(stderr, "error: Unknown MBC \"%s\"\n", arg);
+			return false;
+		} else if (cartridgeType == MBC_WRONG_FEATURES) {
+			fprintf(stderr, "error: Features incompatible with MBC (\"%s\")\n", arg);
+			return false;
+		} else if (cartridgeType == MBC_BAD_RANGE) {
+			fprintf(stderr, "error: Specified MBC ID out of range 0-255: %s\n", arg);
+			return false;
+		} else if (cartridgeType == ROM_RAM || cartridgeType == ROM_RAM_BATTERY) {
+			fprintf(stderr, "warning: ROM+RAM / ROM+RAM+BATTERY are under-specified and poorly supported\n");
+		}
+		break;
+
+	case 'n':
+		return hdr_ParseByte(&romVersion, "n", arg);
+
+	case 'r':
+		return hdr_ParseByte(&ramSize, "r", arg);
+
+	case 's':
+		sgb = true;
+		break;
+
+	case 't':
+		title = arg;
+		len = strlen(title);
+		uint8_t maxLen = maxTitleLen();
+
+		if (len > maxLen) {
+			len = maxLen;
+			fprintf(stderr, "warning: Truncating title \"%s\" to %u chars\n",
+				title, maxLen);
+		}
+		titleLen = len;
+		break;
+
+	case 'v':
+		fixSpec = FIX_LOGO | FIX_HEADER_SUM | FIX_GLOBAL_SUM;
+		break;
+
+	default:
+		unreachable_();
+	}
+	return true;
+}
+
+void hdr_CheckOptions(void)
+{
+	if (ramSize != UNSPECIFIED && cartridgeType < UNSPECIFIED) {
+		if (cartridgeType == ROM_RAM || cartridgeType == ROM_RAM_BATTERY) {
+			if (ramSize != 1)
+				fprintf(stderr, "warning: MBC \"%s\" should have 2kiB of RAM (-r 1)\n",
+					mbcName(cartridgeType));
+		} else if (hasRAM(cartridgeType)) {
+			if (!ramSize) {
+				fprintf(stderr,
+					"warning: MBC \"%s\" has RAM, but RAM size was set to 0\n",
+					mbcName(cartridgeType));
+			} else if (ramSize == 1) {
+				fprintf(stderr,
+					"warning: RAM size 1 (2 kiB) was specified for MBC \"%s\"\n",
+					mbcName(cartridgeType));
+			} // TODO: check possible values?
+		} else if (ramSize) {
+			fprintf(stderr,
+				"warning: MBC \"%s\" has no RAM, but RAM size was set to %u\n",
+				mbcName(cartridgeType), ramSize);
+		}
+	}
+
+	if (sgb && oldLicensee != UNSPECIFIED && oldLicensee != 0x33)
+		fprintf(stderr,
+			"warning: SGB compatibility enabled, but old licensee is %#x, not 0x33\n",
+			oldLicensee);
+}
+
+bool hdr_IsFixing(void)
+{
+	return fixSpec || title || gameID || model != DMG || newLicensee || sgb
+	    || cartridgeType < MBC_NONE || ramSize != UNSPECIFIED || !japanese
+	    || oldLicensee != UNSPECIFIED || romVersion != UNSPECIFIED;
+}
+
+bool hdr_FixesGlobalSum(void)
+{
+	return fixSpec & (FIX_GLOBAL_SUM | TRASH_GLOBAL_SUM);
+}
+
+void hdr_FixFields(uint8_t rom0[MIN_NB_ELMS(HEADER_SIZE)])
+{
+	if (fixSpec & (FIX_LOGO | TRASH_LOGO)) {
+		if (fixSpec & FIX_LOGO) {
+			memcpy(&rom0[0x104], ninLogo, sizeof(ninLogo));
+		} else {
+			for (uint8_t i = 0; i < sizeof(ninLogo); i++)
+				rom0[i + 0x104] = ~ninLogo[i];
+		}
+	}
+
+	if (title)
+		memcpy(&rom0[0x134], title, titleLen);
+
+	if (gameID)
+		memcpy(&rom0[0x13f], gameID, gameIDLen);
+
+	if (model != DMG)
+		rom0[0x143] = model == BOTH ? 0x80 : 0xc0;
+
+	if (newLicensee)
+		memcpy(&rom0[0x144], newLicensee, newLicenseeLen);
+
+	if (sgb)
+		rom0[0x146] = 0x03;
+
+	// If a valid MBC was specified...
+	if (cartridgeType < MBC_NONE)
+		rom0[0x147] = cartridgeType;
+
+	if (ramSize != UNSPECIFIED)
+		rom0[0x149] = ramSize;
+
+	if (!japanese)
+		rom0[0x14a] = 0x01;
+
+	if (oldLicensee != UNSPECIFIED)
+		rom0[0x14b] = oldLicensee;
+
+	if (romVersion != UNSPECIFIED)
+		rom0[0x14c] = romVersion;
+}
+
+void hdr_FixHeaderSum(uint8_t rom0[MIN_NB_ELMS(HEADER_SIZE)])
+{
+	if (fixSpec & (FIX_HEADER_SUM | TRASH_HEADER_SUM)) {
+		uint8_t sum = 0;
+
+		for (uint16_t i = 0x134; i < 0x14d; i++)
+			sum -= rom0[i] + 1;
+		rom0[0x14d] = fixSpec & TRASH_HEADER_SUM ? ~sum : sum;
+	}
+}
+
+void hdr_FixGlobalSum(uint8_t rom0[MIN_NB_ELMS(HEADER_SIZE)], uint16_t sum)
+{
+	if (fixSpec & (FIX_GLOBAL_SUM | TRASH_GLOBAL_SUM)) {
+		if (fixSpec & TRASH_GLOBAL_SUM)
+			sum = ~sum;
+		rom0[0x14e] = sum >> 8;
+		rom0[0x14f] = sum & 0xff;
+	}
+}
+
+uint16_t hdr_SumBytes(uint8_t const *data, size_t len)
+{
+	uint16_t sum = 0;
+
+#ifdef __SSE2__
+	// `psadbw` against zero sums groups of 8 bytes into each 64-bit lane
+	__m128i const zero = _mm_setzero_si128();
+	__m128i acc = zero;
+
+	for (; len >= 16; len -= 16, data += 16)
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((__m128i const *)data),
+						      zero));
+	// Only the low 16 bits of the lanes matter
+	sum = _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc));
+#endif
+	while (len--)
+		sum += *data++;
+	return sum;
+}
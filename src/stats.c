@@ -0,0 +1,182 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2021, RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+/* Neither MSVC nor MinGW provide `getrusage` */
+#if !defined(_MSC_VER) && !defined(__MINGW32__)
+# include <sys/resource.h>
+# define HAS_GETRUSAGE
+#endif
+
+#include "stats.h"
+
+#define MAX_PHASES 16
+#define MAX_COUNTERS 16
+
+struct Phase {
+	char const *name;
+	double wallTime; /* In seconds */
+	double cpuTime; /* In seconds */
+	long peakMemory; /* In KiB, reached by the end of the phase; -1 if unknown */
+};
+
+enum StatsFormat statsFormat = STATS_NONE;
+
+static struct Phase phases[MAX_PHASES];
+static unsigned int nbPhases = 0;
+static bool inPhase = false;
+static double phaseWallStart;
+static clock_t phaseCPUStart;
+
+static struct {
+	char const *name;
+	uint64_t value;
+} counters[MAX_COUNTERS];
+static unsigned int nbCounters = 0;
+
+bool stats_SetFormat(char const *arg)
+{
+	if (!arg || !strcmp(arg, "text"))
+		statsFormat = STATS_TEXT;
+	else if (!strcmp(arg, "json"))
+		statsFormat = STATS_JSON;
+	else
+		return false;
+	return true;
+}
+
+double stats_GetWallTime(void)
+{
+	struct timespec now;
+
+	if (!timespec_get(&now, TIME_UTC))
+		return (double)clock() / CLOCKS_PER_SEC;
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static long getPeakMemory(void)
+{
+#ifdef HAS_GETRUSAGE
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return -1;
+# ifdef __APPLE__
+	return usage.ru_maxrss / 1024; /* macOS reports bytes instead of KiB */
+# else
+	return usage.ru_maxrss;
+# endif
+#else
+	return -1;
+#endif
+}
+
+void stats_StartPhase(char const *name)
+{
+	if (statsFormat == STATS_NONE)
+		return;
+	stats_EndPhase();
+	assert(nbPhases < MAX_PHASES);
+
+	phases[nbPhases].name = name;
+	inPhase = true;
+	phaseWallStart = stats_GetWallTime();
+	phaseCPUStart = clock();
+}
+
+void stats_EndPhase(void)
+{
+	if (!inPhase)
+		return;
+
+	struct Phase *phase = &phases[nbPhases++];
+
+	phase->wallTime = stats_GetWallTime() - phaseWallStart;
+	phase->cpuTime = (double)(clock() - phaseCPUStart) / CLOCKS_PER_SEC;
+	phase->peakMemory = getPeakMemory();
+	inPhase = false;
+}
+
+void stats_SetCounter(char const *name, uint64_t value)
+{
+	if (statsFormat == STATS_NONE)
+		return;
+	assert(nbCounters < MAX_COUNTERS);
+
+	counters[nbCounters].name = name;
+	counters[nbCounters].value = value;
+	nbCounters++;
+}
+
+static void printText(char const *toolName)
+{
+	double totalWall = 0, totalCPU = 0;
+
+	fprintf(stderr, "%s statistics:\n", toolName);
+	fprintf(stderr, "  %-20s %12s %12s %16s\n", "Phase", "Wall (ms)", "CPU (ms)",
+		"Peak mem (KiB)");
+	for (unsigned int i = 0; i < nbPhases; i++) {
+		struct Phase const *phase = &phases[i];
+
+		fprintf(stderr, "  %-20s %12.3f %12.3f ", phase->name,
+			phase->wallTime * 1000, phase->cpuTime * 1000);
+		if (phase->peakMemory < 0)
+			fprintf(stderr, "%16s\n", "?");
+		else
+			fprintf(stderr, "%16ld\n", phase->peakMemory);
+		totalWall += phase->wallTime;
+		totalCPU += phase->cpuTime;
+	}
+	fprintf(stderr, "  %-20s %12.3f %12.3f\n", "(total)", totalWall * 1000, totalCPU * 1000);
+
+	for (unsigned int i = 0; i < nbCounters; i++)
+		fprintf(stderr, "  %-20s %12" PRIu64 "\n", counters[i].name, counters[i].value);
+}
+
+static void printJSON(char const *toolName)
+{
+	/* None of the strings printed here need escaping */
+	fprintf(stderr, "{\"tool\":\"%s\",\"phases\":[", toolName);
+	for (unsigned int i = 0; i < nbPhases; i++) {
+		struct Phase const *phase = &phases[i];
+
+		fprintf(stderr, "%s{\"name\":\"%s\",\"wall_ms\":%.3f,\"cpu_ms\":%.3f,\"peak_mem_kib\":",
+			i ? "," : "", phase->name, phase->wallTime * 1000, phase->cpuTime * 1000);
+		if (phase->peakMemory < 0)
+			fputs("null}", stderr);
+		else
+			fprintf(stderr, "%ld}", phase->peakMemory);
+	}
+	fputs("],\"counters\":{", stderr);
+	for (unsigned int i = 0; i < nbCounters; i++)
+		fprintf(stderr, "%s\"%s\":%" PRIu64, i ? "," : "", counters[i].name,
+			counters[i].value);
+	fputs("}}\n", stderr);
+}
+
+void stats_Print(char const *toolName)
+{
+	stats_EndPhase();
+
+	switch (statsFormat) {
+	case STATS_NONE:
+		break;
+	case STATS_TEXT:
+		printText(toolName);
+		break;
+	case STATS_JSON:
+		printJSON(toolName);
+		break;
+	}
+}
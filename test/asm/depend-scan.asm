@@ -0,0 +1,11 @@
+SECTION "data", ROM0[0]
+	ds 4
+Label:
+	INCBIN "incbin-slice.inc", 0, 5
+
+; Label values must stay the same as in a full assembly
+IF Label == 4
+	INCLUDE "depend-scan.inc"
+ELSE
+	INCLUDE "nonexistent.inc"
+ENDC
@@ -0,0 +1,7 @@
+SECTION "incbin", ROM0
+	INCBIN "incbin-slice.inc"
+	INCBIN "incbin-slice.inc", 7
+	INCBIN "incbin-slice.inc", 0, 5
+	INCBIN "incbin-slice.inc", 14, 6
+	INCBIN "incbin-slice.inc", 19, 1
+	INCBIN "incbin-slice.inc", 0, 20
@@ -0,0 +1,10 @@
+MACRO fill
+	REPT \1
+		db \2
+	ENDR
+ENDM
+
+SECTION "profile", ROM0
+	fill 3, 1
+	INCLUDE "profile.inc"
+	fill 2, 2
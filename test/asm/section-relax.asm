@@ -0,0 +1,11 @@
+SECTION "Floating", ROMX, RELAX
+	align 4 ; Nothing before can shrink
+	jp Floating
+	ds 13
+	align 4 ; Would be misaligned once the `jp` is shortened
+Aligned:
+
+SECTION "Fixed", ROM0[$100], RELAX
+SECTION "RAM", WRAM0, RELAX
+SECTION UNION "Union", ROMX, RELAX
+SECTION FRAGMENT "Fragment", ROMX, RELAX
@@ -0,0 +1,10 @@
+MACRO m
+	db \1
+ENDM
+
+SECTION "stats", ROM0
+Label:
+	REPT 3
+		m 42
+	ENDR
+	dw Label
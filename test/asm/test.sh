@@ -119,4 +119,52 @@ for i in *.asm; do
 	done
 done
 
+# These tests do their own thing
+
+i="depend-scan.asm"
+variant=""
+echo "${bold}${green}${i%.asm}...${rescolors}${resbold}"
+rm -f $o
+$RGBASM -MS -MP -MT depend-scan.o -o $o $i > $output
+tryDiff ${i%.asm}.d $output out
+rc=$(($? || $rc))
+# Only scanning for dependencies must not write an object file
+if [ -e $o ]; then
+	echo "${bold}${red}${i%.asm} wrote an object file!${rescolors}${resbold}"
+	rc=1
+fi
+
+i="stats.asm"
+# Timings and memory usage vary, so only check the report's shape
+for variant in '.text' '.json' '.invalid'; do
+	echo "${bold}${green}${i%.asm}${variant}...${rescolors}${resbold}"
+	case $variant in
+	.text)
+		$RGBASM --stats -o $o $i 2>&1 >/dev/null |
+			sed -E '/\./ s/[0-9?]+(\.[0-9]+)?/N/g; s/ +/ /g' > $errput
+		;;
+	.json)
+		$RGBASM --stats=json -o $o $i 2>&1 >/dev/null |
+			sed -E 's/[0-9]+\.[0-9]+/N/g; s/"peak_mem_kib":([0-9]+|null)/"peak_mem_kib":N/g' > $errput
+		;;
+	.invalid)
+		if $RGBASM --stats=xml -o $o $i 2> $errput; then
+			echo "${bold}${red}${i%.asm}${variant} should have failed!${rescolors}${resbold}"
+			rc=1
+		fi
+		;;
+	esac
+	tryDiff ${i%.asm}${variant}.err $errput err
+	rc=$(($? || $rc))
+done
+
+i="profile.asm"
+variant=""
+echo "${bold}${green}${i%.asm}...${rescolors}${resbold}"
+$RGBASM --profile $output -o $o $i
+# Timings vary, which also makes the order of entries vary
+sed -E 's/^ *[0-9]+\.[0-9]+ +[0-9]+\.[0-9]+ +/N N /; s/ +/ /g' $output | sort > $errput
+tryDiff ${i%.asm}.report $errput out
+rc=$(($? || $rc))
+
 exit $rc
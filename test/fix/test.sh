@@ -98,4 +98,23 @@ rc=$(($rc || $? != 1))
 tryDiff "$src/noexist.err" out.err noexist.err
 rc=$(($rc || $?))
 
+# Check that fixing several files at once gives the same results and messages, in order
+echo "${bold}Checking parallel fixing...${resbold}"
+for dir in serial parallel; do
+	mkdir $dir
+	for i in "$src"/*.bin; do
+		cp "$i" $dir/"$(basename "$i" .bin).gb"
+	done
+done
+(cd serial && ../rgbfix -v -p 0xFF *.gb noexist 2>../serial.err)
+rc=$(($rc || $? != 1))
+(cd parallel && ../rgbfix -J 4 -v -p 0xFF *.gb noexist 2>../parallel.err)
+rc=$(($rc || $? != 1))
+tryDiff serial.err parallel.err parallel.err
+rc=$(($rc || $?))
+for i in serial/*.gb; do
+	tryCmp "$i" parallel/"$(basename "$i")"
+	rc=$(($rc || $?))
+done
+
 exit $rc
@@ -0,0 +1,15 @@
+SECTION "Big1", ROMX
+Big1::
+	ds $3000
+SECTION "Big2", ROMX
+Big2::
+	ds $3000
+SECTION "HotA", ROMX
+HotA::
+	ds $1000
+SECTION "HotB", ROMX
+HotB::
+	ds $1000
+SECTION "Cold", ROMX
+Cold::
+	ds $800
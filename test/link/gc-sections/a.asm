@@ -0,0 +1,16 @@
+SECTION "entry", ROM0[$100]
+	jp Main
+
+SECTION "main", ROM0
+Main:
+	call Used
+	ld a, BANK(Banked)
+	ld a, BANK("ByName")
+	jr Main
+
+SECTION "asserted", ROMX
+Asserted:: db 1
+	assert Asserted != 0
+
+SECTION "unreferenced", ROM0
+Unreferenced:: dw Fragment2
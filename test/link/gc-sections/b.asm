@@ -0,0 +1,27 @@
+SECTION "lib", ROM0
+Used:: ret
+; Kept because it's in the same section as `Used`
+NotUsed:: jp Indirect
+
+SECTION "lib2", ROM0
+Indirect:: ret
+
+SECTION "unused", ROM0
+Unused:: ret
+
+SECTION "banked", ROMX
+Banked:: db 2
+
+SECTION "ByName", ROMX
+ByName:: db 3
+
+SECTION "ram", WRAM0
+wUnused:: ds 10
+
+SECTION "root", ROMX
+Root:: dw Root
+
+SECTION FRAGMENT "fragments", ROM0
+Fragment1:: db 1
+SECTION FRAGMENT "fragments", ROM0
+Fragment2:: db 2
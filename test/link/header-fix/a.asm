@@ -0,0 +1,10 @@
+SECTION "entry", ROM0[$100]
+	nop
+	jp $150
+
+SECTION "code", ROM0[$150]
+	di
+	jr @
+
+SECTION "data", ROMX, BANK[2]
+	db "Banked data"
@@ -0,0 +1,19 @@
+SECTION "entry", ROM0[$0]
+	call CopyA
+	call CopyB
+	ld hl, TableB
+	ld a, BANK("tableB")
+	jp Start
+SECTION "copyA", ROM0
+CopyA::
+.loop
+	ld a, [hli]
+	dec c
+	jr nz, .loop
+	call Helper
+	ret
+SECTION "tableA", ROMX
+TableA:: db 1, 2, 3, 4
+SECTION "start", ROM0
+Start: jr Start
+	assert TableA != 0
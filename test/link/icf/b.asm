@@ -0,0 +1,36 @@
+SECTION "copyB", ROM0
+CopyB::
+.loop
+	ld a, [hli]
+	dec c
+	jr nz, .loop
+	call Helper
+	ret
+SECTION "copyC", ROM0
+CopyC::
+.loop
+	ld a, [hli]
+	dec c
+	jr nz, .loop
+	call Other
+	ret
+SECTION "tableB", ROMX
+TableB:: db 1, 2, 3, 4
+SECTION "tableC", ROMX, ALIGN[4]
+TableC:: db 1, 2, 3, 4
+SECTION "helper", ROM0
+Helper:: ret
+Other:: ret
+; Only identical once the helpers they call are folded
+SECTION "callX", ROM0
+CallX:: call HelperX
+	ret
+SECTION "callY", ROM0
+CallY:: call HelperY
+	ret
+SECTION "helperX", ROM0
+HelperX:: ld a, 1
+	ret
+SECTION "helperY", ROM0
+HelperY:: ld a, 1
+	ret
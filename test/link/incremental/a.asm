@@ -0,0 +1,11 @@
+SECTION "entry", ROM0[$0]
+	call Small
+	call Medium
+	ld a, BANK(Large)
+
+SECTION "large", ROMX
+Large:: ds $2000, $11
+
+SECTION "medium", ROMX
+Medium:: ds $800, $22
+	ret
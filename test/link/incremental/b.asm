@@ -0,0 +1,3 @@
+SECTION "small", ROMX
+Small:: db $33
+	ret
@@ -0,0 +1,4 @@
+SECTION "small", ROMX
+; Large enough that a link from scratch would place it before "medium"
+Small:: ds $1000, $44
+	ret
@@ -0,0 +1,4 @@
+SECTION "A", ROMX
+	ds $3000
+SECTION "B", ROMX
+	ds $800
@@ -0,0 +1,7 @@
+SECTION "A", ROMX
+	ds $3000
+SECTION "B", ROMX
+	ds $800
+; Doesn't fit in bank 1 alongside "A", where the previous link placed it
+SECTION "C", ROMX, BANK[1]
+	ds $2000
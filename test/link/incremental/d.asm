@@ -0,0 +1,4 @@
+SECTION "A", ROM0
+	ds $3000
+SECTION "B", ROM0
+	ds $800
@@ -0,0 +1,7 @@
+SECTION "A", ROM0
+	ds $3000
+SECTION "B", ROM0
+	ds $800
+; Only fits at $0000, where the previous link placed "A"
+SECTION "E", ROM0, ALIGN[14]
+	ds $4800
@@ -0,0 +1,43 @@
+; Sections in every region, so that each is placed on its own thread
+
+SECTION "entry", ROM0
+Entry::
+	call Code
+	ld a, BANK(Data)
+	ld hl, Buffer
+	ld [hVar], a
+	ret
+
+SECTION "empty 1", ROM0
+Empty1::
+SECTION "empty 2", ROM0
+Empty2::
+
+SECTION "code", ROMX
+Code::
+	ld a, [sSave]
+	ret
+
+SECTION "data", ROMX
+Data:: ds $2800, $42
+
+SECTION "more data", ROMX
+MoreData:: ds $2800, $24
+
+SECTION "tiles", VRAM
+Tiles:: ds $100
+
+SECTION "save", SRAM
+sSave:: ds $10
+
+SECTION "buffer", WRAM0
+Buffer:: ds $80
+
+SECTION "banked buffer", WRAMX
+BankedBuffer:: ds $80
+
+SECTION "oam", OAM
+wOAM:: ds $A0
+
+SECTION "vars", HRAM
+hVar:: db
@@ -0,0 +1,3 @@
+SECTION "a", ROM0
+FuncA:: call FuncB
+	ret
@@ -0,0 +1,2 @@
+SECTION "b", ROM0
+FuncB:: ret
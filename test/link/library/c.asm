@@ -0,0 +1,2 @@
+SECTION "c", WRAM0
+wVarC:: ds 1
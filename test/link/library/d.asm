@@ -0,0 +1,3 @@
+SECTION "d", ROM0
+FuncD:: jp FuncB
+Start:: ret
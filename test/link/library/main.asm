@@ -0,0 +1,6 @@
+SECTION "entry", ROM0[$0]
+	call FuncA
+	ld a, [wVarC]
+	jp Start
+SECTION "start", ROM0
+Start:: jr Start
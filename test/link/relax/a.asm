@@ -0,0 +1,20 @@
+SECTION "Far", ROM0, RELAX
+Far::
+	ds 200, $00
+	jp Far ; Out of reach backwards, stays a `jp`
+
+SECTION "Code", ROM0, RELAX
+Start::
+	jp Near
+	jp nz, Near
+	ld hl, End - Start ; Computed by the linker once shortened
+.loop
+	jp c, .loop
+	jr .loop
+Near:
+	jp Far
+	jp Other ; In another file
+	call Near
+End:
+	db @ - Start
+	assert End - Start == 18
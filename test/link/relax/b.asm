@@ -0,0 +1,12 @@
+SECTION "Other", ROM0, RELAX
+Other::
+	jp Start
+
+SECTION "Pinned", ROM0, ALIGN[8], RELAX
+	jp Next
+Next:
+	jp Target ; In reach until the jump above is shortened
+
+SECTION "Target", ROM0[$84]
+Target::
+	ret
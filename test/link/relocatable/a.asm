@@ -0,0 +1,20 @@
+SECTION "func", ROMX
+Func::
+	call Helper
+.loop
+	jr .loop
+Helper:
+	ld hl, Data
+	ret
+
+SECTION FRAGMENT "frag", ROM0
+FragMid::
+	dw FragMid, Data
+	REPT 2
+		dw @
+	ENDR
+
+SECTION UNION "union", WRAM0
+UnionA:: ds 4
+
+	assert Helper != 0, "Helper must be defined"
@@ -0,0 +1,14 @@
+SECTION "data", ROMX
+Data::
+	db BANK(Func), BANK("func"), BANK(@)
+	dw Shared
+Shared::
+	ret
+
+SECTION UNION "union", WRAM0
+UnionB:: ds 8
+UnionC:: ds 1
+
+SECTION FRAGMENT "frag", ROM0
+	db LOW(UnionC), BANK(Data)
+	assert FATAL, UnionC == UnionA + 8, "UnionC must follow UnionB"
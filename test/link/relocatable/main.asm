@@ -0,0 +1,9 @@
+SECTION "entry", ROM0[$0]
+	call Func
+	ld a, BANK(Data)
+	ld hl, Data
+	jp Shared
+
+SECTION FRAGMENT "frag", ROM0
+FragStart::
+	dw FragStart, Func
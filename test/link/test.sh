@@ -19,6 +19,7 @@ rescolors="$(tput op)"
 
 RGBASM=../../rgbasm
 RGBLINK=../../rgblink
+RGBFIX=../../rgbfix
 
 startTest () {
 	echo "$bold$green${i%.asm}...$rescolors$resbold"
@@ -99,6 +100,13 @@ done
 
 # These tests do their own thing
 
+i="affinity.asm"
+startTest
+$RGBASM -o $otemp affinity/a.asm
+rgblink --affinity affinity/a.prof -n $outtemp -o $gbtemp $otemp
+tryDiff affinity/out.sym $outtemp
+rc=$(($? || $rc))
+
 i="bank-const.asm"
 startTest
 $RGBASM -o $otemp bank-const/a.asm
@@ -121,6 +129,39 @@ for i in fragment-align/*; do
 	fi
 done
 
+i="gc-sections.asm"
+startTest
+$RGBASM -o $otemp gc-sections/a.asm
+$RGBASM -o $gbtemp2 gc-sections/b.asm
+rgblink --gc-sections -n $outtemp -o $gbtemp $otemp $gbtemp2
+tryDiff gc-sections/out.sym $outtemp
+rc=$(($? || $rc))
+rgblink --gc-sections -s Root -s Fragment1 -n $outtemp -o $gbtemp $otemp $gbtemp2
+tryDiff gc-sections/root.sym $outtemp
+rc=$(($? || $rc))
+# Without --gc-sections, -s is ignored
+rgblink -n $outtemp.all -o $gbtemp $otemp $gbtemp2
+rgblink -s Root -n $outtemp -o $gbtemp $otemp $gbtemp2
+tryDiff $outtemp.all $outtemp
+rc=$(($? || $rc))
+rm -f $outtemp.all
+
+i="header-fix.asm"
+startTest
+$RGBASM -o $otemp header-fix/a.asm
+rgblink -o $gbtemp $otemp
+../../rgbfix -v -C -m MBC5+RAM+BATTERY -r 2 -t HEADERFIX -i TEST -k HF -n 1 -j $gbtemp
+rgblink --validate --color-only --mbc-type MBC5+RAM+BATTERY --ram-size 2 --title HEADERFIX \
+	--game-id TEST --new-licensee HF --rom-version 1 --non-japanese -o $gbtemp2 $otemp
+tryCmp $gbtemp $gbtemp2
+rc=$(($? || $rc))
+# The output may not be seekable, which requires buffering it
+$RGBLINK --validate --title HEADERFIX -o - $otemp | cat > $gbtemp2
+rgblink -o $gbtemp $otemp
+../../rgbfix -v -t HEADERFIX $gbtemp
+tryCmp $gbtemp $gbtemp2
+rc=$(($? || $rc))
+
 i="high-low.asm"
 startTest
 $RGBASM -o $otemp high-low/a.asm
@@ -130,6 +171,117 @@ rgblink -o $gbtemp2 $otemp
 tryCmp $gbtemp $gbtemp2
 rc=$(($? || $rc))
 
+i="icf.asm"
+startTest
+$RGBASM -o $otemp icf/a.asm
+$RGBASM -o $gbtemp2 icf/b.asm
+rgblink --icf -n $outtemp -o $gbtemp $otemp $gbtemp2
+tryDiff icf/out.sym $outtemp
+rc=$(($? || $rc))
+dd if=$gbtemp count=1 bs=$(printf %s $(wc -c < icf/out.gb)) > $otemp 2>/dev/null
+tryCmp icf/out.gb $otemp
+rc=$(($? || $rc))
+
+i="incremental.asm"
+startTest
+statetemp="$(mktemp)"
+rm -f $statetemp
+$RGBASM -o $otemp incremental/a.asm
+$RGBASM -o $outtemp incremental/b.asm
+rgblink --incremental $statetemp -o $gbtemp -n $statetemp.sym $otemp $outtemp
+grep Medium $statetemp.sym > $statetemp.before
+$RGBASM -o $outtemp incremental/b2.asm
+cp $statetemp $statetemp.2
+rgblink --incremental $statetemp -o $gbtemp -n $statetemp.sym $otemp $outtemp
+# A link from scratch would move "medium" after "small", which grew
+grep Medium $statetemp.sym > $statetemp.after
+tryDiff $statetemp.before $statetemp.after
+rc=$(($? || $rc))
+# Only the banks that changed were written, which must give the same ROM as writing all of them
+rgblink --incremental $statetemp.2 -o $gbtemp2 $otemp $outtemp
+tryCmp $gbtemp2 $gbtemp
+rc=$(($? || $rc))
+# Modifying the header must keep the output from being partially rewritten
+rgblink --incremental $statetemp -o $gbtemp $otemp $outtemp
+cp $gbtemp $gbtemp2
+$RGBFIX -v -p 0xFF $gbtemp
+rgblink --incremental $statetemp -o $gbtemp $otemp $outtemp
+tryCmp $gbtemp2 $gbtemp
+rc=$(($? || $rc))
+# The previous placements must not keep sections with a fixed bank from fitting
+rm -f $statetemp
+$RGBASM -o $otemp incremental/c.asm
+rgblink --incremental $statetemp -o $gbtemp $otemp
+$RGBASM -o $otemp incremental/c2.asm
+rgblink --incremental $statetemp -o $gbtemp $otemp
+rc=$(($? || $rc))
+# Nor any other section, by placing the region from scratch if need be
+rm -f $statetemp
+$RGBASM -o $otemp incremental/d.asm
+rgblink -t --incremental $statetemp -o $gbtemp $otemp
+$RGBASM -o $otemp incremental/d2.asm
+rgblink -t --incremental $statetemp -o $gbtemp $otemp
+rc=$(($? || $rc))
+rgblink -t -o $gbtemp2 $otemp
+tryCmp $gbtemp2 $gbtemp
+rc=$(($? || $rc))
+rm -f $statetemp $statetemp.2 $statetemp.sym $statetemp.before $statetemp.after
+
+i="jobs.asm"
+startTest
+$RGBASM -o $otemp jobs/a.asm
+rgblink -J 1 -o $gbtemp -n $outtemp -m $outtemp.map $otemp
+rgblink -J 4 -o $gbtemp2 -n $outtemp.sym -m $outtemp.map2 $otemp
+# Placing the regions in parallel must not change anything
+tryCmp $gbtemp $gbtemp2
+rc=$(($? || $rc))
+tryDiff $outtemp $outtemp.sym
+rc=$(($? || $rc))
+tryDiff $outtemp.map $outtemp.map2
+rc=$(($? || $rc))
+rm -f $outtemp.sym $outtemp.map $outtemp.map2
+
+i="library.asm"
+startTest
+libtemp="$(mktemp)"
+for f in a b c d; do
+	$RGBASM -o $otemp library/$f.asm
+	cp $otemp $libtemp.$f
+done
+rgblink --make-lib -o $libtemp $libtemp.d $libtemp.a $libtemp.b $libtemp.c
+$RGBASM -o $otemp library/main.asm
+rgblink -o $gbtemp $otemp $libtemp
+# Only the members defining undefined symbols must be linked, `d` isn't
+rgblink -o $gbtemp2 $otemp $libtemp.a $libtemp.b $libtemp.c
+tryCmp $gbtemp2 $gbtemp
+rc=$(($? || $rc))
+rm -f $libtemp $libtemp.a $libtemp.b $libtemp.c $libtemp.d
+
+i="relax.asm"
+startTest
+$RGBASM -o $otemp relax/a.asm
+$RGBASM -o $gbtemp2 relax/b.asm
+rgblink -n $outtemp -o $gbtemp $otemp $gbtemp2
+tryDiff relax/out.sym $outtemp
+rc=$(($? || $rc))
+dd if=$gbtemp count=1 bs=$(printf %s $(wc -c < relax/out.gb)) > $otemp 2>/dev/null
+tryCmp relax/out.gb $otemp
+rc=$(($? || $rc))
+
+i="relocatable.asm"
+startTest
+reltemp="$(mktemp)"
+for f in main a b; do
+	$RGBASM -o $reltemp.$f relocatable/$f.asm
+done
+rgblink -r -o $otemp $reltemp.a $reltemp.b
+rgblink -o $gbtemp $reltemp.main $otemp
+# The combined object must link the same as the object files it combines
+rgblink -o $gbtemp2 $reltemp.main $reltemp.a $reltemp.b
+tryCmp $gbtemp2 $gbtemp
+rc=$(($? || $rc))
+rm -f $reltemp $reltemp.main $reltemp.a $reltemp.b
+
 i="overlay.asm"
 startTest
 $RGBASM -o $otemp overlay/a.asm